@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+
+# Runs pht-tester's `--bench` workloads and compares their throughput with
+# `bench-baseline.json`. Exits with 1 if any of them got slower than the
+# baseline by more than the threshold.
+#
+#   ./bench.py build/pht-tester                      every variant and workload
+#   ./bench.py build/pht-tester --variant v2 --workload insert
+#   ./bench.py build/pht-tester --update             record a new baseline
+#
+# Every run of pht-tester also times inserting every key into the base
+# table, and a workload's throughput is compared as a multiple of that
+# reference's. Measured in the same process a moment apart, both slow down
+# together when the machine is busy or slower, so the ratio holds still where
+# absolute operations per second move by 20% or more. That also makes
+# base-insert the reference itself, so it's reported but never gated.
+
+import argparse
+import json
+import pathlib
+import subprocess
+import sys
+
+pht_dir = pathlib.Path(__file__).resolve().parent
+
+VARIANTS = ['base', 'v1', 'v2']
+WORKLOADS = ['insert', 'lookup', 'fixed-keys', 'huge', 'iterate']
+REFERENCE = ('base', 'insert')
+
+parser = argparse.ArgumentParser()
+parser.add_argument('tester', type=pathlib.Path)
+parser.add_argument('--variant', choices=VARIANTS, action='append')
+parser.add_argument('--workload', choices=WORKLOADS, action='append')
+parser.add_argument('--baseline', type=pathlib.Path,
+                    default=pht_dir / 'bench-baseline.json')
+parser.add_argument('--threshold', type=float,
+                    help='allowed slowdown as a fraction, overrides the baseline')
+parser.add_argument('--repeat', type=int, default=5,
+                    help='runs per workload, the fastest one counts')
+parser.add_argument('--update', action='store_true',
+                    help='write the results into the baseline instead')
+args = parser.parse_args()
+
+with open(args.baseline, 'r') as f:
+    baseline = json.load(f)
+threshold = args.threshold
+if threshold is None:
+    threshold = baseline['threshold']
+
+
+# Returns the workload's operations per second, and that as a multiple of
+# the reference's
+def run(variant, workload):
+    process = subprocess.run(
+        [args.tester, '--variant', variant, '--bench', workload,
+         '--threads', str(baseline['threads']),
+         '--size', str(baseline['size'])],
+        stdout=subprocess.PIPE,
+        text=True,
+    )
+    if process.returncode != 0:
+        print(process.stdout, end='')
+        return None
+    result = json.loads(process.stdout.splitlines()[-1])
+    ops_per_sec = result['operations'] / max(result['usec'], 1) * 1e6
+    reference = result['reference_operations'] / max(result['reference_usec'], 1) * 1e6
+    return ops_per_sec, ops_per_sec / reference
+
+
+# The repeats take turns, so a stretch where the machine is busy slows one
+# run of every workload instead of every run of one.
+names = [(variant, workload) for variant in args.variant or VARIANTS
+         for workload in args.workload or WORKLOADS]
+best = {}
+for _ in range(args.repeat):
+    for name in names:
+        if name in best and best[name] is None:
+            continue
+        result = run(*name)
+        if result is None or name not in best or result[1] > best[name][1]:
+            best[name] = result
+
+failed = False
+for variant, workload in names:
+    name = f'{variant}-{workload}'
+    if best[variant, workload] is None:
+        print(f'{name}: pht-tester failed')
+        failed = True
+        continue
+    ops_per_sec, ratio = best[variant, workload]
+    if args.update:
+        baseline['results'].setdefault(variant, {})[workload] = round(ratio, 4)
+        print(f'{name}: {ops_per_sec:,.0f} ops/s, {ratio:.3f}x the reference')
+        continue
+
+    expected = baseline['results'].get(variant, {}).get(workload)
+    if (variant, workload) == REFERENCE:
+        print(f'{name}: {ops_per_sec:,.0f} ops/s, the reference')
+        continue
+    if expected is None:
+        print(f'{name}: {ops_per_sec:,.0f} ops/s, {ratio:.3f}x the reference, '
+              f'no baseline')
+        continue
+    change = ratio / expected - 1
+    status = 'ok'
+    if change < -threshold:
+        status = 'REGRESSION'
+        failed = True
+    print(f'{name}: {ops_per_sec:,.0f} ops/s, {ratio:.3f}x the reference, '
+          f'baseline {expected:.3f}x ({change:+.1%}) {status}')
+
+if args.update:
+    with open(args.baseline, 'w') as f:
+        json.dump(baseline, f, indent=2)
+        f.write('\n')
+
+sys.exit(1 if failed else 0)
@@ -14,6 +14,8 @@ struct list_entry {
 	uint32_t value;
     /* In this case this is just a pointer to the next node. */
 	SLIST_ENTRY(list_entry) pointers;
+	/* Only allocated with a `key_width`, `key` then points here. */
+	struct hash_table_key fixed_key[];
 };
 
 /* This defines a struct called `list_head` that represents our list. */
@@ -32,6 +34,9 @@ struct hash_table_entry {
    your `hash_table_entry`. */
 struct hash_table_base {
 	struct hash_table_entry entries[HASH_TABLE_CAPACITY];
+	enum hash_table_alloc alloc;
+	struct hash_table_pool pool;
+	size_t key_width;
 };
 
 /* This function uses `calloc` to allocate dynamic memory, because it will be
@@ -40,12 +45,28 @@ struct hash_table_base {
    in your hash table's create function as well. */
 struct hash_table_base *hash_table_base_create()
 {
-	struct hash_table_base *hash_table = calloc(1, sizeof(struct hash_table_base));
-	assert(hash_table != NULL);
+	struct hash_table_options options = { 0 };
+	return hash_table_base_create_with(&options);
+}
+
+/* The table itself (and with it the bucket array) and the list entries both
+   come from the allocator picked in `options`. */
+struct hash_table_base *hash_table_base_create_with(const struct hash_table_options *options)
+{
+	struct hash_table_base *hash_table = hash_table_alloc(sizeof(struct hash_table_base),
+	                                                      options->alloc);
 	for (size_t i = 0; i < HASH_TABLE_CAPACITY; ++i) {
 		struct hash_table_entry *entry = &hash_table->entries[i];
 		SLIST_INIT(&entry->list_head);
 	}
+	hash_table->alloc = options->alloc;
+	assert(options->key_width == 0 || options->key_width == 8 || options->key_width == 16);
+	hash_table->key_width = options->key_width;
+	size_t node_size = sizeof(struct list_entry);
+	if (hash_table->key_width != 0) {
+		node_size += sizeof(struct hash_table_key);
+	}
+	hash_table_pool_init(&hash_table->pool, node_size, options->alloc);
 	
 	return hash_table;
 }
@@ -57,7 +78,7 @@ static struct list_head *get_list_head(struct hash_table_base *hash_table,
                                        const char *key)
 {
 	assert(key != NULL);
-	uint32_t index = bernstein_hash(key) % HASH_TABLE_CAPACITY;
+	uint32_t index = hash_table_hash(key, hash_table->key_width) % HASH_TABLE_CAPACITY;
 	struct hash_table_entry *entry = &hash_table->entries[index];
 	struct list_head *list_head = &entry->list_head;
 	return list_head;
@@ -68,12 +89,23 @@ static struct list_head *get_list_head(struct hash_table_base *hash_table,
    table. This function just iterates though the list to find an exact match
    for the key, and if found it immediately returns. Otherwise we return
    `NULL` if the key is not in the hash table. */
-static struct list_entry *get_list_entry(struct list_head *list_head,
+static struct list_entry *get_list_entry(size_t key_width,
+                                         struct list_head *list_head,
                                          const char *key) {
 	assert(key != NULL);
 
 	struct list_entry *entry = NULL;
 	
+	if (key_width != 0) {
+		struct hash_table_key fixed = hash_table_key_load(key, key_width);
+		SLIST_FOREACH(entry, list_head, pointers) {
+			if (hash_table_key_equal(entry->fixed_key, &fixed)) {
+				return entry;
+			}
+		}
+		return NULL;
+	}
+
 	SLIST_FOREACH(entry, list_head, pointers) {
 	  if (strcmp(entry->key, key) == 0) {
 	    return entry;
@@ -89,7 +121,7 @@ bool hash_table_base_contains(struct hash_table_base *hash_table,
                               const char *key)
 {
 	struct list_head *list_head = get_list_head(hash_table, key);
-	struct list_entry *list_entry = get_list_entry(list_head, key);
+	struct list_entry *list_entry = get_list_entry(hash_table->key_width, list_head, key);
 	return list_entry != NULL;
 }
 
@@ -105,7 +137,7 @@ void hash_table_base_add_entry(struct hash_table_base *hash_table,
                                uint32_t value)
 {
 	struct list_head *list_head = get_list_head(hash_table, key);
-	struct list_entry *list_entry = get_list_entry(list_head, key);
+	struct list_entry *list_entry = get_list_entry(hash_table->key_width, list_head, key);
 
 	/* Update the value if it already exists */
 	if (list_entry != NULL) {
@@ -113,7 +145,11 @@ void hash_table_base_add_entry(struct hash_table_base *hash_table,
 		return;
 	}
 
-	list_entry = calloc(1, sizeof(struct list_entry));
+	list_entry = hash_table_pool_alloc(&hash_table->pool);
+	if (hash_table->key_width != 0) {
+		list_entry->fixed_key[0] = hash_table_key_load(key, hash_table->key_width);
+		key = (const char *) list_entry->fixed_key;
+	}
 	list_entry->key = key;
 	list_entry->value = value;
 	SLIST_INSERT_HEAD(list_head, list_entry, pointers);
@@ -127,11 +163,117 @@ uint32_t hash_table_base_get_value(struct hash_table_base *hash_table,
                                    const char *key)
 {
 	struct list_head *list_head = get_list_head(hash_table, key);
-	struct list_entry *list_entry = get_list_entry(list_head, key);
+	struct list_entry *list_entry = get_list_entry(hash_table->key_width, list_head, key);
 	assert(list_entry != NULL);
 	return list_entry->value;
 }
 
+/* Iterators copy one bucket at a time, `bucket` is the next one to copy and
+   `position` how far into the current copy we are. */
+struct hash_table_base_iterator {
+	struct hash_table_base *hash_table;
+	size_t bucket;
+	size_t position;
+	struct hash_table_bucket_copy copy;
+};
+
+static void copy_bucket(struct hash_table_base *hash_table,
+                        size_t bucket,
+                        struct hash_table_bucket_copy *copy)
+{
+	struct list_entry *list_entry = NULL;
+	SLIST_FOREACH(list_entry, &hash_table->entries[bucket].list_head, pointers) {
+		hash_table_bucket_copy_add(copy, list_entry->key, list_entry->value);
+	}
+}
+
+struct hash_table_base_iterator *hash_table_base_iterator_create(struct hash_table_base *hash_table)
+{
+	struct hash_table_base_iterator *iterator = calloc(1, sizeof(struct hash_table_base_iterator));
+	assert(iterator != NULL);
+	iterator->hash_table = hash_table;
+	return iterator;
+}
+
+bool hash_table_base_iterator_next(struct hash_table_base_iterator *iterator,
+                                   const char **key,
+                                   uint32_t *value)
+{
+	while (iterator->position == iterator->copy.count) {
+		if (iterator->bucket == HASH_TABLE_CAPACITY) {
+			return false;
+		}
+		iterator->copy.count = 0;
+		iterator->position = 0;
+		copy_bucket(iterator->hash_table, iterator->bucket++, &iterator->copy);
+	}
+	struct hash_table_copied_entry *entry = &iterator->copy.entries[iterator->position++];
+	*key = entry->key;
+	*value = entry->value;
+	return true;
+}
+
+void hash_table_base_iterator_destroy(struct hash_table_base_iterator *iterator)
+{
+	hash_table_bucket_copy_destroy(&iterator->copy);
+	free(iterator);
+}
+
+struct foreach_arg {
+	struct hash_table_base *hash_table;
+	hash_table_visit visit;
+	void *arg;
+};
+
+/* Nothing else may touch the table meanwhile, so there's no need to copy. */
+static void foreach_range(size_t begin, size_t end, void *arg)
+{
+	struct foreach_arg *foreach = arg;
+	for (size_t i = begin; i < end; ++i) {
+		struct list_entry *list_entry = NULL;
+		SLIST_FOREACH(list_entry, &foreach->hash_table->entries[i].list_head, pointers) {
+			foreach->visit(list_entry->key, list_entry->value, foreach->arg);
+		}
+	}
+}
+
+void hash_table_base_foreach(struct hash_table_base *hash_table,
+                             size_t threads,
+                             hash_table_visit visit,
+                             void *arg)
+{
+	struct foreach_arg foreach = { hash_table, visit, arg };
+	hash_table_foreach_ranges(HASH_TABLE_CAPACITY, threads, foreach_range, &foreach);
+}
+
+/* Walks every list to count the entries in each one, and the bytes of the
+   keys they point to. */
+void hash_table_base_stats(struct hash_table_base *hash_table,
+                           struct hash_table_stats *stats)
+{
+	size_t *chain_lengths = calloc(HASH_TABLE_CAPACITY, sizeof(size_t));
+	assert(chain_lengths != NULL);
+	size_t entries = 0;
+	size_t key_bytes = 0;
+	for (size_t i = 0; i < HASH_TABLE_CAPACITY; ++i) {
+		struct hash_table_entry *hash_table_entry = &hash_table->entries[i];
+		struct list_entry *list_entry = NULL;
+		SLIST_FOREACH(list_entry, &hash_table_entry->list_head, pointers) {
+			++chain_lengths[i];
+			if (hash_table->key_width == 0) {
+				key_bytes += strlen(list_entry->key) + 1;
+			}
+		}
+		entries += chain_lengths[i];
+	}
+
+	stats->bucket_bytes = sizeof(struct hash_table_base);
+	stats->node_bytes = hash_table_pool_bytes(&hash_table->pool, entries);
+	stats->key_bytes = key_bytes;
+	hash_table_stats_from_chains(stats, chain_lengths, HASH_TABLE_CAPACITY);
+	free(chain_lengths);
+}
+
 /* This function uses frees all memory our hash table uses. First it goes
    through the linked lists for every element. To properly free all the memory
    we free each node in the linked list, by remove removing the first node
@@ -148,8 +290,9 @@ void hash_table_base_destroy(struct hash_table_base *hash_table)
 		while (!SLIST_EMPTY(list_head)) {
 			list_entry = SLIST_FIRST(list_head);
 			SLIST_REMOVE_HEAD(list_head, pointers);
-			free(list_entry);
+			hash_table_pool_free(&hash_table->pool, list_entry);
 		}
 	}
-	free(hash_table);
+	hash_table_pool_destroy(&hash_table->pool);
+	hash_table_free(hash_table, sizeof(struct hash_table_base), hash_table->alloc);
 }
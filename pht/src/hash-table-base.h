@@ -12,6 +12,10 @@ struct hash_table_base;
    empty hash table. */
 struct hash_table_base *hash_table_base_create();
 
+/* Same as `hash_table_base_create`, but lets you pick how the hash table
+   allocates its memory, see `struct hash_table_options`. */
+struct hash_table_base *hash_table_base_create_with(const struct hash_table_options *options);
+
 /* Add a new entry to the hash table, this will insert a key (string) with
    a value to the hash table. */
 void hash_table_base_add_entry(struct hash_table_base *hash_table,
@@ -24,6 +28,29 @@ bool hash_table_base_contains(struct hash_table_base *hash_table,
    not in the table this function will terminate the process. */
 uint32_t hash_table_base_get_value(struct hash_table_base *hash_table,
                                    const char* key);
+/* Fills in `stats` with the number of entries, the memory the table uses and
+   how long its chains are. */
+void hash_table_base_stats(struct hash_table_base *hash_table,
+                           struct hash_table_stats *stats);
+
+/* Iterates over a snapshot of the table taken one bucket at a time. The base
+   table has no locks, so it must not change while an iterator is in use. */
+struct hash_table_base_iterator;
+struct hash_table_base_iterator *hash_table_base_iterator_create(struct hash_table_base *hash_table);
+/* Sets the next `key` and `value` and returns `true`, or returns `false` once
+   every bucket has been visited. Keys are valid until the table is destroyed,
+   with a `key_width` they're that many bytes without a NUL terminator. */
+bool hash_table_base_iterator_next(struct hash_table_base_iterator *iterator,
+                                   const char **key,
+                                   uint32_t *value);
+void hash_table_base_iterator_destroy(struct hash_table_base_iterator *iterator);
+/* Calls `visit` for every entry, with `threads` threads each walking their own
+   range of buckets. */
+void hash_table_base_foreach(struct hash_table_base *hash_table,
+                             size_t threads,
+                             hash_table_visit visit,
+                             void *arg);
+
 /* Destroy a hash table, returned from `hash_table_base_create`. This function
    should free all associated memory that the hash table used. It should pass
    `valgrind` with no leaks. */
@@ -0,0 +1,262 @@
+#include "hash-table-cache.h"
+
+#include "hash-table-v2.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Where a cached entry lives. The table maps every key to the index of its
+   slot, and the slot is only read or written with the key's bucket locked,
+   so a slot can't be reused under a lookup that found it. */
+struct cache_slot {
+	const char *key;
+	uint32_t value;
+	atomic_bool referenced;
+};
+
+/* The shard mutex serializes insertions and eviction within a shard, lookups
+   only ever take the table's bucket mutex and set the reference bit. Lock
+   order is always shard, then bucket. Shards are cache line aligned so the
+   counters of different shards don't share a line. */
+struct cache_shard {
+	pthread_mutex_t mutex;
+	/* The shard's slots are `first` up to `first + capacity`, its clock ring. */
+	size_t first;
+	size_t capacity;
+	size_t count;
+	size_t hand;
+	atomic_uint_fast64_t hits;
+	atomic_uint_fast64_t misses;
+	uint64_t insertions;
+	uint64_t evictions;
+} __attribute__((aligned(64)));
+
+struct hash_table_cache {
+	struct hash_table_v2 *table;
+	struct cache_slot *slots;
+	size_t capacity;
+	struct cache_shard shards[HASH_TABLE_CACHE_SHARDS];
+	/* Shards in use, fewer than all of them for small capacities. */
+	size_t shard_count;
+	struct hash_table_cache_callbacks callbacks;
+};
+
+struct hash_table_cache *hash_table_cache_create(
+	size_t capacity,
+	const struct hash_table_cache_callbacks *callbacks)
+{
+	assert(capacity > 0 && capacity <= UINT32_MAX);
+	struct hash_table_cache *cache = aligned_alloc(_Alignof(struct hash_table_cache),
+	                                               sizeof(struct hash_table_cache));
+	assert(cache != NULL);
+	memset(cache, 0, sizeof(struct hash_table_cache));
+
+	/* A bucket per entry the cache can hold, so the table never has to grow
+	   and chains stay short however big the cache is. */
+	struct hash_table_options options = {
+		.initial_capacity = capacity,
+		.removable = true,
+	};
+	cache->table = hash_table_v2_create_with(&options);
+	cache->slots = calloc(capacity, sizeof(struct cache_slot));
+	assert(cache->slots != NULL);
+	cache->capacity = capacity;
+
+	/* Every shard has to hold at least one entry, so a capacity below the
+	   number of shards only uses that many. The remainder of the division
+	   goes to the first shards. */
+	cache->shard_count = capacity < HASH_TABLE_CACHE_SHARDS ? capacity
+	                                                        : HASH_TABLE_CACHE_SHARDS;
+	size_t first = 0;
+	for (size_t i = 0; i < cache->shard_count; ++i) {
+		struct cache_shard *shard = &cache->shards[i];
+		pthread_mutex_init(&shard->mutex, NULL);
+		shard->first = first;
+		shard->capacity = capacity / cache->shard_count
+		                  + (i < capacity % cache->shard_count);
+		first += shard->capacity;
+	}
+
+	if (callbacks != NULL) {
+		cache->callbacks = *callbacks;
+	}
+	return cache;
+}
+
+/* Every key always goes to the same shard, so the shard mutex is enough to
+   keep two insertions of one key from both adding it. */
+static struct cache_shard *get_shard(struct hash_table_cache *cache,
+                                     const char *key)
+{
+	assert(key != NULL);
+	return &cache->shards[bernstein_hash(key) % cache->shard_count];
+}
+
+struct slot_access {
+	struct hash_table_cache *cache;
+	uint32_t value;
+};
+
+/* Runs with the key's bucket locked, `index` is the value the table holds. */
+static void read_slot(const char *key, uint32_t index, void *arg)
+{
+	(void) key;
+	struct slot_access *access = arg;
+	struct cache_slot *slot = &access->cache->slots[index];
+	access->value = slot->value;
+	/* Only store when it changes, hot entries stay in the shared state. */
+	if (!atomic_load_explicit(&slot->referenced, memory_order_relaxed)) {
+		atomic_store_explicit(&slot->referenced, true, memory_order_relaxed);
+	}
+}
+
+static void write_slot(const char *key, uint32_t index, void *arg)
+{
+	(void) key;
+	struct slot_access *access = arg;
+	struct cache_slot *slot = &access->cache->slots[index];
+	slot->value = access->value;
+	atomic_store_explicit(&slot->referenced, true, memory_order_relaxed);
+}
+
+bool hash_table_cache_get(struct hash_table_cache *cache,
+                          const char *key,
+                          uint32_t *value)
+{
+	struct cache_shard *shard = get_shard(cache, key);
+	struct slot_access access = { cache, 0 };
+	bool hit = hash_table_v2_visit(cache->table, key, read_slot, &access);
+
+	if (hit) {
+		atomic_fetch_add_explicit(&shard->hits, 1, memory_order_relaxed);
+		if (value != NULL) {
+			*value = access.value;
+		}
+	}
+	else {
+		atomic_fetch_add_explicit(&shard->misses, 1, memory_order_relaxed);
+	}
+
+	if (cache->callbacks.get != NULL) {
+		cache->callbacks.get(key, access.value, hit, cache->callbacks.arg);
+	}
+	return hit;
+}
+
+/* Advances the clock hand until it finds a slot that hasn't been referenced
+   since the last sweep, clearing reference bits along the way. The victim is
+   removed from the table and the index of its slot returned, so it can be
+   reused. Must be called with the shard mutex held on a full shard. */
+static size_t evict(struct hash_table_cache *cache,
+                    struct cache_shard *shard)
+{
+	assert(shard->count == shard->capacity);
+	while (true) {
+		size_t index = shard->first + shard->hand;
+		struct cache_slot *candidate = &cache->slots[index];
+		if (atomic_exchange_explicit(&candidate->referenced, false,
+		                             memory_order_relaxed)) {
+			shard->hand = (shard->hand + 1) % shard->capacity;
+			continue;
+		}
+
+		bool removed = hash_table_v2_remove(cache->table, candidate->key);
+		assert(removed);
+		(void) removed;
+		shard->count -= 1;
+		shard->evictions += 1;
+		return index;
+	}
+}
+
+void hash_table_cache_put(struct hash_table_cache *cache,
+                          const char *key,
+                          uint32_t value)
+{
+	struct cache_shard *shard = get_shard(cache, key);
+
+	pthread_mutex_lock(&shard->mutex);
+	/* Update the value if it already exists */
+	struct slot_access access = { cache, value };
+	if (hash_table_v2_visit(cache->table, key, write_slot, &access)) {
+		pthread_mutex_unlock(&shard->mutex);
+		if (cache->callbacks.put != NULL) {
+			cache->callbacks.put(key, value, cache->callbacks.arg);
+		}
+		return;
+	}
+
+	/* Only insertions into this shard can add this key, and we hold the
+	   shard mutex, so it can't show up while the bucket is unlocked. */
+	const char *evicted_key = NULL;
+	uint32_t evicted_value = 0;
+	size_t index;
+	if (shard->count == shard->capacity) {
+		index = evict(cache, shard);
+		evicted_key = cache->slots[index].key;
+		evicted_value = cache->slots[index].value;
+	}
+	else {
+		/* Until the shard first fills up, the ring is filled in order. */
+		shard->hand = shard->count;
+		index = shard->first + shard->hand;
+	}
+
+	/* Nobody can reach the slot until the table points to it. */
+	struct cache_slot *slot = &cache->slots[index];
+	slot->key = key;
+	slot->value = value;
+	atomic_store_explicit(&slot->referenced, false, memory_order_relaxed);
+	hash_table_v2_add_entry(cache->table, key, index);
+	shard->hand = (shard->hand + 1) % shard->capacity;
+	shard->count += 1;
+	shard->insertions += 1;
+	pthread_mutex_unlock(&shard->mutex);
+
+	if (evicted_key != NULL && cache->callbacks.evict != NULL) {
+		cache->callbacks.evict(evicted_key, evicted_value, cache->callbacks.arg);
+	}
+	if (cache->callbacks.put != NULL) {
+		cache->callbacks.put(key, value, cache->callbacks.arg);
+	}
+}
+
+void hash_table_cache_get_counters(struct hash_table_cache *cache,
+                                   struct hash_table_cache_counters *counters)
+{
+	memset(counters, 0, sizeof(struct hash_table_cache_counters));
+	for (size_t i = 0; i < cache->shard_count; ++i) {
+		struct cache_shard *shard = &cache->shards[i];
+		counters->hits += atomic_load(&shard->hits);
+		counters->misses += atomic_load(&shard->misses);
+		pthread_mutex_lock(&shard->mutex);
+		counters->insertions += shard->insertions;
+		counters->evictions += shard->evictions;
+		counters->entries += shard->count;
+		pthread_mutex_unlock(&shard->mutex);
+	}
+}
+
+/* The table's, with the cache itself and the clock rings counted as part of
+   the buckets. */
+void hash_table_cache_stats(struct hash_table_cache *cache,
+                            struct hash_table_stats *stats)
+{
+	hash_table_v2_stats(cache->table, stats);
+	stats->bucket_bytes += sizeof(struct hash_table_cache)
+	                       + cache->capacity * sizeof(struct cache_slot);
+	stats->total_bytes = stats->bucket_bytes + stats->node_bytes + stats->key_bytes;
+}
+
+void hash_table_cache_destroy(struct hash_table_cache *cache)
+{
+	hash_table_v2_destroy(cache->table);
+	free(cache->slots);
+	for (size_t i = 0; i < cache->shard_count; ++i) {
+		pthread_mutex_destroy(&cache->shards[i].mutex);
+	}
+	free(cache);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "hash-table-common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* A capacity-bounded cache over a `hash_table_v2` with a bucket per entry it
+   can hold. Keys are split into shards, and every shard runs its own CLOCK
+   eviction over its share of the capacity, so there is never a table-wide
+   list or lock. A cache with a capacity below this uses one shard per
+   entry. */
+#define HASH_TABLE_CACHE_SHARDS 64
+
+/* Optional hooks, any of them may be `NULL`. They are called after the cache
+   has released its locks, so they may call back into the cache. */
+struct hash_table_cache_callbacks {
+	void (*get)(const char *key, uint32_t value, bool hit, void *arg);
+	void (*put)(const char *key, uint32_t value, void *arg);
+	void (*evict)(const char *key, uint32_t value, void *arg);
+	void *arg;
+};
+
+/* Totals over every shard, read with `hash_table_cache_get_counters`. */
+struct hash_table_cache_counters {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t insertions;
+	uint64_t evictions;
+	size_t entries;
+};
+
+struct hash_table_cache;
+
+/* Create a cache holding at most `capacity` entries, which must be at least 1
+   and fit a `uint32_t`, `callbacks` is copied and may be `NULL`. */
+struct hash_table_cache *hash_table_cache_create(
+	size_t capacity,
+	const struct hash_table_cache_callbacks *callbacks);
+/* Looks up `key`, on a hit the value is stored in `value` (if it's not `NULL`)
+   and the entry is marked as recently used. */
+bool hash_table_cache_get(struct hash_table_cache *cache,
+                          const char *key,
+                          uint32_t *value);
+/* Inserts or updates `key`, evicting an entry from the key's shard if the
+   shard is full. Like the other tables, the key is not copied. */
+void hash_table_cache_put(struct hash_table_cache *cache,
+                          const char *key,
+                          uint32_t value);
+void hash_table_cache_get_counters(struct hash_table_cache *cache,
+                                   struct hash_table_cache_counters *counters);
+void hash_table_cache_stats(struct hash_table_cache *cache,
+                            struct hash_table_stats *stats);
+void hash_table_cache_destroy(struct hash_table_cache *cache);
@@ -1,7 +1,11 @@
 #include "hash-table-common.h"
 
+#include <assert.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
 
 uint32_t bernstein_hash(const char *string)
 {
@@ -17,3 +21,244 @@ uint32_t bernstein_hash(const char *string)
 	}
 	return hash;
 }
+
+static size_t round_to_huge_page(size_t size)
+{
+	return (size + HASH_TABLE_HUGE_PAGE_SIZE - 1)
+	       & ~((size_t) HASH_TABLE_HUGE_PAGE_SIZE - 1);
+}
+
+/* `MAP_HUGETLB` only works if the administrator reserved huge pages, so
+   otherwise we map twice the size, trim it down to a 2 MB aligned range and
+   ask for transparent huge pages. Anonymous mappings are zero filled. */
+static void *map_huge(size_t size)
+{
+	size = round_to_huge_page(size);
+#ifdef MAP_HUGETLB
+	void *pointer = mmap(NULL, size, PROT_READ | PROT_WRITE,
+	                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (pointer != MAP_FAILED) {
+		return pointer;
+	}
+#endif
+
+	size_t padded = size + HASH_TABLE_HUGE_PAGE_SIZE;
+	char *region = mmap(NULL, padded, PROT_READ | PROT_WRITE,
+	                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	assert(region != MAP_FAILED);
+	char *aligned = (char *) round_to_huge_page((uintptr_t) region);
+	size_t before = aligned - region;
+	if (before > 0) {
+		munmap(region, before);
+	}
+	munmap(aligned + size, padded - before - size);
+#ifdef MADV_HUGEPAGE
+	madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+	return aligned;
+}
+
+void *hash_table_alloc(size_t size, enum hash_table_alloc alloc)
+{
+	if (alloc == HASH_TABLE_ALLOC_HUGE) {
+		return map_huge(size);
+	}
+	void *pointer = calloc(1, size);
+	assert(pointer != NULL);
+	return pointer;
+}
+
+void hash_table_free(void *pointer, size_t size, enum hash_table_alloc alloc)
+{
+	if (alloc == HASH_TABLE_ALLOC_HUGE) {
+		munmap(pointer, round_to_huge_page(size));
+		return;
+	}
+	free(pointer);
+}
+
+void hash_table_pool_init(struct hash_table_pool *pool,
+                          size_t node_size,
+                          enum hash_table_alloc alloc)
+{
+	memset(pool, 0, sizeof(struct hash_table_pool));
+	pool->alloc = alloc;
+	pool->node_size = node_size;
+	pool->nodes_per_chunk = HASH_TABLE_HUGE_PAGE_SIZE / node_size;
+	atomic_init(&pool->next, 0);
+	pthread_mutex_init(&pool->mutex, NULL);
+}
+
+/* Each node index belongs to exactly one chunk. The first thread that needs
+   a chunk maps it under the mutex, everyone else only does the atomic
+   increment and a load. */
+void *hash_table_pool_alloc(struct hash_table_pool *pool)
+{
+	if (pool->alloc == HASH_TABLE_ALLOC_DEFAULT) {
+		void *node = calloc(1, pool->node_size);
+		assert(node != NULL);
+		return node;
+	}
+
+	size_t index = atomic_fetch_add_explicit(&pool->next, 1, memory_order_relaxed);
+	size_t chunk = index / pool->nodes_per_chunk;
+	assert(chunk < HASH_TABLE_POOL_CHUNKS);
+	char *base = atomic_load_explicit(&pool->chunks[chunk], memory_order_acquire);
+	if (base == NULL) {
+		pthread_mutex_lock(&pool->mutex);
+		base = atomic_load_explicit(&pool->chunks[chunk], memory_order_relaxed);
+		if (base == NULL) {
+			base = map_huge(HASH_TABLE_HUGE_PAGE_SIZE);
+			atomic_store_explicit(&pool->chunks[chunk], base, memory_order_release);
+		}
+		pthread_mutex_unlock(&pool->mutex);
+	}
+	return base + (index % pool->nodes_per_chunk) * pool->node_size;
+}
+
+void hash_table_pool_free(struct hash_table_pool *pool, void *node)
+{
+	if (pool->alloc == HASH_TABLE_ALLOC_DEFAULT) {
+		free(node);
+	}
+}
+
+size_t hash_table_pool_bytes(struct hash_table_pool *pool, size_t nodes)
+{
+	if (pool->alloc == HASH_TABLE_ALLOC_DEFAULT) {
+		return nodes * pool->node_size;
+	}
+	size_t bytes = 0;
+	for (size_t i = 0; i < HASH_TABLE_POOL_CHUNKS; ++i) {
+		if (atomic_load(&pool->chunks[i]) != NULL) {
+			bytes += HASH_TABLE_HUGE_PAGE_SIZE;
+		}
+	}
+	return bytes;
+}
+
+void hash_table_pool_destroy(struct hash_table_pool *pool)
+{
+	for (size_t i = 0; i < HASH_TABLE_POOL_CHUNKS; ++i) {
+		char *base = atomic_load(&pool->chunks[i]);
+		if (base != NULL) {
+			munmap(base, HASH_TABLE_HUGE_PAGE_SIZE);
+		}
+	}
+	pthread_mutex_destroy(&pool->mutex);
+}
+
+/* The percentile comes from a histogram of the lengths, which is small since
+   no chain is longer than the number of entries. */
+void hash_table_stats_from_chains(struct hash_table_stats *stats,
+                                  const size_t *chain_lengths,
+                                  size_t buckets)
+{
+	size_t entries = 0;
+	size_t non_empty = 0;
+	size_t max_chain = 0;
+	for (size_t i = 0; i < buckets; ++i) {
+		entries += chain_lengths[i];
+		if (chain_lengths[i] > 0) {
+			++non_empty;
+		}
+		if (chain_lengths[i] > max_chain) {
+			max_chain = chain_lengths[i];
+		}
+	}
+
+	size_t *histogram = calloc(max_chain + 1, sizeof(size_t));
+	assert(histogram != NULL);
+	for (size_t i = 0; i < buckets; ++i) {
+		++histogram[chain_lengths[i]];
+	}
+	size_t p99_rank = (buckets * 99 + 99) / 100;
+	size_t seen = 0;
+	size_t p99_chain = 0;
+	for (size_t length = 0; length <= max_chain; ++length) {
+		seen += histogram[length];
+		if (seen >= p99_rank) {
+			p99_chain = length;
+			break;
+		}
+	}
+	free(histogram);
+
+	stats->entries = entries;
+	stats->buckets = buckets;
+	stats->total_bytes = stats->bucket_bytes + stats->node_bytes + stats->key_bytes;
+	stats->load_factor = buckets == 0 ? 0 : (double) entries / buckets;
+	stats->max_chain = max_chain;
+	stats->mean_chain = non_empty == 0 ? 0 : (double) entries / non_empty;
+	stats->p99_chain = p99_chain;
+}
+
+void hash_table_bucket_copy_add(struct hash_table_bucket_copy *copy,
+                                const char *key,
+                                uint32_t value)
+{
+	if (copy->count == copy->capacity) {
+		copy->capacity = copy->capacity == 0 ? 16 : copy->capacity * 2;
+		copy->entries = reallocarray(copy->entries, copy->capacity,
+		                             sizeof(struct hash_table_copied_entry));
+		assert(copy->entries != NULL);
+	}
+	copy->entries[copy->count].key = key;
+	copy->entries[copy->count].value = value;
+	++copy->count;
+}
+
+void hash_table_bucket_copy_destroy(struct hash_table_bucket_copy *copy)
+{
+	free(copy->entries);
+	copy->entries = NULL;
+	copy->count = 0;
+	copy->capacity = 0;
+}
+
+struct foreach_range {
+	size_t begin;
+	size_t end;
+	void (*walk)(size_t begin, size_t end, void *arg);
+	void *arg;
+};
+
+static void *walk_range(void *arg)
+{
+	struct foreach_range *range = arg;
+	range->walk(range->begin, range->end, range->arg);
+	return NULL;
+}
+
+void hash_table_foreach_ranges(size_t buckets,
+                               size_t threads,
+                               void (*walk)(size_t begin, size_t end, void *arg),
+                               void *arg)
+{
+	if (threads == 0) {
+		threads = 1;
+	}
+	if (threads > buckets) {
+		threads = buckets;
+	}
+	struct foreach_range *ranges = calloc(threads, sizeof(struct foreach_range));
+	pthread_t *pthreads = calloc(threads, sizeof(pthread_t));
+	assert(ranges != NULL && pthreads != NULL);
+	for (size_t i = 0; i < threads; ++i) {
+		ranges[i].begin = buckets * i / threads;
+		ranges[i].end = buckets * (i + 1) / threads;
+		ranges[i].walk = walk;
+		ranges[i].arg = arg;
+	}
+	for (size_t i = 1; i < threads; ++i) {
+		int err = pthread_create(&pthreads[i], NULL, walk_range, &ranges[i]);
+		assert(err == 0);
+		(void) err;
+	}
+	walk_range(&ranges[0]);
+	for (size_t i = 1; i < threads; ++i) {
+		pthread_join(pthreads[i], NULL);
+	}
+	free(pthreads);
+	free(ranges);
+}
@@ -1,6 +1,11 @@
 #pragma once
 
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 /* All of our hash tables will have the same capcity so we can create a fair
    comparsion. */
@@ -9,3 +14,165 @@
 /* We'll also use the same hash function for all our hash tables, called the
    bernstein hash. You may also find it referred to as the djb2 hash. */
 uint32_t bernstein_hash(const char *string);
+
+/* Where a table gets its memory from. `HASH_TABLE_ALLOC_HUGE` backs the
+   bucket array and the nodes with 2 MB pages to cut down on TLB misses, at
+   the cost of rounding every allocation up to a whole huge page. */
+enum hash_table_alloc {
+	HASH_TABLE_ALLOC_DEFAULT,
+	HASH_TABLE_ALLOC_HUGE,
+};
+
+/* Options for the `*_create_with` functions, a zeroed struct gives the same
+   table as `*_create`. */
+struct hash_table_options {
+	enum hash_table_alloc alloc;
+	/* Only used by v2 for now. The number of buckets to start with, 0 means
+	   `HASH_TABLE_CAPACITY`. */
+	size_t initial_capacity;
+	/* Only used by v2 for now. If not 0, a background thread doubles the
+	   buckets whenever entries per bucket goes over this. */
+	double resize_load_factor;
+	/* 0 for NUL terminated string keys, which the table only points to. 8 or
+	   16 for keys of exactly that many bytes, see `hash_table_key`. Iterators
+	   and `*_foreach` hand those out as the `key_width` bytes copied into the
+	   node, which aren't NUL terminated. */
+	size_t key_width;
+	/* Only used by v2 for now. Lets `*_remove` take entries out again, which
+	   makes lookups lock their bucket like resizing does. Only for string
+	   keys. */
+	bool removable;
+};
+
+/* A fixed-width key, copied into the node and zero padded to two words.
+   Comparing is one or two 64-bit compares instead of a `strcmp`, and hashing
+   is two multiplies instead of a loop over the bytes. */
+struct hash_table_key {
+	uint64_t words[2];
+};
+
+static inline struct hash_table_key hash_table_key_load(const char *key, size_t key_width)
+{
+	struct hash_table_key fixed = { { 0, 0 } };
+	memcpy(fixed.words, key, key_width);
+	return fixed;
+}
+
+static inline bool hash_table_key_equal(const struct hash_table_key *a,
+                                        const struct hash_table_key *b)
+{
+	return ((a->words[0] ^ b->words[0]) | (a->words[1] ^ b->words[1])) == 0;
+}
+
+/* Folds the second word in with a multiply of its own, so its bits spread
+   before they meet the first word's, then multiplies by 2^64 over the golden
+   ratio and keeps the high half, which is the best mixed. */
+static inline uint32_t hash_table_key_hash(const struct hash_table_key *key)
+{
+	uint64_t mixed = key->words[0] ^ (key->words[1] * UINT64_C(0xc2b2ae3d27d4eb4f));
+	return (mixed * UINT64_C(0x9e3779b97f4a7c15)) >> 32;
+}
+
+/* The hash every chained table uses for `key`, given its `key_width`. */
+static inline uint32_t hash_table_hash(const char *key, size_t key_width)
+{
+	if (key_width == 0) {
+		return bernstein_hash(key);
+	}
+	struct hash_table_key fixed = hash_table_key_load(key, key_width);
+	return hash_table_key_hash(&fixed);
+}
+
+#define HASH_TABLE_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* Allocate zeroed memory for `size` bytes. With `HASH_TABLE_ALLOC_HUGE` this
+   tries `MAP_HUGETLB` first and falls back to a 2 MB aligned mapping with
+   `madvise(MADV_HUGEPAGE)`. Free with the same `size` and `alloc`. */
+void *hash_table_alloc(size_t size, enum hash_table_alloc alloc);
+void hash_table_free(void *pointer, size_t size, enum hash_table_alloc alloc);
+
+#define HASH_TABLE_POOL_CHUNKS 4096
+
+/* Fixed-size node allocator. With `HASH_TABLE_ALLOC_DEFAULT` every node is
+   its own `calloc`. With `HASH_TABLE_ALLOC_HUGE` nodes are carved out of huge
+   page chunks with an atomic bump, so threads only synchronize when a chunk
+   runs out, and nodes are only returned by `hash_table_pool_destroy`. */
+struct hash_table_pool {
+	enum hash_table_alloc alloc;
+	size_t node_size;
+	size_t nodes_per_chunk;
+	atomic_size_t next;
+	_Atomic(char *) chunks[HASH_TABLE_POOL_CHUNKS];
+	pthread_mutex_t mutex;
+};
+
+void hash_table_pool_init(struct hash_table_pool *pool,
+                          size_t node_size,
+                          enum hash_table_alloc alloc);
+void *hash_table_pool_alloc(struct hash_table_pool *pool);
+void hash_table_pool_free(struct hash_table_pool *pool, void *node);
+void hash_table_pool_destroy(struct hash_table_pool *pool);
+
+/* Returns how many bytes `pool` holds for its `nodes` nodes. */
+size_t hash_table_pool_bytes(struct hash_table_pool *pool, size_t nodes);
+
+/* Size and shape of a table, filled in by the `*_stats` functions. The bucket
+   bytes are the table struct itself, which includes the bucket array. Tables
+   that don't copy their keys still count the strings they point to in the
+   key bytes, since those have to stay alive as long as the table does.
+   Fixed-width keys are part of the nodes, so they're in the node bytes. */
+struct hash_table_stats {
+	size_t entries;
+	size_t buckets;
+	size_t bucket_bytes;
+	size_t node_bytes;
+	size_t key_bytes;
+	size_t total_bytes;
+	/* Entries per bucket. */
+	double load_factor;
+	/* Chain lengths, the mean is over non-empty buckets (the expected cost
+	   of a hit), the 99th percentile over all of them. */
+	size_t max_chain;
+	double mean_chain;
+	size_t p99_chain;
+};
+
+/* Fills in everything derived from the chain lengths of the `buckets`
+   buckets, as well as `buckets`, `entries` and `total_bytes`. The caller
+   sets the byte counts before calling this. */
+void hash_table_stats_from_chains(struct hash_table_stats *stats,
+                                  const size_t *chain_lengths,
+                                  size_t buckets);
+
+/* Called once for every entry by the `*_foreach` functions, from whichever
+   of their threads walks the entry's bucket. With a `key_width`, `key` is
+   exactly that many bytes and not NUL terminated. */
+typedef void (*hash_table_visit)(const char *key, uint32_t value, void *arg);
+
+struct hash_table_copied_entry {
+	const char *key;
+	uint32_t value;
+};
+
+/* The entries of a bucket, copied out while holding its lock so the lock
+   isn't held while the caller looks at them. Keys are still pointers, which
+   stay valid as long as the table does, since only tables with string keys,
+   which the caller keeps alive, can remove entries. */
+struct hash_table_bucket_copy {
+	struct hash_table_copied_entry *entries;
+	size_t count;
+	size_t capacity;
+};
+
+void hash_table_bucket_copy_add(struct hash_table_bucket_copy *copy,
+                                const char *key,
+                                uint32_t value);
+void hash_table_bucket_copy_destroy(struct hash_table_bucket_copy *copy);
+
+/* Splits the buckets `[0, buckets)` into `threads` contiguous ranges and calls
+   `walk` for each one on its own thread, the calling thread takes the first
+   range. Returns once every range is done. */
+void hash_table_foreach_ranges(size_t buckets,
+                               size_t threads,
+                               void (*walk)(size_t begin, size_t end, void *arg),
+                               void *arg);
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "hash-table-common.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Stamps out a hash table specialized for one key type, one value type and
+   one capacity. It has the same chains and per-bucket locking as
+   `hash_table_v2`, but because `hash`, `equal` and `capacity` are known where
+   the functions are generated, the compiler can inline the hash and the key
+   compare and turn the modulo into a mask for power of two capacities.
+
+   `hash` is called as `uint32_t hash(key_type key)` and `equal` as
+   `bool equal(key_type a, key_type b)`, both can be functions or macros.
+   Keys and values are stored by value, so a `const char *` key is not copied,
+   just like the other tables, and counts the string it points to in the key
+   bytes like they do. Other keys only count towards the node bytes.
+   This defines `struct name` and the functions `name_create`,
+   `name_add_entry`, `name_contains`, `name_get_value`, `name_stats` and
+   `name_destroy`, all `static inline`, so it can be used in any number of
+   translation units. */
+#define HASH_TABLE_GENERIC_DEFINE(name, key_type, value_type, capacity, hash, equal) \
+	struct name##_node {                                                         \
+		key_type key;                                                        \
+		value_type value;                                                    \
+		struct name##_node *next;                                            \
+	};                                                                           \
+                                                                                     \
+	struct name##_bucket {                                                       \
+		struct name##_node *head;                                            \
+		pthread_mutex_t mutex;                                               \
+	};                                                                           \
+                                                                                     \
+	struct name {                                                                \
+		struct name##_bucket buckets[capacity];                              \
+	};                                                                           \
+                                                                                     \
+	static inline struct name *name##_create(void)                               \
+	{                                                                            \
+		struct name *hash_table = calloc(1, sizeof(struct name));            \
+		assert(hash_table != NULL);                                          \
+		for (size_t i = 0; i < (capacity); ++i) {                            \
+			pthread_mutex_init(&hash_table->buckets[i].mutex, NULL);     \
+		}                                                                    \
+		return hash_table;                                                   \
+	}                                                                            \
+                                                                                     \
+	static inline struct name##_bucket *name##_get_bucket(struct name *hash_table, \
+	                                                      key_type key)          \
+	{                                                                            \
+		return &hash_table->buckets[(uint32_t) hash(key) % (capacity)];      \
+	}                                                                            \
+                                                                                     \
+	static inline struct name##_node *name##_get_node(struct name##_bucket *bucket, \
+	                                                  key_type key)              \
+	{                                                                            \
+		for (struct name##_node *node = bucket->head; node != NULL;          \
+		     node = node->next) {                                            \
+			if (equal(node->key, key)) {                                 \
+				return node;                                         \
+			}                                                            \
+		}                                                                    \
+		return NULL;                                                         \
+	}                                                                            \
+                                                                                     \
+	static inline void name##_add_entry(struct name *hash_table,                 \
+	                                    key_type key,                            \
+	                                    value_type value)                        \
+	{                                                                            \
+		struct name##_bucket *bucket = name##_get_bucket(hash_table, key);   \
+		pthread_mutex_lock(&bucket->mutex);                                  \
+		struct name##_node *node = name##_get_node(bucket, key);             \
+		if (node == NULL) {                                                  \
+			node = calloc(1, sizeof(struct name##_node));                \
+			assert(node != NULL);                                        \
+			node->key = key;                                             \
+			node->next = bucket->head;                                   \
+			bucket->head = node;                                         \
+		}                                                                    \
+		node->value = value;                                                 \
+		pthread_mutex_unlock(&bucket->mutex);                                \
+	}                                                                            \
+                                                                                     \
+	static inline bool name##_contains(struct name *hash_table, key_type key)    \
+	{                                                                            \
+		struct name##_bucket *bucket = name##_get_bucket(hash_table, key);   \
+		return name##_get_node(bucket, key) != NULL;                         \
+	}                                                                            \
+                                                                                     \
+	static inline value_type name##_get_value(struct name *hash_table,           \
+	                                          key_type key)                      \
+	{                                                                            \
+		struct name##_bucket *bucket = name##_get_bucket(hash_table, key);   \
+		struct name##_node *node = name##_get_node(bucket, key);             \
+		assert(node != NULL);                                                \
+		return node->value;                                                  \
+	}                                                                            \
+                                                                                     \
+	static inline void name##_stats(struct name *hash_table,                     \
+	                                struct hash_table_stats *stats)              \
+	{                                                                            \
+		size_t *chain_lengths = calloc((capacity), sizeof(size_t));          \
+		assert(chain_lengths != NULL);                                       \
+		size_t entries = 0;                                                  \
+		size_t key_bytes = 0;                                                \
+		for (size_t i = 0; i < (capacity); ++i) {                            \
+			struct name##_bucket *bucket = &hash_table->buckets[i];      \
+			pthread_mutex_lock(&bucket->mutex);                          \
+			for (struct name##_node *node = bucket->head; node != NULL;  \
+			     node = node->next) {                                    \
+				++chain_lengths[i];                                  \
+				key_bytes += HASH_TABLE_GENERIC_KEY_BYTES(node->key); \
+			}                                                            \
+			pthread_mutex_unlock(&bucket->mutex);                        \
+			entries += chain_lengths[i];                                 \
+		}                                                                    \
+		stats->bucket_bytes = sizeof(struct name);                           \
+		stats->node_bytes = entries * sizeof(struct name##_node);            \
+		stats->key_bytes = key_bytes;                                        \
+		hash_table_stats_from_chains(stats, chain_lengths, (capacity));      \
+		free(chain_lengths);                                                 \
+	}                                                                            \
+                                                                                     \
+	static inline void name##_destroy(struct name *hash_table)                   \
+	{                                                                            \
+		for (size_t i = 0; i < (capacity); ++i) {                            \
+			struct name##_bucket *bucket = &hash_table->buckets[i];      \
+			while (bucket->head != NULL) {                               \
+				struct name##_node *node = bucket->head;             \
+				bucket->head = node->next;                           \
+				free(node);                                          \
+			}                                                            \
+			pthread_mutex_destroy(&bucket->mutex);                       \
+		}                                                                    \
+		free(hash_table);                                                    \
+	}                                                                            \
+                                                                                     \
+	struct name##_unused /* so the macro can be followed by a semicolon */
+
+/* The bytes of the string a key points to, or 0 for keys that aren't
+   strings. Picked by the key's type, so it works for any `key_type`. */
+static inline size_t hash_table_generic_string_bytes(const void *key)
+{
+	return strlen(*(const char *const *) key) + 1;
+}
+
+static inline size_t hash_table_generic_no_bytes(const void *key)
+{
+	(void) key;
+	return 0;
+}
+
+#define HASH_TABLE_GENERIC_KEY_BYTES(key)                                            \
+	_Generic((key),                                                              \
+	         const char *: hash_table_generic_string_bytes,                      \
+	         char *: hash_table_generic_string_bytes,                            \
+	         default: hash_table_generic_no_bytes)(&(key))
+
+/* Ready-made hash and compare functions for the two key shapes we use. The
+   string hash is `bernstein_hash`, repeated here so it can be inlined. */
+static inline uint32_t hash_table_generic_hash_string(const char *string)
+{
+	uint32_t hash = 0;
+	for (size_t i = 0; string[i] != 0; ++i) {
+		hash = (33 * hash) + string[i];
+	}
+	return hash;
+}
+
+static inline bool hash_table_generic_equal_string(const char *a, const char *b)
+{
+	return strcmp(a, b) == 0;
+}
+
+/* One multiply by a 64-bit odd constant (from splitmix64), keeping the high
+   bits, which are the ones every bit of the key has been mixed into. */
+static inline uint32_t hash_table_generic_hash_uint64(uint64_t key)
+{
+	return (uint32_t) ((key * 0x9e3779b97f4a7c15) >> 32);
+}
+
+static inline bool hash_table_generic_equal_uint64(uint64_t a, uint64_t b)
+{
+	return a == b;
+}
@@ -0,0 +1,313 @@
+#include "hash-table-hopscotch.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A slot holds at most one entry, `hop_info` belongs to the slot as a home:
+   bit i is set if slot (this + i) holds an entry whose home is this slot.
+   A `NULL` key means the slot is free. */
+struct hopscotch_slot {
+	_Atomic uint32_t hop_info;
+	_Atomic uint32_t hash;
+	_Atomic(const char *) key;
+	_Atomic uint32_t value;
+};
+
+/* The timestamp changes whenever an entry whose home slot is in this segment
+   moves. */
+struct hopscotch_segment {
+	pthread_mutex_t mutex;
+	atomic_uint timestamp;
+} __attribute__((aligned(64)));
+
+struct hash_table_hopscotch {
+	size_t capacity;
+	size_t segment_count;
+	struct hopscotch_slot *slots;
+	struct hopscotch_segment *segments;
+};
+
+struct hash_table_hopscotch *hash_table_hopscotch_create(size_t capacity)
+{
+	if (capacity < HASH_TABLE_HOPSCOTCH_HOP_RANGE) {
+		capacity = HASH_TABLE_HOPSCOTCH_HOP_RANGE;
+	}
+	struct hash_table_hopscotch *hash_table = calloc(1, sizeof(struct hash_table_hopscotch));
+	assert(hash_table != NULL);
+	hash_table->capacity = capacity;
+	hash_table->slots = calloc(capacity, sizeof(struct hopscotch_slot));
+	assert(hash_table->slots != NULL);
+
+	/* The last segment takes the remainder, so every segment is at least
+	   `HASH_TABLE_HOPSCOTCH_SEGMENT_SIZE` slots (or the whole table). */
+	hash_table->segment_count = capacity / HASH_TABLE_HOPSCOTCH_SEGMENT_SIZE;
+	if (hash_table->segment_count == 0) {
+		hash_table->segment_count = 1;
+	}
+	hash_table->segments = aligned_alloc(_Alignof(struct hopscotch_segment),
+	                                     hash_table->segment_count
+	                                     * sizeof(struct hopscotch_segment));
+	assert(hash_table->segments != NULL);
+	for (size_t i = 0; i < hash_table->segment_count; ++i) {
+		pthread_mutex_init(&hash_table->segments[i].mutex, NULL);
+		atomic_init(&hash_table->segments[i].timestamp, 0);
+	}
+	return hash_table;
+}
+
+static size_t wrap(struct hash_table_hopscotch *hash_table, size_t index)
+{
+	return index >= hash_table->capacity ? index - hash_table->capacity : index;
+}
+
+static size_t get_segment(struct hash_table_hopscotch *hash_table, size_t index)
+{
+	size_t segment = index / HASH_TABLE_HOPSCOTCH_SEGMENT_SIZE;
+	return segment < hash_table->segment_count ? segment : hash_table->segment_count - 1;
+}
+
+/* Searches the home slot's neighborhood. On a match the value is read, then
+   the key is checked again in case the slot was reused in between. */
+static bool find(struct hash_table_hopscotch *hash_table,
+                 size_t home,
+                 uint32_t hash,
+                 const char *key,
+                 struct hopscotch_slot **found,
+                 uint32_t *value)
+{
+	uint32_t hop_info = atomic_load_explicit(&hash_table->slots[home].hop_info,
+	                                         memory_order_acquire);
+	while (hop_info != 0) {
+		size_t i = __builtin_ctz(hop_info);
+		hop_info &= hop_info - 1;
+		struct hopscotch_slot *slot = &hash_table->slots[wrap(hash_table, home + i)];
+		const char *slot_key = atomic_load_explicit(&slot->key, memory_order_acquire);
+		if (slot_key == NULL
+		    || atomic_load_explicit(&slot->hash, memory_order_relaxed) != hash
+		    || strcmp(slot_key, key) != 0) {
+			continue;
+		}
+		uint32_t slot_value = atomic_load_explicit(&slot->value, memory_order_acquire);
+		if (atomic_load_explicit(&slot->key, memory_order_relaxed) != slot_key) {
+			continue;
+		}
+		if (found != NULL) {
+			*found = slot;
+		}
+		if (value != NULL) {
+			*value = slot_value;
+		}
+		return true;
+	}
+	return false;
+}
+
+/* A miss only counts if no entry of this home moved while we were looking,
+   otherwise we might have looked at both of its slots at the wrong time. */
+static bool lookup(struct hash_table_hopscotch *hash_table,
+                   const char *key,
+                   uint32_t *value)
+{
+	assert(key != NULL);
+	uint32_t hash = bernstein_hash(key);
+	size_t home = hash % hash_table->capacity;
+	struct hopscotch_segment *segment = &hash_table->segments[get_segment(hash_table, home)];
+	while (true) {
+		unsigned timestamp = atomic_load_explicit(&segment->timestamp, memory_order_acquire);
+		if (find(hash_table, home, hash, key, NULL, value)) {
+			return true;
+		}
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&segment->timestamp, memory_order_relaxed) == timestamp) {
+			return false;
+		}
+	}
+}
+
+/* An insertion only touches slots from `HOP_RANGE - 1` before its home (the
+   homes of entries it may move) to `ADD_RANGE - 1` after it. That's less
+   than a segment, so it's at most two segments, locked in index order. */
+static size_t lock_segments(struct hash_table_hopscotch *hash_table,
+                            size_t home,
+                            size_t locked[2])
+{
+	size_t first = get_segment(hash_table,
+	                           wrap(hash_table, home + hash_table->capacity
+	                                            - (HASH_TABLE_HOPSCOTCH_HOP_RANGE - 1)
+	                                              % hash_table->capacity));
+	size_t last = get_segment(hash_table,
+	                          wrap(hash_table, home + (HASH_TABLE_HOPSCOTCH_ADD_RANGE - 1)
+	                                           % hash_table->capacity));
+	size_t count = 1;
+	locked[0] = first < last ? first : last;
+	if (first != last) {
+		locked[1] = first < last ? last : first;
+		count = 2;
+	}
+	for (size_t i = 0; i < count; ++i) {
+		pthread_mutex_lock(&hash_table->segments[locked[i]].mutex);
+	}
+	return count;
+}
+
+static void unlock_segments(struct hash_table_hopscotch *hash_table,
+                            size_t locked[2],
+                            size_t count)
+{
+	for (size_t i = count; i > 0; --i) {
+		pthread_mutex_unlock(&hash_table->segments[locked[i - 1]].mutex);
+	}
+}
+
+/* Moves the free slot `*free` closer to the home slot by moving an entry
+   between the two into it. The entry is visible in both slots while it
+   moves, and its home segment's timestamp tells readers to look again. */
+static bool move_closer(struct hash_table_hopscotch *hash_table,
+                        size_t *free,
+                        size_t *distance)
+{
+	struct hopscotch_slot *to = &hash_table->slots[*free];
+	for (size_t back = HASH_TABLE_HOPSCOTCH_HOP_RANGE - 1; back > 0; --back) {
+		size_t home = wrap(hash_table, *free + hash_table->capacity - back);
+		struct hopscotch_slot *home_slot = &hash_table->slots[home];
+		uint32_t hop_info = atomic_load_explicit(&home_slot->hop_info,
+		                                         memory_order_relaxed);
+		/* Only entries that sit before `*free` get it closer. */
+		uint32_t movable = hop_info & ((UINT32_C(1) << back) - 1);
+		if (movable == 0) {
+			continue;
+		}
+		size_t offset = __builtin_ctz(movable);
+		size_t from_index = wrap(hash_table, home + offset);
+		struct hopscotch_slot *from = &hash_table->slots[from_index];
+
+		atomic_store_explicit(&to->value,
+		                      atomic_load_explicit(&from->value, memory_order_relaxed),
+		                      memory_order_relaxed);
+		atomic_store_explicit(&to->hash,
+		                      atomic_load_explicit(&from->hash, memory_order_relaxed),
+		                      memory_order_relaxed);
+		atomic_store_explicit(&to->key,
+		                      atomic_load_explicit(&from->key, memory_order_relaxed),
+		                      memory_order_release);
+		atomic_fetch_or_explicit(&home_slot->hop_info, UINT32_C(1) << back,
+		                         memory_order_release);
+
+		struct hopscotch_segment *segment
+			= &hash_table->segments[get_segment(hash_table, home)];
+		atomic_fetch_add_explicit(&segment->timestamp, 1, memory_order_release);
+
+		atomic_fetch_and_explicit(&home_slot->hop_info, ~(UINT32_C(1) << offset),
+		                          memory_order_release);
+		atomic_store_explicit(&from->key, NULL, memory_order_release);
+
+		*distance -= back - offset;
+		*free = from_index;
+		return true;
+	}
+	return false;
+}
+
+bool hash_table_hopscotch_add_entry(struct hash_table_hopscotch *hash_table,
+                                    const char *key,
+                                    uint32_t value)
+{
+	assert(key != NULL);
+	uint32_t hash = bernstein_hash(key);
+	size_t home = hash % hash_table->capacity;
+	size_t locked[2];
+	size_t locked_count = lock_segments(hash_table, home, locked);
+
+	/* Update the value if it already exists */
+	struct hopscotch_slot *slot = NULL;
+	if (find(hash_table, home, hash, key, &slot, NULL)) {
+		atomic_store_explicit(&slot->value, value, memory_order_release);
+		unlock_segments(hash_table, locked, locked_count);
+		return true;
+	}
+
+	size_t free = 0;
+	size_t distance = 0;
+	bool found_free = false;
+	for (; distance < HASH_TABLE_HOPSCOTCH_ADD_RANGE && distance < hash_table->capacity;
+	     ++distance) {
+		free = wrap(hash_table, home + distance);
+		if (atomic_load_explicit(&hash_table->slots[free].key, memory_order_relaxed) == NULL) {
+			found_free = true;
+			break;
+		}
+	}
+	if (!found_free) {
+		unlock_segments(hash_table, locked, locked_count);
+		return false;
+	}
+
+	while (distance >= HASH_TABLE_HOPSCOTCH_HOP_RANGE) {
+		if (!move_closer(hash_table, &free, &distance)) {
+			unlock_segments(hash_table, locked, locked_count);
+			return false;
+		}
+	}
+
+	slot = &hash_table->slots[free];
+	atomic_store_explicit(&slot->value, value, memory_order_relaxed);
+	atomic_store_explicit(&slot->hash, hash, memory_order_relaxed);
+	atomic_store_explicit(&slot->key, key, memory_order_release);
+	atomic_fetch_or_explicit(&hash_table->slots[home].hop_info,
+	                         UINT32_C(1) << distance, memory_order_release);
+	unlock_segments(hash_table, locked, locked_count);
+	return true;
+}
+
+bool hash_table_hopscotch_contains(struct hash_table_hopscotch *hash_table,
+                                   const char *key)
+{
+	return lookup(hash_table, key, NULL);
+}
+
+uint32_t hash_table_hopscotch_get_value(struct hash_table_hopscotch *hash_table,
+                                        const char *key)
+{
+	uint32_t value = 0;
+	bool found = lookup(hash_table, key, &value);
+	assert(found);
+	(void) found;
+	return value;
+}
+
+void hash_table_hopscotch_stats(struct hash_table_hopscotch *hash_table,
+                                struct hash_table_stats *stats)
+{
+	size_t *chain_lengths = calloc(hash_table->capacity, sizeof(size_t));
+	assert(chain_lengths != NULL);
+	size_t key_bytes = 0;
+	for (size_t i = 0; i < hash_table->capacity; ++i) {
+		struct hopscotch_slot *slot = &hash_table->slots[i];
+		chain_lengths[i] = __builtin_popcount(atomic_load(&slot->hop_info));
+		const char *key = atomic_load(&slot->key);
+		if (key != NULL) {
+			key_bytes += strlen(key) + 1;
+		}
+	}
+
+	stats->bucket_bytes = sizeof(struct hash_table_hopscotch)
+	                      + hash_table->capacity * sizeof(struct hopscotch_slot)
+	                      + hash_table->segment_count * sizeof(struct hopscotch_segment);
+	stats->node_bytes = 0;
+	stats->key_bytes = key_bytes;
+	hash_table_stats_from_chains(stats, chain_lengths, hash_table->capacity);
+	free(chain_lengths);
+}
+
+void hash_table_hopscotch_destroy(struct hash_table_hopscotch *hash_table)
+{
+	for (size_t i = 0; i < hash_table->segment_count; ++i) {
+		pthread_mutex_destroy(&hash_table->segments[i].mutex);
+	}
+	free(hash_table->segments);
+	free(hash_table->slots);
+	free(hash_table);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "hash-table-common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* An open addressing table using hopscotch hashing. Every entry is stored
+   within `HASH_TABLE_HOPSCOTCH_HOP_RANGE` slots of its home slot, and each
+   home slot has a bitmap of which of those slots hold its entries, so a
+   lookup reads one bitmap and at most one or two cache lines of slots.
+
+   Writers lock the segments of slots they may touch. Readers don't lock, they
+   check the home segment's timestamp before and after the lookup and retry
+   if an entry was moved in the meantime. */
+#define HASH_TABLE_HOPSCOTCH_HOP_RANGE 32
+
+/* How far an insertion looks for a free slot before the table counts as
+   full, and the number of slots sharing one lock. */
+#define HASH_TABLE_HOPSCOTCH_ADD_RANGE 1024
+#define HASH_TABLE_HOPSCOTCH_SEGMENT_SIZE 2048
+
+struct hash_table_hopscotch;
+
+/* Unlike the chained tables this one has a fixed number of slots, so the load
+   factor is the number of entries divided by `capacity`. */
+struct hash_table_hopscotch *hash_table_hopscotch_create(size_t capacity);
+/* Returns `false` if there's no free slot that can be moved close enough to
+   the key's home slot. */
+bool hash_table_hopscotch_add_entry(struct hash_table_hopscotch *hash_table,
+                                    const char *key,
+                                    uint32_t value);
+bool hash_table_hopscotch_contains(struct hash_table_hopscotch *hash_table,
+                                   const char *key);
+uint32_t hash_table_hopscotch_get_value(struct hash_table_hopscotch *hash_table,
+                                        const char *key);
+/* The chain length of a slot is how many entries have it as their home. */
+void hash_table_hopscotch_stats(struct hash_table_hopscotch *hash_table,
+                                struct hash_table_stats *stats);
+void hash_table_hopscotch_destroy(struct hash_table_hopscotch *hash_table);
@@ -0,0 +1,321 @@
+#include "hash-table-shm.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SHM_MAGIC 0x7068742d73686d32 /* "pht-shm2" */
+
+/* An offset of 0 is the header, so it doubles as the `NULL` offset. */
+typedef uint64_t shm_offset;
+
+/* Nodes are never freed or moved, only `next` and `value` change after a node
+   is published, so readers can walk the chains without the bucket lock. */
+struct shm_node {
+	shm_offset key;
+	_Atomic shm_offset next;
+	_Atomic uint32_t value;
+};
+
+struct shm_bucket {
+	pthread_mutex_t mutex;
+	_Atomic shm_offset head;
+};
+
+/* The start of the region. The nodes and key heap follow, both are bump
+   allocated. `used` packs the nodes taken into its low 32 bits and the key
+   bytes taken into its high 32 bits, so an insertion reserves both with a
+   single compare and swap. */
+struct shm_header {
+	uint64_t magic;
+	uint64_t size;
+	uint64_t node_offset;
+	uint64_t node_capacity;
+	uint64_t key_offset;
+	uint64_t key_capacity;
+	_Atomic uint64_t used;
+	struct shm_bucket buckets[HASH_TABLE_CAPACITY];
+};
+
+/* The process-local handle. */
+struct hash_table_shm {
+	struct shm_header *header;
+	size_t size;
+	char *name;
+};
+
+static void *at(struct hash_table_shm *hash_table, shm_offset offset)
+{
+	assert(offset != 0 && offset < hash_table->size);
+	return (char *) hash_table->header + offset;
+}
+
+static struct hash_table_shm *map_region(int fd, size_t size, const char *name)
+{
+	int flags = MAP_SHARED;
+	if (fd == -1) {
+		flags |= MAP_ANONYMOUS;
+	}
+	void *region = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+	if (region == MAP_FAILED) {
+		return NULL;
+	}
+
+	struct hash_table_shm *hash_table = calloc(1, sizeof(struct hash_table_shm));
+	assert(hash_table != NULL);
+	hash_table->header = region;
+	hash_table->size = size;
+	if (name != NULL) {
+		hash_table->name = strdup(name);
+		assert(hash_table->name != NULL);
+	}
+	return hash_table;
+}
+
+struct hash_table_shm *hash_table_shm_create(const char *name,
+                                             size_t max_entries,
+                                             size_t key_bytes)
+{
+	if (max_entries > UINT32_MAX || key_bytes > UINT32_MAX) {
+		errno = EINVAL;
+		return NULL;
+	}
+	size_t node_offset = sizeof(struct shm_header);
+	node_offset = (node_offset + _Alignof(struct shm_node) - 1)
+	              & ~(_Alignof(struct shm_node) - 1);
+	size_t key_offset = node_offset + max_entries * sizeof(struct shm_node);
+	size_t size = key_offset + key_bytes;
+
+	int fd = -1;
+	if (name != NULL) {
+		fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (fd == -1) {
+			return NULL;
+		}
+		if (ftruncate(fd, size) == -1) {
+			close(fd);
+			shm_unlink(name);
+			return NULL;
+		}
+	}
+	struct hash_table_shm *hash_table = map_region(fd, size, name);
+	if (fd != -1) {
+		close(fd);
+	}
+	if (hash_table == NULL) {
+		if (name != NULL) {
+			shm_unlink(name);
+		}
+		return NULL;
+	}
+
+	/* A fresh mapping is zero filled, so only the non-zero fields and the
+	   mutexes need initializing. */
+	struct shm_header *header = hash_table->header;
+	header->size = size;
+	header->node_offset = node_offset;
+	header->node_capacity = max_entries;
+	header->key_offset = key_offset;
+	header->key_capacity = key_bytes;
+
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	for (size_t i = 0; i < HASH_TABLE_CAPACITY; ++i) {
+		pthread_mutex_init(&header->buckets[i].mutex, &attr);
+	}
+	pthread_mutexattr_destroy(&attr);
+
+	/* Attaching processes check the magic last. */
+	atomic_thread_fence(memory_order_release);
+	header->magic = SHM_MAGIC;
+	return hash_table;
+}
+
+struct hash_table_shm *hash_table_shm_attach(const char *name)
+{
+	assert(name != NULL);
+	int fd = shm_open(name, O_RDWR, 0);
+	if (fd == -1) {
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(struct shm_header)) {
+		close(fd);
+		return NULL;
+	}
+	struct hash_table_shm *hash_table = map_region(fd, st.st_size, name);
+	close(fd);
+	if (hash_table == NULL) {
+		return NULL;
+	}
+	if (hash_table->header->magic != SHM_MAGIC
+	    || hash_table->header->size != hash_table->size) {
+		hash_table_shm_detach(hash_table);
+		return NULL;
+	}
+	atomic_thread_fence(memory_order_acquire);
+	return hash_table;
+}
+
+/* If the previous owner died holding the lock, the chain is still intact:
+   a node only becomes reachable with the single store that publishes it. */
+static void lock_bucket(struct shm_bucket *bucket)
+{
+	int err = pthread_mutex_lock(&bucket->mutex);
+	if (err == EOWNERDEAD) {
+		pthread_mutex_consistent(&bucket->mutex);
+	}
+	else {
+		assert(err == 0);
+	}
+}
+
+static struct shm_bucket *get_bucket(struct hash_table_shm *hash_table,
+                                     const char *key)
+{
+	assert(key != NULL);
+	uint32_t index = bernstein_hash(key) % HASH_TABLE_CAPACITY;
+	return &hash_table->header->buckets[index];
+}
+
+static struct shm_node *get_node(struct hash_table_shm *hash_table,
+                                 struct shm_bucket *bucket,
+                                 const char *key)
+{
+	shm_offset offset = atomic_load_explicit(&bucket->head, memory_order_acquire);
+	while (offset != 0) {
+		struct shm_node *node = at(hash_table, offset);
+		if (strcmp(at(hash_table, node->key), key) == 0) {
+			return node;
+		}
+		offset = atomic_load_explicit(&node->next, memory_order_acquire);
+	}
+	return NULL;
+}
+
+#define USED_NODES(used) ((used) & UINT32_MAX)
+#define USED_KEY_BYTES(used) ((used) >> 32)
+
+/* Takes a node and `key_size` bytes of the key heap, or neither if either of
+   them is out of space, so a failed insertion doesn't leak the other one. */
+static bool reserve(struct shm_header *header,
+                    size_t key_size,
+                    shm_offset *node_offset,
+                    shm_offset *key_offset)
+{
+	uint64_t used = atomic_load_explicit(&header->used, memory_order_relaxed);
+	do {
+		if (USED_NODES(used) + 1 > header->node_capacity
+		    || USED_KEY_BYTES(used) + key_size > header->key_capacity) {
+			return false;
+		}
+	} while (!atomic_compare_exchange_weak_explicit(&header->used, &used,
+	                                                used + 1 + ((uint64_t) key_size << 32),
+	                                                memory_order_relaxed,
+	                                                memory_order_relaxed));
+	*node_offset = header->node_offset + USED_NODES(used) * sizeof(struct shm_node);
+	*key_offset = header->key_offset + USED_KEY_BYTES(used);
+	return true;
+}
+
+bool hash_table_shm_add_entry(struct hash_table_shm *hash_table,
+                              const char *key,
+                              uint32_t value)
+{
+	struct shm_header *header = hash_table->header;
+	struct shm_bucket *bucket = get_bucket(hash_table, key);
+	lock_bucket(bucket);
+	struct shm_node *node = get_node(hash_table, bucket, key);
+
+	/* Update the value if it already exists */
+	if (node != NULL) {
+		atomic_store_explicit(&node->value, value, memory_order_relaxed);
+		pthread_mutex_unlock(&bucket->mutex);
+		return true;
+	}
+
+	size_t key_size = strlen(key) + 1;
+	shm_offset node_offset;
+	shm_offset key_offset;
+	if (!reserve(header, key_size, &node_offset, &key_offset)) {
+		pthread_mutex_unlock(&bucket->mutex);
+		return false;
+	}
+
+	memcpy(at(hash_table, key_offset), key, key_size);
+	node = at(hash_table, node_offset);
+	node->key = key_offset;
+	atomic_store_explicit(&node->value, value, memory_order_relaxed);
+	atomic_store_explicit(&node->next,
+	                      atomic_load_explicit(&bucket->head, memory_order_relaxed),
+	                      memory_order_relaxed);
+	atomic_store_explicit(&bucket->head, node_offset, memory_order_release);
+	pthread_mutex_unlock(&bucket->mutex);
+	return true;
+}
+
+bool hash_table_shm_contains(struct hash_table_shm *hash_table,
+                             const char *key)
+{
+	struct shm_bucket *bucket = get_bucket(hash_table, key);
+	return get_node(hash_table, bucket, key) != NULL;
+}
+
+uint32_t hash_table_shm_get_value(struct hash_table_shm *hash_table,
+                                  const char *key)
+{
+	struct shm_bucket *bucket = get_bucket(hash_table, key);
+	struct shm_node *node = get_node(hash_table, bucket, key);
+	assert(node != NULL);
+	return atomic_load_explicit(&node->value, memory_order_relaxed);
+}
+
+/* The header holds the buckets, the rest is what the bump allocators handed
+   out so far rather than the size of the region. */
+void hash_table_shm_stats(struct hash_table_shm *hash_table,
+                          struct hash_table_stats *stats)
+{
+	struct shm_header *header = hash_table->header;
+	size_t *chain_lengths = calloc(HASH_TABLE_CAPACITY, sizeof(size_t));
+	assert(chain_lengths != NULL);
+	for (size_t i = 0; i < HASH_TABLE_CAPACITY; ++i) {
+		shm_offset offset = atomic_load_explicit(&header->buckets[i].head,
+		                                         memory_order_acquire);
+		while (offset != 0) {
+			struct shm_node *node = at(hash_table, offset);
+			++chain_lengths[i];
+			offset = atomic_load_explicit(&node->next, memory_order_acquire);
+		}
+	}
+
+	stats->bucket_bytes = header->node_offset;
+	uint64_t used = atomic_load(&header->used);
+	stats->node_bytes = USED_NODES(used) * sizeof(struct shm_node);
+	stats->key_bytes = USED_KEY_BYTES(used);
+	hash_table_stats_from_chains(stats, chain_lengths, HASH_TABLE_CAPACITY);
+	free(chain_lengths);
+}
+
+void hash_table_shm_detach(struct hash_table_shm *hash_table)
+{
+	munmap(hash_table->header, hash_table->size);
+	free(hash_table->name);
+	free(hash_table);
+}
+
+void hash_table_shm_destroy(struct hash_table_shm *hash_table)
+{
+	if (hash_table->name != NULL) {
+		shm_unlink(hash_table->name);
+	}
+	hash_table_shm_detach(hash_table);
+}
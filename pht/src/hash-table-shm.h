@@ -0,0 +1,41 @@
+#pragma once
+
+#include "hash-table-common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* A hash table that lives entirely in one `MAP_SHARED` region: the buckets,
+   the nodes and a heap the keys are copied into. Everything inside the region
+   refers to everything else by offset, so each process can map it at a
+   different address. Buckets are locked with process-shared robust mutexes,
+   so a process dying while holding one doesn't wedge the others. */
+struct hash_table_shm;
+
+/* Create a region that fits `max_entries` entries and `key_bytes` bytes of
+   keys (including their NUL terminators). If `name` isn't `NULL` the region
+   is a POSIX shared memory object other processes can attach to, otherwise
+   it's anonymous and only shared with children forked after this call.
+   Both sizes can be at most `UINT32_MAX`. Returns `NULL` if the region can't
+   be created. */
+struct hash_table_shm *hash_table_shm_create(const char *name,
+                                             size_t max_entries,
+                                             size_t key_bytes);
+/* Map an existing named region, this doesn't touch its contents beyond the
+   header. Returns `NULL` if it doesn't exist or isn't a table. */
+struct hash_table_shm *hash_table_shm_attach(const char *name);
+/* Returns `false` if the region is out of nodes or key space. */
+bool hash_table_shm_add_entry(struct hash_table_shm *hash_table,
+                              const char *key,
+                              uint32_t value);
+bool hash_table_shm_contains(struct hash_table_shm *hash_table,
+                             const char *key);
+uint32_t hash_table_shm_get_value(struct hash_table_shm *hash_table,
+                                  const char *key);
+void hash_table_shm_stats(struct hash_table_shm *hash_table,
+                          struct hash_table_stats *stats);
+/* Unmap this process' view, the table stays alive for everyone else. */
+void hash_table_shm_detach(struct hash_table_shm *hash_table);
+/* Unmap and, for a named region, remove the name. Processes that are still
+   attached keep a working mapping until they detach. */
+void hash_table_shm_destroy(struct hash_table_shm *hash_table);
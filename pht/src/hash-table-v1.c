@@ -1,4 +1,4 @@
-#include "hash-table-base.h"
+#include "hash-table-v1.h"
 
 #include <assert.h>
 #include <bits/pthreadtypes.h>
@@ -11,6 +11,8 @@ struct list_entry {
 	const char *key;
 	uint32_t value;
 	SLIST_ENTRY(list_entry) pointers;
+	/* Only allocated with a `key_width`, `key` then points here. */
+	struct hash_table_key fixed_key[];
 };
 
 SLIST_HEAD(list_head, list_entry);
@@ -22,17 +24,34 @@ struct hash_table_entry {
 struct hash_table_v1 {
 	struct hash_table_entry entries[HASH_TABLE_CAPACITY];
     pthread_mutex_t mutex;
+	enum hash_table_alloc alloc;
+	struct hash_table_pool pool;
+	size_t key_width;
 };
 
 struct hash_table_v1 *hash_table_v1_create()
 {
-	struct hash_table_v1 *hash_table = calloc(1, sizeof(struct hash_table_v1));
-	assert(hash_table != NULL);
+	struct hash_table_options options = { 0 };
+	return hash_table_v1_create_with(&options);
+}
+
+struct hash_table_v1 *hash_table_v1_create_with(const struct hash_table_options *options)
+{
+	struct hash_table_v1 *hash_table = hash_table_alloc(sizeof(struct hash_table_v1),
+	                                                    options->alloc);
 	for (size_t i = 0; i < HASH_TABLE_CAPACITY; ++i) {
 		struct hash_table_entry *entry = &hash_table->entries[i];
 		SLIST_INIT(&entry->list_head);
 	}
 	pthread_mutex_init(&hash_table->mutex, NULL);
+	hash_table->alloc = options->alloc;
+	assert(options->key_width == 0 || options->key_width == 8 || options->key_width == 16);
+	hash_table->key_width = options->key_width;
+	size_t node_size = sizeof(struct list_entry);
+	if (hash_table->key_width != 0) {
+		node_size += sizeof(struct hash_table_key);
+	}
+	hash_table_pool_init(&hash_table->pool, node_size, options->alloc);
 	
 	return hash_table;
 }
@@ -41,18 +60,29 @@ static struct hash_table_entry *get_hash_table_entry(struct hash_table_v1 *hash_
                                                      const char *key)
 {
 	assert(key != NULL);
-	uint32_t index = bernstein_hash(key) % HASH_TABLE_CAPACITY;
+	uint32_t index = hash_table_hash(key, hash_table->key_width) % HASH_TABLE_CAPACITY;
 	struct hash_table_entry *entry = &hash_table->entries[index];
 	return entry;
 }
 
-static struct list_entry *get_list_entry(struct list_head *list_head,
+static struct list_entry *get_list_entry(size_t key_width,
+                                         struct list_head *list_head,
                                          const char *key)
 {
 	assert(key != NULL);
 
 	struct list_entry *entry = NULL;
 	
+	if (key_width != 0) {
+		struct hash_table_key fixed = hash_table_key_load(key, key_width);
+		SLIST_FOREACH(entry, list_head, pointers) {
+			if (hash_table_key_equal(entry->fixed_key, &fixed)) {
+				return entry;
+			}
+		}
+		return NULL;
+	}
+
 	SLIST_FOREACH(entry, list_head, pointers) {
 	  if (strcmp(entry->key, key) == 0) {
 	    return entry;
@@ -66,7 +96,7 @@ bool hash_table_v1_contains(struct hash_table_v1 *hash_table,
 {
 	struct hash_table_entry *hash_table_entry = get_hash_table_entry(hash_table, key);
 	struct list_head *list_head = &hash_table_entry->list_head;
-	struct list_entry *list_entry = get_list_entry(list_head, key);
+	struct list_entry *list_entry = get_list_entry(hash_table->key_width, list_head, key);
 	return list_entry != NULL;
 }
 
@@ -78,16 +108,21 @@ void hash_table_v1_add_entry(struct hash_table_v1 *hash_table,
 	struct hash_table_entry *hash_table_entry = get_hash_table_entry(hash_table, key);
 	struct list_head *list_head = &hash_table_entry->list_head;
 	pthread_mutex_lock(&hash_table->mutex);
-	struct list_entry *list_entry = get_list_entry(list_head, key);
+	struct list_entry *list_entry = get_list_entry(hash_table->key_width, list_head, key);
 
 
 	/* Update the value if it already exists */
 	if (list_entry != NULL) {
 		list_entry->value = value;
+		pthread_mutex_unlock(&hash_table->mutex);
 		return;
 	}
 
-	list_entry = calloc(1, sizeof(struct list_entry));
+	list_entry = hash_table_pool_alloc(&hash_table->pool);
+	if (hash_table->key_width != 0) {
+		list_entry->fixed_key[0] = hash_table_key_load(key, hash_table->key_width);
+		key = (const char *) list_entry->fixed_key;
+	}
 	list_entry->key = key;
 	list_entry->value = value;
 	SLIST_INSERT_HEAD(list_head, list_entry, pointers);
@@ -99,11 +134,120 @@ uint32_t hash_table_v1_get_value(struct hash_table_v1 *hash_table,
 {
 	struct hash_table_entry *hash_table_entry = get_hash_table_entry(hash_table, key);
 	struct list_head *list_head = &hash_table_entry->list_head;
-	struct list_entry *list_entry = get_list_entry(list_head, key);
+	struct list_entry *list_entry = get_list_entry(hash_table->key_width, list_head, key);
 	assert(list_entry != NULL);
 	return list_entry->value;
 }
 
+struct hash_table_v1_iterator {
+	struct hash_table_v1 *hash_table;
+	size_t bucket;
+	size_t position;
+	struct hash_table_bucket_copy copy;
+};
+
+/* Only holds the table lock for one bucket, so writers get in between. */
+static void copy_bucket(struct hash_table_v1 *hash_table,
+                        size_t bucket,
+                        struct hash_table_bucket_copy *copy)
+{
+	struct list_entry *list_entry = NULL;
+	pthread_mutex_lock(&hash_table->mutex);
+	SLIST_FOREACH(list_entry, &hash_table->entries[bucket].list_head, pointers) {
+		hash_table_bucket_copy_add(copy, list_entry->key, list_entry->value);
+	}
+	pthread_mutex_unlock(&hash_table->mutex);
+}
+
+struct hash_table_v1_iterator *hash_table_v1_iterator_create(struct hash_table_v1 *hash_table)
+{
+	struct hash_table_v1_iterator *iterator = calloc(1, sizeof(struct hash_table_v1_iterator));
+	assert(iterator != NULL);
+	iterator->hash_table = hash_table;
+	return iterator;
+}
+
+bool hash_table_v1_iterator_next(struct hash_table_v1_iterator *iterator,
+                                 const char **key,
+                                 uint32_t *value)
+{
+	while (iterator->position == iterator->copy.count) {
+		if (iterator->bucket == HASH_TABLE_CAPACITY) {
+			return false;
+		}
+		iterator->copy.count = 0;
+		iterator->position = 0;
+		copy_bucket(iterator->hash_table, iterator->bucket++, &iterator->copy);
+	}
+	struct hash_table_copied_entry *entry = &iterator->copy.entries[iterator->position++];
+	*key = entry->key;
+	*value = entry->value;
+	return true;
+}
+
+void hash_table_v1_iterator_destroy(struct hash_table_v1_iterator *iterator)
+{
+	hash_table_bucket_copy_destroy(&iterator->copy);
+	free(iterator);
+}
+
+struct foreach_arg {
+	struct hash_table_v1 *hash_table;
+	hash_table_visit visit;
+	void *arg;
+};
+
+static void foreach_range(size_t begin, size_t end, void *arg)
+{
+	struct foreach_arg *foreach = arg;
+	struct hash_table_bucket_copy copy = { 0 };
+	for (size_t i = begin; i < end; ++i) {
+		copy.count = 0;
+		copy_bucket(foreach->hash_table, i, &copy);
+		for (size_t j = 0; j < copy.count; ++j) {
+			foreach->visit(copy.entries[j].key, copy.entries[j].value, foreach->arg);
+		}
+	}
+	hash_table_bucket_copy_destroy(&copy);
+}
+
+void hash_table_v1_foreach(struct hash_table_v1 *hash_table,
+                           size_t threads,
+                           hash_table_visit visit,
+                           void *arg)
+{
+	struct foreach_arg foreach = { hash_table, visit, arg };
+	hash_table_foreach_ranges(HASH_TABLE_CAPACITY, threads, foreach_range, &foreach);
+}
+
+void hash_table_v1_stats(struct hash_table_v1 *hash_table,
+                         struct hash_table_stats *stats)
+{
+	size_t *chain_lengths = calloc(HASH_TABLE_CAPACITY, sizeof(size_t));
+	assert(chain_lengths != NULL);
+	size_t entries = 0;
+	size_t key_bytes = 0;
+	pthread_mutex_lock(&hash_table->mutex);
+	for (size_t i = 0; i < HASH_TABLE_CAPACITY; ++i) {
+		struct hash_table_entry *hash_table_entry = &hash_table->entries[i];
+		struct list_entry *list_entry = NULL;
+		SLIST_FOREACH(list_entry, &hash_table_entry->list_head, pointers) {
+			++chain_lengths[i];
+			if (hash_table->key_width == 0) {
+				key_bytes += strlen(list_entry->key) + 1;
+			}
+		}
+		entries += chain_lengths[i];
+	}
+	pthread_mutex_unlock(&hash_table->mutex);
+
+	stats->bucket_bytes = sizeof(struct hash_table_v1);
+	stats->node_bytes = hash_table_pool_bytes(&hash_table->pool, entries);
+	stats->key_bytes = key_bytes;
+	hash_table_stats_from_chains(stats, chain_lengths, HASH_TABLE_CAPACITY);
+	free(chain_lengths);
+}
+
 void hash_table_v1_destroy(struct hash_table_v1 *hash_table)
 {
 	for (size_t i = 0; i < HASH_TABLE_CAPACITY; ++i) {
@@ -113,9 +257,10 @@ void hash_table_v1_destroy(struct hash_table_v1 *hash_table)
 		while (!SLIST_EMPTY(list_head)) {
 			list_entry = SLIST_FIRST(list_head);
 			SLIST_REMOVE_HEAD(list_head, pointers);
-			free(list_entry);
+			hash_table_pool_free(&hash_table->pool, list_entry);
 		}
 		pthread_mutex_destroy(&hash_table->mutex);
 	}
-	free(hash_table);
+	hash_table_pool_destroy(&hash_table->pool);
+	hash_table_free(hash_table, sizeof(struct hash_table_v1), hash_table->alloc);
 }
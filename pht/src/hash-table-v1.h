@@ -6,6 +6,7 @@
 
 struct hash_table_v1;
 struct hash_table_v1 *hash_table_v1_create();
+struct hash_table_v1 *hash_table_v1_create_with(const struct hash_table_options *options);
 void hash_table_v1_add_entry(struct hash_table_v1 *hash_table,
                              const char *key,
                              uint32_t value);
@@ -13,4 +14,22 @@ bool hash_table_v1_contains(struct hash_table_v1 *hash_table,
                             const char *key);
 uint32_t hash_table_v1_get_value(struct hash_table_v1 *hash_table,
                                  const char* key);
+/* Weakly consistent: every entry that's in the table for the whole iteration
+   shows up exactly once, entries added meanwhile may or may not. Only one
+   bucket lock is held at a time, and none between calls. With a `key_width`,
+   keys are that many bytes without a NUL terminator. */
+struct hash_table_v1_iterator;
+struct hash_table_v1_iterator *hash_table_v1_iterator_create(struct hash_table_v1 *hash_table);
+bool hash_table_v1_iterator_next(struct hash_table_v1_iterator *iterator,
+                                 const char **key,
+                                 uint32_t *value);
+void hash_table_v1_iterator_destroy(struct hash_table_v1_iterator *iterator);
+/* Same guarantees as the iterator, with `threads` threads each walking their
+   own range of buckets. `visit` runs without any lock held. */
+void hash_table_v1_foreach(struct hash_table_v1 *hash_table,
+                           size_t threads,
+                           hash_table_visit visit,
+                           void *arg);
+void hash_table_v1_stats(struct hash_table_v1 *hash_table,
+                         struct hash_table_stats *stats);
 void hash_table_v1_destroy(struct hash_table_v1 *hash_table);
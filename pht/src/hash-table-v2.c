@@ -1,7 +1,8 @@
-#include "hash-table-base.h"
+#include "hash-table-v2.h"
 
 #include <assert.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/queue.h>
@@ -10,47 +11,158 @@ struct list_entry {
 	const char *key;
 	uint32_t value;
 	SLIST_ENTRY(list_entry) pointers;
+	/* Only allocated with a `key_width`, `key` then points here. */
+	struct hash_table_key fixed_key[];
 };
 
 SLIST_HEAD(list_head, list_entry);
 
+/* `migrated` is set (under the mutex) once the resize thread has moved this
+   bucket's entries into the next bucket array. */
 struct hash_table_entry {
 	struct list_head list_head;
     pthread_mutex_t mutex;
+	bool migrated;
+};
+
+/* A table starts with one bucket array. Growing links a bigger array from
+   `next`, which acts as the forwarding marker for every migrated bucket. Old
+   arrays stay around until the table is destroyed, since another thread may
+   still be about to lock one of their buckets. */
+struct bucket_array {
+	size_t size;
+	_Atomic(struct bucket_array *) next;
+	struct hash_table_entry entries[];
 };
 
 struct hash_table_v2 {
-	struct hash_table_entry entries[HASH_TABLE_CAPACITY];
+	_Atomic(struct bucket_array *) current;
+	struct bucket_array *first;
+	enum hash_table_alloc alloc;
+	struct hash_table_pool pool;
+	size_t key_width;
+	bool removable;
+
+	/* Only used if `resize_load_factor` isn't 0. */
+	double resize_load_factor;
+	atomic_size_t count;
+	atomic_bool resize_pending;
+	bool resizing;
+	bool stopping;
+	pthread_t resize_thread;
+	pthread_mutex_t resize_mutex;
+	pthread_cond_t resize_cond;
 };
 
+static size_t bucket_array_bytes(size_t size)
+{
+	return sizeof(struct bucket_array) + size * sizeof(struct hash_table_entry);
+}
+
+static struct bucket_array *bucket_array_create(size_t size, enum hash_table_alloc alloc)
+{
+	struct bucket_array *array = hash_table_alloc(bucket_array_bytes(size), alloc);
+	array->size = size;
+	atomic_init(&array->next, NULL);
+	for (size_t i = 0; i < size; ++i) {
+		struct hash_table_entry *entry = &array->entries[i];
+		pthread_mutex_init(&entry->mutex, NULL);
+		SLIST_INIT(&entry->list_head);
+	}
+	return array;
+}
+
+static void *resize(void *arg);
+
 struct hash_table_v2 *hash_table_v2_create()
+{
+	struct hash_table_options options = { 0 };
+	return hash_table_v2_create_with(&options);
+}
+
+struct hash_table_v2 *hash_table_v2_create_with(const struct hash_table_options *options)
 {
 	struct hash_table_v2 *hash_table = calloc(1, sizeof(struct hash_table_v2));
 	assert(hash_table != NULL);
-	for (size_t i = 0; i < HASH_TABLE_CAPACITY; ++i) {
-		struct hash_table_entry *entry = &hash_table->entries[i];
-		pthread_mutex_init(&entry->mutex, NULL);
-		SLIST_INIT(&entry->list_head);
+	size_t size = options->initial_capacity;
+	if (size == 0) {
+		size = HASH_TABLE_CAPACITY;
+	}
+	hash_table->first = bucket_array_create(size, options->alloc);
+	atomic_init(&hash_table->current, hash_table->first);
+	hash_table->alloc = options->alloc;
+	assert(options->key_width == 0 || options->key_width == 8 || options->key_width == 16);
+	hash_table->key_width = options->key_width;
+	assert(!options->removable || options->key_width == 0);
+	hash_table->removable = options->removable;
+	size_t node_size = sizeof(struct list_entry);
+	if (hash_table->key_width != 0) {
+		node_size += sizeof(struct hash_table_key);
+	}
+	hash_table_pool_init(&hash_table->pool, node_size, options->alloc);
+
+	hash_table->resize_load_factor = options->resize_load_factor;
+	if (hash_table->resize_load_factor > 0) {
+		pthread_mutex_init(&hash_table->resize_mutex, NULL);
+		pthread_cond_init(&hash_table->resize_cond, NULL);
+		int err = pthread_create(&hash_table->resize_thread, NULL, resize, hash_table);
+		assert(err == 0);
+		(void) err;
 	}
 	return hash_table;
 }
 
+/* Without resizing there's only one array and nothing ever moves, so the
+   lookups don't need to lock, like before, unless entries can be removed. */
 static struct hash_table_entry *get_hash_table_entry(struct hash_table_v2 *hash_table,
                                                      const char *key)
 {
 	assert(key != NULL);
-	uint32_t index = bernstein_hash(key) % HASH_TABLE_CAPACITY;
-	struct hash_table_entry *entry = &hash_table->entries[index];
+	struct bucket_array *array = atomic_load_explicit(&hash_table->current,
+	                                                  memory_order_acquire);
+	uint32_t index = hash_table_hash(key, hash_table->key_width) % array->size;
+	struct hash_table_entry *entry = &array->entries[index];
 	return entry;
 }
 
-static struct list_entry *get_list_entry(struct list_head *list_head,
+/* Returns the locked bucket for `key`, following the forwarding markers to the
+   array that holds the key's entries at the moment. */
+static struct hash_table_entry *lock_hash_table_entry(struct hash_table_v2 *hash_table,
+                                                      const char *key)
+{
+	assert(key != NULL);
+	uint32_t hash = hash_table_hash(key, hash_table->key_width);
+	struct bucket_array *array = atomic_load_explicit(&hash_table->current,
+	                                                  memory_order_acquire);
+	while (true) {
+		struct hash_table_entry *entry = &array->entries[hash % array->size];
+		pthread_mutex_lock(&entry->mutex);
+		if (!entry->migrated) {
+			return entry;
+		}
+		pthread_mutex_unlock(&entry->mutex);
+		array = atomic_load_explicit(&array->next, memory_order_acquire);
+	}
+}
+
+static struct list_entry *get_list_entry(size_t key_width,
+                                         struct list_head *list_head,
                                          const char *key)
 {
 	assert(key != NULL);
 
 	struct list_entry *entry = NULL;
-	
+
+	if (key_width != 0) {
+		struct hash_table_key fixed = hash_table_key_load(key, key_width);
+		SLIST_FOREACH(entry, list_head, pointers) {
+			if (hash_table_key_equal(entry->fixed_key, &fixed)) {
+				return entry;
+			}
+		}
+		return NULL;
+	}
+
 	SLIST_FOREACH(entry, list_head, pointers) {
 	  if (strcmp(entry->key, key) == 0) {
 	    return entry;
@@ -59,59 +171,377 @@ static struct list_entry *get_list_entry(struct list_head *list_head,
 	return NULL;
 }
 
+/* Returns whether the key was found, and its value in `value`. */
+static bool lookup(struct hash_table_v2 *hash_table,
+                   const char *key,
+                   uint32_t *value)
+{
+	if (hash_table->resize_load_factor == 0 && !hash_table->removable) {
+		struct hash_table_entry *hash_table_entry = get_hash_table_entry(hash_table, key);
+		struct list_entry *list_entry = get_list_entry(hash_table->key_width,
+		                                               &hash_table_entry->list_head, key);
+		if (list_entry != NULL) {
+			*value = list_entry->value;
+		}
+		return list_entry != NULL;
+	}
+
+	struct hash_table_entry *hash_table_entry = lock_hash_table_entry(hash_table, key);
+	struct list_entry *list_entry = get_list_entry(hash_table->key_width,
+	                                               &hash_table_entry->list_head, key);
+	if (list_entry != NULL) {
+		*value = list_entry->value;
+	}
+	pthread_mutex_unlock(&hash_table_entry->mutex);
+	return list_entry != NULL;
+}
+
 bool hash_table_v2_contains(struct hash_table_v2 *hash_table,
                             const char *key)
 {
-	struct hash_table_entry *hash_table_entry = get_hash_table_entry(hash_table, key);
-	struct list_head *list_head = &hash_table_entry->list_head;
-	struct list_entry *list_entry = get_list_entry(list_head, key);
-	return list_entry != NULL;
+	uint32_t value;
+	return lookup(hash_table, key, &value);
+}
+
+/* Wakes the resize thread once the current array is over its load factor.
+   `resize_pending` stays set until that resize is done, so writers only take
+   the mutex once per resize. */
+static void check_load_factor(struct hash_table_v2 *hash_table, size_t count)
+{
+	struct bucket_array *array = atomic_load_explicit(&hash_table->current,
+	                                                  memory_order_acquire);
+	if (count <= hash_table->resize_load_factor * array->size
+	    || atomic_load_explicit(&hash_table->resize_pending, memory_order_relaxed)
+	    || atomic_exchange(&hash_table->resize_pending, true)) {
+		return;
+	}
+	pthread_mutex_lock(&hash_table->resize_mutex);
+	pthread_cond_signal(&hash_table->resize_cond);
+	pthread_mutex_unlock(&hash_table->resize_mutex);
 }
 
 void hash_table_v2_add_entry(struct hash_table_v2 *hash_table,
                              const char *key,
                              uint32_t value)
 {
-	struct hash_table_entry *hash_table_entry = get_hash_table_entry(hash_table, key);
+	struct hash_table_entry *hash_table_entry = lock_hash_table_entry(hash_table, key);
 	struct list_head *list_head = &hash_table_entry->list_head;
-	pthread_mutex_lock(&hash_table_entry->mutex);
-	struct list_entry *list_entry = get_list_entry(list_head, key);
+	struct list_entry *list_entry = get_list_entry(hash_table->key_width, list_head, key);
 
 	/* Update the value if it already exists */
 	if (list_entry != NULL) {
 		list_entry->value = value;
+		pthread_mutex_unlock(&hash_table_entry->mutex);
 		return;
 	}
 
-	list_entry = calloc(1, sizeof(struct list_entry));
+	list_entry = hash_table_pool_alloc(&hash_table->pool);
+	if (hash_table->key_width != 0) {
+		list_entry->fixed_key[0] = hash_table_key_load(key, hash_table->key_width);
+		key = (const char *) list_entry->fixed_key;
+	}
 	list_entry->key = key;
 	list_entry->value = value;
 	SLIST_INSERT_HEAD(list_head, list_entry, pointers);
     pthread_mutex_unlock(&hash_table_entry->mutex);
+
+	if (hash_table->resize_load_factor > 0) {
+		size_t count = atomic_fetch_add_explicit(&hash_table->count, 1,
+		                                         memory_order_relaxed) + 1;
+		check_load_factor(hash_table, count);
+	}
 }
 
 uint32_t hash_table_v2_get_value(struct hash_table_v2 *hash_table,
                                  const char *key)
 {
-	struct hash_table_entry *hash_table_entry = get_hash_table_entry(hash_table, key);
+	uint32_t value = 0;
+	bool found = lookup(hash_table, key, &value);
+	assert(found);
+	(void) found;
+	return value;
+}
+
+bool hash_table_v2_visit(struct hash_table_v2 *hash_table,
+                         const char *key,
+                         hash_table_visit visit,
+                         void *arg)
+{
+	struct hash_table_entry *hash_table_entry = lock_hash_table_entry(hash_table, key);
+	struct list_entry *list_entry = get_list_entry(hash_table->key_width,
+	                                               &hash_table_entry->list_head, key);
+	if (list_entry != NULL) {
+		visit(list_entry->key, list_entry->value, arg);
+	}
+	pthread_mutex_unlock(&hash_table_entry->mutex);
+	return list_entry != NULL;
+}
+
+bool hash_table_v2_remove(struct hash_table_v2 *hash_table,
+                          const char *key)
+{
+	assert(hash_table->removable);
+	struct hash_table_entry *hash_table_entry = lock_hash_table_entry(hash_table, key);
 	struct list_head *list_head = &hash_table_entry->list_head;
-	struct list_entry *list_entry = get_list_entry(list_head, key);
-	assert(list_entry != NULL);
-	return list_entry->value;
+	struct list_entry *list_entry = get_list_entry(hash_table->key_width, list_head, key);
+	if (list_entry != NULL) {
+		SLIST_REMOVE(list_head, list_entry, list_entry, pointers);
+	}
+	pthread_mutex_unlock(&hash_table_entry->mutex);
+	if (list_entry == NULL) {
+		return false;
+	}
+	hash_table_pool_free(&hash_table->pool, list_entry);
+	if (hash_table->resize_load_factor > 0) {
+		atomic_fetch_sub_explicit(&hash_table->count, 1, memory_order_relaxed);
+	}
+	return true;
 }
 
-void hash_table_v2_destroy(struct hash_table_v2 *hash_table)
+/* Moves every bucket of the current array into one twice its size, one
+   bucket at a time. Writers keep using the old array for buckets that haven't
+   moved yet, and follow `next` for the ones that have. The new array's
+   buckets are only locked while their old bucket is locked, and writers never
+   lock in the other order, so this can't deadlock. */
+static void migrate(struct hash_table_v2 *hash_table)
 {
-	for (size_t i = 0; i < HASH_TABLE_CAPACITY; ++i) {
-		struct hash_table_entry *entry = &hash_table->entries[i];
-		struct list_head *list_head = &entry->list_head;
+	struct bucket_array *old = atomic_load(&hash_table->current);
+	struct bucket_array *new = bucket_array_create(old->size * 2, hash_table->alloc);
+	atomic_store_explicit(&old->next, new, memory_order_release);
+
+	for (size_t i = 0; i < old->size; ++i) {
+		struct hash_table_entry *from = &old->entries[i];
+		pthread_mutex_lock(&from->mutex);
+		while (!SLIST_EMPTY(&from->list_head)) {
+			struct list_entry *list_entry = SLIST_FIRST(&from->list_head);
+			SLIST_REMOVE_HEAD(&from->list_head, pointers);
+			struct hash_table_entry *to
+				= &new->entries[hash_table_hash(list_entry->key, hash_table->key_width)
+				  % new->size];
+			pthread_mutex_lock(&to->mutex);
+			SLIST_INSERT_HEAD(&to->list_head, list_entry, pointers);
+			pthread_mutex_unlock(&to->mutex);
+		}
+		from->migrated = true;
+		pthread_mutex_unlock(&from->mutex);
+	}
+	atomic_store_explicit(&hash_table->current, new, memory_order_release);
+}
+
+/* The resize thread sleeps until a writer sees the load factor go over the
+   limit, and keeps doubling until it's back under. */
+static void *resize(void *arg)
+{
+	struct hash_table_v2 *hash_table = arg;
+	pthread_mutex_lock(&hash_table->resize_mutex);
+	while (true) {
+		while (!atomic_load(&hash_table->resize_pending) && !hash_table->stopping) {
+			pthread_cond_wait(&hash_table->resize_cond, &hash_table->resize_mutex);
+		}
+		if (hash_table->stopping) {
+			break;
+		}
+		hash_table->resizing = true;
+		pthread_mutex_unlock(&hash_table->resize_mutex);
+
+		migrate(hash_table);
+
+		pthread_mutex_lock(&hash_table->resize_mutex);
+		hash_table->resizing = false;
+		pthread_cond_broadcast(&hash_table->resize_cond);
+		struct bucket_array *array = atomic_load(&hash_table->current);
+		atomic_store(&hash_table->resize_pending,
+		             atomic_load(&hash_table->count)
+		             > hash_table->resize_load_factor * array->size);
+	}
+	pthread_mutex_unlock(&hash_table->resize_mutex);
+	return NULL;
+}
+
+/* Waits for a running resize to finish and keeps the next one from starting,
+   so the current array holds every entry. Does nothing without resizing. */
+static void pause_resizing(struct hash_table_v2 *hash_table)
+{
+	if (hash_table->resize_load_factor == 0) {
+		return;
+	}
+	pthread_mutex_lock(&hash_table->resize_mutex);
+	while (hash_table->resizing) {
+		pthread_cond_wait(&hash_table->resize_cond, &hash_table->resize_mutex);
+	}
+}
+
+static void resume_resizing(struct hash_table_v2 *hash_table)
+{
+	if (hash_table->resize_load_factor == 0) {
+		return;
+	}
+	pthread_mutex_unlock(&hash_table->resize_mutex);
+}
+
+/* Buckets are numbered in the array that was current when the iterator was
+   created. Growing the table splits bucket i of an array of size n into
+   buckets i and i + n of the next one, so a migrated bucket is visited by
+   visiting those two instead. */
+struct hash_table_v2_iterator {
+	struct hash_table_v2 *hash_table;
+	struct bucket_array *array;
+	size_t bucket;
+	size_t position;
+	struct hash_table_bucket_copy copy;
+};
+
+static void copy_bucket(struct bucket_array *array,
+                        size_t bucket,
+                        struct hash_table_bucket_copy *copy)
+{
+	struct hash_table_entry *hash_table_entry = &array->entries[bucket];
+	pthread_mutex_lock(&hash_table_entry->mutex);
+	if (hash_table_entry->migrated) {
+		pthread_mutex_unlock(&hash_table_entry->mutex);
+		struct bucket_array *next = atomic_load_explicit(&array->next,
+		                                                 memory_order_acquire);
+		copy_bucket(next, bucket, copy);
+		copy_bucket(next, bucket + array->size, copy);
+		return;
+	}
+	struct list_entry *list_entry = NULL;
+	SLIST_FOREACH(list_entry, &hash_table_entry->list_head, pointers) {
+		hash_table_bucket_copy_add(copy, list_entry->key, list_entry->value);
+	}
+	pthread_mutex_unlock(&hash_table_entry->mutex);
+}
+
+struct hash_table_v2_iterator *hash_table_v2_iterator_create(struct hash_table_v2 *hash_table)
+{
+	struct hash_table_v2_iterator *iterator = calloc(1, sizeof(struct hash_table_v2_iterator));
+	assert(iterator != NULL);
+	iterator->hash_table = hash_table;
+	iterator->array = atomic_load_explicit(&hash_table->current, memory_order_acquire);
+	return iterator;
+}
+
+bool hash_table_v2_iterator_next(struct hash_table_v2_iterator *iterator,
+                                 const char **key,
+                                 uint32_t *value)
+{
+	while (iterator->position == iterator->copy.count) {
+		if (iterator->bucket == iterator->array->size) {
+			return false;
+		}
+		iterator->copy.count = 0;
+		iterator->position = 0;
+		copy_bucket(iterator->array, iterator->bucket++, &iterator->copy);
+	}
+	struct hash_table_copied_entry *entry = &iterator->copy.entries[iterator->position++];
+	*key = entry->key;
+	*value = entry->value;
+	return true;
+}
+
+void hash_table_v2_iterator_destroy(struct hash_table_v2_iterator *iterator)
+{
+	hash_table_bucket_copy_destroy(&iterator->copy);
+	free(iterator);
+}
+
+struct foreach_arg {
+	struct bucket_array *array;
+	hash_table_visit visit;
+	void *arg;
+};
+
+static void foreach_range(size_t begin, size_t end, void *arg)
+{
+	struct foreach_arg *foreach = arg;
+	struct hash_table_bucket_copy copy = { 0 };
+	for (size_t i = begin; i < end; ++i) {
+		copy.count = 0;
+		copy_bucket(foreach->array, i, &copy);
+		for (size_t j = 0; j < copy.count; ++j) {
+			foreach->visit(copy.entries[j].key, copy.entries[j].value, foreach->arg);
+		}
+	}
+	hash_table_bucket_copy_destroy(&copy);
+}
+
+void hash_table_v2_foreach(struct hash_table_v2 *hash_table,
+                           size_t threads,
+                           hash_table_visit visit,
+                           void *arg)
+{
+	struct foreach_arg foreach = {
+		atomic_load_explicit(&hash_table->current, memory_order_acquire),
+		visit,
+		arg,
+	};
+	hash_table_foreach_ranges(foreach.array->size, threads, foreach_range, &foreach);
+}
+
+void hash_table_v2_stats(struct hash_table_v2 *hash_table,
+                         struct hash_table_stats *stats)
+{
+	pause_resizing(hash_table);
+	struct bucket_array *array = atomic_load(&hash_table->current);
+	size_t *chain_lengths = calloc(array->size, sizeof(size_t));
+	assert(chain_lengths != NULL);
+	size_t entries = 0;
+	size_t key_bytes = 0;
+	for (size_t i = 0; i < array->size; ++i) {
+		struct hash_table_entry *hash_table_entry = &array->entries[i];
 		struct list_entry *list_entry = NULL;
-		while (!SLIST_EMPTY(list_head)) {
-			list_entry = SLIST_FIRST(list_head);
-			SLIST_REMOVE_HEAD(list_head, pointers);
-			free(list_entry);
+		pthread_mutex_lock(&hash_table_entry->mutex);
+		SLIST_FOREACH(list_entry, &hash_table_entry->list_head, pointers) {
+			++chain_lengths[i];
+			if (hash_table->key_width == 0) {
+				key_bytes += strlen(list_entry->key) + 1;
+			}
+		}
+		pthread_mutex_unlock(&hash_table_entry->mutex);
+		entries += chain_lengths[i];
+	}
+
+	stats->bucket_bytes = sizeof(struct hash_table_v2);
+	for (struct bucket_array *a = hash_table->first; a != NULL; a = atomic_load(&a->next)) {
+		stats->bucket_bytes += bucket_array_bytes(a->size);
+	}
+	stats->node_bytes = hash_table_pool_bytes(&hash_table->pool, entries);
+	stats->key_bytes = key_bytes;
+	hash_table_stats_from_chains(stats, chain_lengths, array->size);
+	free(chain_lengths);
+	resume_resizing(hash_table);
+}
+
+void hash_table_v2_destroy(struct hash_table_v2 *hash_table)
+{
+	if (hash_table->resize_load_factor > 0) {
+		pthread_mutex_lock(&hash_table->resize_mutex);
+		hash_table->stopping = true;
+		pthread_cond_signal(&hash_table->resize_cond);
+		pthread_mutex_unlock(&hash_table->resize_mutex);
+		pthread_join(hash_table->resize_thread, NULL);
+		pthread_cond_destroy(&hash_table->resize_cond);
+		pthread_mutex_destroy(&hash_table->resize_mutex);
+	}
+
+	/* Every entry is in the last array, the older ones are empty. */
+	struct bucket_array *array = hash_table->first;
+	while (array != NULL) {
+		for (size_t i = 0; i < array->size; ++i) {
+			struct hash_table_entry *entry = &array->entries[i];
+			struct list_head *list_head = &entry->list_head;
+			struct list_entry *list_entry = NULL;
+			while (!SLIST_EMPTY(list_head)) {
+				list_entry = SLIST_FIRST(list_head);
+				SLIST_REMOVE_HEAD(list_head, pointers);
+				hash_table_pool_free(&hash_table->pool, list_entry);
+			}
+			pthread_mutex_destroy(&entry->mutex);
 		}
-		pthread_mutex_destroy(&entry->mutex);
+		struct bucket_array *next = atomic_load(&array->next);
+		hash_table_free(array, bucket_array_bytes(array->size), hash_table->alloc);
+		array = next;
 	}
+	hash_table_pool_destroy(&hash_table->pool);
 	free(hash_table);
 }
@@ -6,6 +6,10 @@
 
 struct hash_table_v2;
 struct hash_table_v2 *hash_table_v2_create();
+/* With `resize_load_factor` set the table grows in a background thread.
+   Buckets move one at a time, so writers only ever wait for a single bucket,
+   and lookups lock their bucket instead of reading it unlocked. */
+struct hash_table_v2 *hash_table_v2_create_with(const struct hash_table_options *options);
 void hash_table_v2_add_entry(struct hash_table_v2 *hash_table,
                              const char *key,
                              uint32_t value);
@@ -13,4 +17,33 @@ bool hash_table_v2_contains(struct hash_table_v2 *hash_table,
                             const char *key);
 uint32_t hash_table_v2_get_value(struct hash_table_v2 *hash_table,
                                  const char* key);
+/* Calls `visit` with the entry for `key`, if there is one, before its bucket
+   is unlocked, so the entry can't be removed meanwhile. Returns whether there
+   was one. */
+bool hash_table_v2_visit(struct hash_table_v2 *hash_table,
+                         const char *key,
+                         hash_table_visit visit,
+                         void *arg);
+/* Only for tables created with `removable`. Returns whether `key` was in the
+   table. */
+bool hash_table_v2_remove(struct hash_table_v2 *hash_table,
+                          const char *key);
+/* Weakly consistent: every entry that's in the table for the whole iteration
+   shows up exactly once, entries added meanwhile may or may not. Only one
+   bucket lock is held at a time, and none between calls. With a `key_width`,
+   keys are that many bytes without a NUL terminator. */
+struct hash_table_v2_iterator;
+struct hash_table_v2_iterator *hash_table_v2_iterator_create(struct hash_table_v2 *hash_table);
+bool hash_table_v2_iterator_next(struct hash_table_v2_iterator *iterator,
+                                 const char **key,
+                                 uint32_t *value);
+void hash_table_v2_iterator_destroy(struct hash_table_v2_iterator *iterator);
+/* Same guarantees as the iterator, with `threads` threads each walking their
+   own range of buckets. `visit` runs without any lock held. */
+void hash_table_v2_foreach(struct hash_table_v2 *hash_table,
+                           size_t threads,
+                           hash_table_visit visit,
+                           void *arg);
+void hash_table_v2_stats(struct hash_table_v2 *hash_table,
+                         struct hash_table_stats *stats);
 void hash_table_v2_destroy(struct hash_table_v2 *hash_table);
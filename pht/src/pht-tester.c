@@ -1,13 +1,28 @@
 #include "hash-table-base.h"
+#include "hash-table-cache.h"
+#include "hash-table-generic.h"
+#include "hash-table-hopscotch.h"
+#include "hash-table-shm.h"
 #include "hash-table-v1.h"
 #include "hash-table-v2.h"
+#include "pht-trace.h"
 
 #include <argp.h>
+#include <errno.h>
+#include <linux/perf_event.h>
 #include <locale.h>
+#include <math.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
 
 char *entries;
 
@@ -18,11 +33,37 @@ void (*add_entry)(void *, const char *key, uint32_t value);
 struct arguments {
 	uint32_t threads;
 	uint32_t size;
+	uint32_t cache_capacity;
+	double zipf_theta;
+	bool shm;
+	bool huge;
+	bool generic;
+	const char *record;
+	const char *replay;
+	const char *variant;
+	bool hopscotch;
+	bool latency;
+	bool fixed_keys;
+	bool iterate;
+	const char *bench;
 };
 
 static struct argp_option options[] = { 
 	{ "threads", 't', "NUM", 0, "Number of threads.", 0},
 	{ "size", 's', "NUM", 0, "Size per thread.", 0},
+	{ "cache", 'c', "NUM", 0, "Capacity of the cache (0 skips the cache).", 0},
+	{ "zipf", 'z', "THETA", 0, "Skew of the cache's Zipfian accesses.", 0},
+	{ "shm", 'm', 0, 0, "Run the shared-memory table with a process per thread.", 0},
+	{ "huge", 'H', 0, 0, "Also run every table with huge pages and count dTLB misses.", 0},
+	{ "generic", 'g', 0, 0, "Run the generated string and integer key tables.", 0},
+	{ "hopscotch", 'o', 0, 0, "Run the hopscotch table at load factors 0.5 to 0.95.", 0},
+	{ "fixed-keys", 'w', 0, 0, "Also run every table with 8 byte fixed-width keys.", 0},
+	{ "iterate", 'i', 0, 0, "Only time the variant's iterator and foreach while writers run.", 0},
+	{ "bench", 'b', "WORKLOAD", 0, "Only time one workload (insert, lookup, fixed-keys, huge or iterate) of the variant and print it as JSON.", 0},
+	{ "latency", 'l', 0, 0, "Compare v2 insert latencies with and without resizing.", 0},
+	{ "variant", 'V', "NAME", 0, "Table to record (base, v1 or v2) or replay (also cache, shm or hopscotch).", 0},
+	{ "record", 'r', "FILE", 0, "Write a trace of the variant's operations.", 0},
+	{ "replay", 'R', "FILE", 0, "Only replay a trace through the variant.", 0},
 	{ 0 } 
 };
 
@@ -73,6 +114,50 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
 	case 's':
 		arguments->size = parse_uint32_t(arg);
 		break;
+	case 'c':
+		arguments->cache_capacity = parse_uint32_t(arg);
+		break;
+	case 'z': {
+		char *end = NULL;
+		arguments->zipf_theta = strtod(arg, &end);
+		if (*end != 0 || arguments->zipf_theta < 0) {
+			exit(EINVAL);
+		}
+		break;
+	}
+	case 'm':
+		arguments->shm = true;
+		break;
+	case 'H':
+		arguments->huge = true;
+		break;
+	case 'g':
+		arguments->generic = true;
+		break;
+	case 'o':
+		arguments->hopscotch = true;
+		break;
+	case 'l':
+		arguments->latency = true;
+		break;
+	case 'w':
+		arguments->fixed_keys = true;
+		break;
+	case 'i':
+		arguments->iterate = true;
+		break;
+	case 'b':
+		arguments->bench = arg;
+		break;
+	case 'V':
+		arguments->variant = arg;
+		break;
+	case 'r':
+		arguments->record = arg;
+		break;
+	case 'R':
+		arguments->replay = arg;
+		break;
 	}   
 	return 0;
 }
@@ -98,33 +183,1012 @@ static unsigned long usec_diff(struct timeval *a, struct timeval *b)
 	return usec;
 }
 
-static struct hash_table_v1 *hash_table_v1;
+static void *hash_table;
+static struct pht_trace_writer *trace_writer;
+
+void *run_add_entry(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		size_t global_index = get_global_index(thread, j);
+		char *string = get_string(global_index);
+		if (trace_writer != NULL) {
+			pht_trace_write(trace_writer, PHT_TRACE_ADD_ENTRY, thread,
+			                string, global_index);
+		}
+		add_entry(hash_table, string, global_index);
+	}
+	return NULL;
+}
+
+/* Runs `run` on every thread and waits for all of them. */
+static int run_threads(pthread_t *threads, void *(*run)(void *)) {
+	for (uintptr_t i = 0; i < arguments.threads; ++i) {
+		int err = pthread_create(&threads[i], NULL, run, (void*) i);
+		if (err != 0) {
+			printf("pthread_create returned %d\n", err);
+			return err;
+		}
+	}
+	for (uintptr_t i = 0; i < arguments.threads; ++i) {
+		int err = pthread_join(threads[i], NULL);
+		if (err != 0) {
+			printf("pthread_join returned %d\n", err);
+			return err;
+		}
+	}
+	return 0;
+}
+
+/* The tables that are timed the same way: fill from every thread (or from
+   one, for base), then look every key up. */
+struct hash_table_ops {
+	const char *name;
+	bool threaded;
+	void *(*create)(const struct hash_table_options *options);
+	void (*add_entry)(void *hash_table, const char *key, uint32_t value);
+	bool (*contains)(void *hash_table, const char *key);
+	void (*stats)(void *hash_table, struct hash_table_stats *stats);
+	void (*destroy)(void *hash_table);
+	void *(*iterator_create)(void *hash_table);
+	bool (*iterator_next)(void *iterator, const char **key, uint32_t *value);
+	void (*iterator_destroy)(void *iterator);
+	void (*foreach)(void *hash_table, size_t threads, hash_table_visit visit,
+	                void *arg);
+};
+
+#define HASH_TABLE_OPS(variant, is_threaded)                                    \
+	static void *variant##_create(const struct hash_table_options *options) \
+	{                                                                       \
+		return hash_table_##variant##_create_with(options);             \
+	}                                                                       \
+	static void variant##_add_entry(void *hash_table, const char *key,      \
+	                                uint32_t value)                         \
+	{                                                                       \
+		hash_table_##variant##_add_entry(hash_table, key, value);       \
+	}                                                                       \
+	static bool variant##_contains(void *hash_table, const char *key)       \
+	{                                                                       \
+		return hash_table_##variant##_contains(hash_table, key);        \
+	}                                                                       \
+	static void variant##_stats(void *hash_table,                           \
+	                            struct hash_table_stats *stats)             \
+	{                                                                       \
+		hash_table_##variant##_stats(hash_table, stats);                \
+	}                                                                       \
+	static void variant##_destroy(void *hash_table)                         \
+	{                                                                       \
+		hash_table_##variant##_destroy(hash_table);                     \
+	}                                                                       \
+	static void *variant##_iterator_create(void *hash_table)                \
+	{                                                                       \
+		return hash_table_##variant##_iterator_create(hash_table);      \
+	}                                                                       \
+	static bool variant##_iterator_next(void *iterator, const char **key,   \
+	                                    uint32_t *value)                    \
+	{                                                                       \
+		return hash_table_##variant##_iterator_next(iterator, key,      \
+		                                            value);             \
+	}                                                                       \
+	static void variant##_iterator_destroy(void *iterator)                  \
+	{                                                                       \
+		hash_table_##variant##_iterator_destroy(iterator);              \
+	}                                                                       \
+	static void variant##_foreach(void *hash_table, size_t threads,         \
+	                              hash_table_visit visit, void *arg)        \
+	{                                                                       \
+		hash_table_##variant##_foreach(hash_table, threads, visit, arg);\
+	}                                                                       \
+	static const struct hash_table_ops variant##_ops = {                    \
+		#variant, is_threaded, variant##_create, variant##_add_entry,   \
+		variant##_contains, variant##_stats, variant##_destroy,         \
+		variant##_iterator_create, variant##_iterator_next,             \
+		variant##_iterator_destroy, variant##_foreach,                  \
+	}
+
+HASH_TABLE_OPS(base, false);
+HASH_TABLE_OPS(v1, true);
+HASH_TABLE_OPS(v2, true);
+
+/* Runs `run` for every thread, on its own thread if the table allows it. */
+static int run_workers(const struct hash_table_ops *ops,
+                       pthread_t *threads,
+                       void *(*run)(void *)) {
+	if (ops->threaded) {
+		return run_threads(threads, run);
+	}
+	for (uintptr_t i = 0; i < arguments.threads; ++i) {
+		run((void*) i);
+	}
+	return 0;
+}
+
+static void print_stats(struct hash_table_stats *stats) {
+	printf("  - %'zu entries, %'zu bytes (%'zu buckets, %'zu nodes, %'zu keys)\n",
+	       stats->entries, stats->total_bytes, stats->bucket_bytes,
+	       stats->node_bytes, stats->key_bytes);
+	printf("  - load factor %.2f, chain length max %zu, mean %.2f, p99 %zu\n",
+	       stats->load_factor, stats->max_chain, stats->mean_chain,
+	       stats->p99_chain);
+}
+
+/* Counts data TLB read misses in user space for this process, including the
+   threads it creates while the counter is open. Returns -1 if the kernel or
+   the machine can't count them. */
+static int dtlb_open(void) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CACHE_DTLB
+	              | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+	              | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.inherit = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static const struct hash_table_ops *find_ops(const char *name) {
+	const struct hash_table_ops *tables[] = { &base_ops, &v1_ops, &v2_ops };
+	for (size_t i = 0; i < sizeof(tables) / sizeof(tables[0]); ++i) {
+		if (strcmp(tables[i]->name, name) == 0) {
+			return tables[i];
+		}
+	}
+	return NULL;
+}
+
+/* Records the phase of the variant picked with `--variant`: every thread's
+   insertions, a barrier once they're all done, then the lookups that check
+   for missing keys as thread 0. */
+static bool recording(const struct hash_table_ops *ops,
+                      const struct hash_table_options *table_options) {
+	return arguments.record != NULL && table_options->alloc == HASH_TABLE_ALLOC_DEFAULT
+	       && table_options->key_width == 0
+	       && strcmp(ops->name, arguments.variant) == 0;
+}
+
+static int run_phase(const struct hash_table_ops *ops,
+                     const struct hash_table_options *table_options,
+                     pthread_t *threads) {
+	struct timeval start, end;
+	if (recording(ops, table_options)) {
+		trace_writer = pht_trace_writer_open(arguments.record);
+		if (trace_writer == NULL) {
+			perror(arguments.record);
+			return errno;
+		}
+	}
+	hash_table = ops->create(table_options);
+	add_entry = ops->add_entry;
+
+	int dtlb = -1;
+	if (arguments.huge) {
+		dtlb = dtlb_open();
+		if (dtlb != -1) {
+			ioctl(dtlb, PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+
+	gettimeofday(&start, NULL);
+	if (ops->threaded) {
+		int err = run_threads(threads, run_add_entry);
+		if (err != 0) {
+			return err;
+		}
+	}
+	else {
+		for (uintptr_t i = 0; i < arguments.threads; ++i) {
+			run_add_entry((void*) i);
+		}
+	}
+	gettimeofday(&end, NULL);
+
+	uint64_t dtlb_misses = 0;
+	if (dtlb != -1) {
+		ioctl(dtlb, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(dtlb, &dtlb_misses, sizeof(dtlb_misses)) != sizeof(dtlb_misses)) {
+			dtlb_misses = 0;
+		}
+		close(dtlb);
+	}
+
+	printf("Hash table %s%s%s: %'lu usec\n", ops->name,
+	       table_options->alloc == HASH_TABLE_ALLOC_HUGE ? " (huge pages)" : "",
+	       table_options->key_width != 0 ? " (fixed keys)" : "",
+	       usec_diff(&start, &end));
+	if (arguments.huge) {
+		if (dtlb == -1) {
+			printf("  - dTLB misses not available\n");
+		}
+		else {
+			printf("  - %'lu dTLB misses\n", dtlb_misses);
+		}
+	}
+
+	if (trace_writer != NULL) {
+		pht_trace_write_barrier(trace_writer);
+	}
+	size_t missing = 0;
+	for (uint32_t i = 0; i < arguments.threads; ++i) {
+		for (uint32_t j = 0; j < arguments.size; ++j) {
+			size_t global_index = get_global_index(i, j);
+			char *string = get_string(global_index);
+			if (trace_writer != NULL) {
+				pht_trace_write(trace_writer, PHT_TRACE_CONTAINS, 0,
+				                string, 0);
+			}
+			if (!ops->contains(hash_table, string)) {
+				++missing;
+			}
+		}
+	}
+	printf("  - %'lu missing\n", missing);
+	if (trace_writer != NULL) {
+		int err = pht_trace_writer_close(trace_writer);
+		trace_writer = NULL;
+		if (err != 0) {
+			printf("writing %s failed: %s\n", arguments.record, strerror(err));
+			return err;
+		}
+	}
+	struct hash_table_stats stats;
+	ops->stats(hash_table, &stats);
+	print_stats(&stats);
+	ops->destroy(hash_table);
+	return 0;
+}
+
+/* The same shape as the other tables, but generated. */
+HASH_TABLE_GENERIC_DEFINE(generic_string, const char *, uint32_t, HASH_TABLE_CAPACITY,
+                          hash_table_generic_hash_string,
+                          hash_table_generic_equal_string);
+
+static struct generic_string *generic_string;
+
+void *run_generic_string(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		size_t global_index = get_global_index(thread, j);
+		char *string = get_string(global_index);
+		generic_string_add_entry(generic_string, string, global_index);
+	}
+	return NULL;
+}
+
+/* Integer keys with a struct value. The keys are the same random strings,
+   read as one 64-bit integer. */
+struct generic_value {
+	uint32_t thread;
+	uint32_t index;
+};
+
+HASH_TABLE_GENERIC_DEFINE(generic_uint64, uint64_t, struct generic_value,
+                          HASH_TABLE_CAPACITY,
+                          hash_table_generic_hash_uint64,
+                          hash_table_generic_equal_uint64);
+
+static struct generic_uint64 *generic_uint64;
+
+_Static_assert(BYTES_PER_STRING == sizeof(uint64_t), "keys must fit a uint64_t");
+
+static uint64_t get_uint64(size_t global_index)
+{
+	uint64_t key;
+	memcpy(&key, get_string(global_index), sizeof(key));
+	return key;
+}
+
+void *run_generic_uint64(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		size_t global_index = get_global_index(thread, j);
+		struct generic_value value = { thread, j };
+		generic_uint64_add_entry(generic_uint64, get_uint64(global_index), value);
+	}
+	return NULL;
+}
+
+static struct pht_trace *trace;
+static const struct hash_table_ops *replay_ops;
+static uint64_t replay_missing;
+static uint64_t replay_failed;
+static uint64_t replay_walked;
+static pthread_barrier_t replay_barrier;
+
+/* The tables without an iterator can only be replayed. They're sized from the
+   trace, which has at most as many entries as it has records, and at most as
+   many key bytes as the whole file. The cache keeps `--cache` entries if it's
+   set, otherwise all of them. */
+static void *cache_replay_create(const struct hash_table_options *options) {
+	(void) options;
+	uint64_t capacity = arguments.cache_capacity;
+	if (capacity == 0) {
+		capacity = trace->records > 0 ? trace->records : 1;
+	}
+	if (capacity > UINT32_MAX) {
+		return NULL;
+	}
+	return hash_table_cache_create(capacity, NULL);
+}
+
+static void cache_replay_add_entry(void *hash_table, const char *key,
+                                   uint32_t value) {
+	hash_table_cache_put(hash_table, key, value);
+}
+
+static bool cache_replay_contains(void *hash_table, const char *key) {
+	return hash_table_cache_get(hash_table, key, NULL);
+}
+
+static void cache_replay_stats(void *hash_table, struct hash_table_stats *stats) {
+	hash_table_cache_stats(hash_table, stats);
+}
+
+static void cache_replay_destroy(void *hash_table) {
+	hash_table_cache_destroy(hash_table);
+}
+
+static void *shm_replay_create(const struct hash_table_options *options) {
+	(void) options;
+	return hash_table_shm_create(NULL, trace->records, trace->size);
+}
+
+static void shm_replay_add_entry(void *hash_table, const char *key,
+                                 uint32_t value) {
+	if (!hash_table_shm_add_entry(hash_table, key, value)) {
+		__atomic_fetch_add(&replay_failed, 1, __ATOMIC_RELAXED);
+	}
+}
+
+static bool shm_replay_contains(void *hash_table, const char *key) {
+	return hash_table_shm_contains(hash_table, key);
+}
+
+static void shm_replay_stats(void *hash_table, struct hash_table_stats *stats) {
+	hash_table_shm_stats(hash_table, stats);
+}
+
+static void shm_replay_destroy(void *hash_table) {
+	hash_table_shm_destroy(hash_table);
+}
+
+/* Twice as many slots as entries, a load factor hopscotch never fills up
+   at. */
+static void *hopscotch_replay_create(const struct hash_table_options *options) {
+	(void) options;
+	return hash_table_hopscotch_create(2 * (trace->records > 0 ? trace->records : 1));
+}
+
+static void hopscotch_replay_add_entry(void *hash_table, const char *key,
+                                       uint32_t value) {
+	if (!hash_table_hopscotch_add_entry(hash_table, key, value)) {
+		__atomic_fetch_add(&replay_failed, 1, __ATOMIC_RELAXED);
+	}
+}
+
+static bool hopscotch_replay_contains(void *hash_table, const char *key) {
+	return hash_table_hopscotch_contains(hash_table, key);
+}
+
+static void hopscotch_replay_stats(void *hash_table,
+                                   struct hash_table_stats *stats) {
+	hash_table_hopscotch_stats(hash_table, stats);
+}
+
+static void hopscotch_replay_destroy(void *hash_table) {
+	hash_table_hopscotch_destroy(hash_table);
+}
+
+static const struct hash_table_ops replay_only_ops[] = {
+	{ "cache", true, cache_replay_create, cache_replay_add_entry,
+	  cache_replay_contains, cache_replay_stats, cache_replay_destroy,
+	  NULL, NULL, NULL, NULL },
+	{ "shm", true, shm_replay_create, shm_replay_add_entry,
+	  shm_replay_contains, shm_replay_stats, shm_replay_destroy,
+	  NULL, NULL, NULL, NULL },
+	{ "hopscotch", true, hopscotch_replay_create, hopscotch_replay_add_entry,
+	  hopscotch_replay_contains, hopscotch_replay_stats,
+	  hopscotch_replay_destroy, NULL, NULL, NULL, NULL },
+};
+
+static const struct hash_table_ops *find_replay_ops(const char *name) {
+	for (size_t i = 0; i < sizeof(replay_only_ops) / sizeof(replay_only_ops[0]); ++i) {
+		if (strcmp(replay_only_ops[i].name, name) == 0) {
+			return &replay_only_ops[i];
+		}
+	}
+	return find_ops(name);
+}
+
+/* Returns whether a lookup missed. */
+static bool replay_record(const struct pht_trace_record *record) {
+	const char *key = pht_trace_key(record);
+	switch (record->op) {
+	case PHT_TRACE_ADD_ENTRY:
+		add_entry(hash_table, key, record->value);
+		return false;
+	case PHT_TRACE_BARRIER:
+		/* Replaying in order already waits for the phase before it. */
+		return false;
+	default:
+		return !replay_ops->contains(hash_table, key);
+	}
+}
+
+/* Replays one recorded thread's operations in their original order, walking
+   the mapped trace and skipping the other threads' records, and waits for
+   the others at every barrier. If the trace ends early the barriers it
+   missed are still waited for, so the other threads don't wait forever. */
+void *run_replay(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	uint64_t missing = 0;
+	uint64_t walked = 0;
+	uint64_t barriers = 0;
+	for (const struct pht_trace_record *record = pht_trace_first(trace);
+	     record != NULL; record = pht_trace_next(trace, record)) {
+		++walked;
+		if (record->thread != thread) {
+			continue;
+		}
+		if (record->op == PHT_TRACE_BARRIER) {
+			if (barriers < trace->barriers) {
+				pthread_barrier_wait(&replay_barrier);
+				++barriers;
+			}
+		}
+		else if (replay_record(record)) {
+			++missing;
+		}
+	}
+	for (; barriers < trace->barriers; ++barriers) {
+		pthread_barrier_wait(&replay_barrier);
+	}
+	__atomic_fetch_add(&replay_missing, missing, __ATOMIC_RELAXED);
+	if (thread == 0) {
+		replay_walked = walked;
+	}
+	return NULL;
+}
+
+/* Replays the whole trace with one thread per recorded thread, or in the
+   order it was written for base. The keys point straight into the mapped
+   trace. */
+static int replay(void) {
+	struct timeval start, end;
+	replay_ops = find_replay_ops(arguments.variant);
+	if (replay_ops == NULL) {
+		printf("unknown variant %s\n", arguments.variant);
+		return EINVAL;
+	}
+	trace = pht_trace_open(arguments.replay);
+	if (trace == NULL) {
+		perror(arguments.replay);
+		return errno;
+	}
+
+	struct hash_table_options table_options = {
+		.alloc = arguments.huge ? HASH_TABLE_ALLOC_HUGE : HASH_TABLE_ALLOC_DEFAULT,
+	};
+	hash_table = replay_ops->create(&table_options);
+	if (hash_table == NULL) {
+		printf("can't create a %s table for %s\n", replay_ops->name,
+		       arguments.replay);
+		pht_trace_close(trace);
+		return ENOMEM;
+	}
+	add_entry = replay_ops->add_entry;
+	pthread_t *threads = calloc(trace->threads, sizeof(pthread_t));
+	if (replay_ops->threaded && trace->threads > 0) {
+		pthread_barrier_init(&replay_barrier, NULL, trace->threads);
+	}
+
+	gettimeofday(&start, NULL);
+	if (!replay_ops->threaded) {
+		for (const struct pht_trace_record *record = pht_trace_first(trace);
+		     record != NULL; record = pht_trace_next(trace, record)) {
+			++replay_walked;
+			if (replay_record(record)) {
+				++replay_missing;
+			}
+		}
+	}
+	for (uintptr_t i = 0; replay_ops->threaded && i < trace->threads; ++i) {
+		int err = pthread_create(&threads[i], NULL, run_replay, (void*) i);
+		if (err != 0) {
+			printf("pthread_create returned %d\n", err);
+			return err;
+		}
+	}
+	for (uintptr_t i = 0; replay_ops->threaded && i < trace->threads; ++i) {
+		int err = pthread_join(threads[i], NULL);
+		if (err != 0) {
+			printf("pthread_join returned %d\n", err);
+			return err;
+		}
+	}
+	gettimeofday(&end, NULL);
+	printf("Replay %s: %'lu usec\n", replay_ops->name, usec_diff(&start, &end));
+	printf("  - %'lu operations from %u threads, %'lu lookups missed, "
+	       "%'lu insertions failed\n",
+	       replay_walked, trace->threads, replay_missing, replay_failed);
+	if (replay_walked < trace->records) {
+		printf("  - the trace ends after %'lu of its %'lu records\n",
+		       replay_walked, trace->records);
+	}
+
+	struct hash_table_stats stats;
+	replay_ops->stats(hash_table, &stats);
+	print_stats(&stats);
+	replay_ops->destroy(hash_table);
+	if (replay_ops->threaded && trace->threads > 0) {
+		pthread_barrier_destroy(&replay_barrier);
+	}
+	free(threads);
+	int err = replay_walked < trace->records ? EINVAL : 0;
+	pht_trace_close(trace);
+	return err;
+}
+
+static struct hash_table_hopscotch *hash_table_hopscotch;
+static size_t hopscotch_failed;
+static size_t hopscotch_missing;
+
+void *run_hopscotch_add_entry(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	size_t failed = 0;
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		size_t global_index = get_global_index(thread, j);
+		char *string = get_string(global_index);
+		if (!hash_table_hopscotch_add_entry(hash_table_hopscotch, string, global_index)) {
+			++failed;
+		}
+	}
+	__atomic_fetch_add(&hopscotch_failed, failed, __ATOMIC_RELAXED);
+	return NULL;
+}
 
-void *run_v1(void *arg) {
+/* The read-mostly part: every thread looks up all of its keys. */
+void *run_hopscotch_contains(void *arg) {
 	uint32_t thread = (uintptr_t) arg;
+	size_t missing = 0;
 	for (uint32_t j = 0; j < arguments.size; ++j) {
 		size_t global_index = get_global_index(thread, j);
 		char *string = get_string(global_index);
-		hash_table_v1_add_entry(hash_table_v1, string, global_index);
+		if (!hash_table_hopscotch_contains(hash_table_hopscotch, string)) {
+			++missing;
+		}
 	}
+	__atomic_fetch_add(&hopscotch_missing, missing, __ATOMIC_RELAXED);
 	return NULL;
 }
 
-static struct hash_table_v2 *hash_table_v2;
+/* Sizes the table so it ends up at each load factor once every key is in. */
+static int run_hopscotch(pthread_t *threads) {
+	static const double load_factors[] = { 0.5, 0.6, 0.7, 0.8, 0.9, 0.95 };
+	struct timeval start, end;
+	size_t entries = (size_t) arguments.threads * arguments.size;
+	for (size_t i = 0; i < sizeof(load_factors) / sizeof(load_factors[0]); ++i) {
+		size_t capacity = ceil(entries / load_factors[i]);
+		hash_table_hopscotch = hash_table_hopscotch_create(capacity);
+		hopscotch_failed = 0;
+		hopscotch_missing = 0;
+
+		gettimeofday(&start, NULL);
+		int err = run_threads(threads, run_hopscotch_add_entry);
+		if (err != 0) {
+			return err;
+		}
+		gettimeofday(&end, NULL);
+		printf("Hash table hopscotch %.2f: %'lu usec\n", load_factors[i],
+		       usec_diff(&start, &end));
+
+		gettimeofday(&start, NULL);
+		err = run_threads(threads, run_hopscotch_contains);
+		if (err != 0) {
+			return err;
+		}
+		gettimeofday(&end, NULL);
+		printf("  - %'lu failed, %'lu missing, lookups %'lu usec\n",
+		       hopscotch_failed, hopscotch_missing, usec_diff(&start, &end));
+
+		struct hash_table_stats stats;
+		hash_table_hopscotch_stats(hash_table_hopscotch, &stats);
+		print_stats(&stats);
+		hash_table_hopscotch_destroy(hash_table_hopscotch);
+	}
+	return 0;
+}
+
+/* Insert latencies in nanoseconds, bucket i counts those in [2^i, 2^(i+1)).
+   Every thread has its own histogram so timing doesn't add contention. */
+#define LATENCY_BUCKETS 64
+
+static uint64_t (*latency_histograms)[LATENCY_BUCKETS];
+static uint64_t *latency_max;
+
+static uint64_t nsec_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
-void *run_v2(void *arg) {
+void *run_latency_add_entry(void *arg) {
 	uint32_t thread = (uintptr_t) arg;
+	uint64_t *histogram = latency_histograms[thread];
 	for (uint32_t j = 0; j < arguments.size; ++j) {
 		size_t global_index = get_global_index(thread, j);
 		char *string = get_string(global_index);
-		hash_table_v2_add_entry(hash_table_v2, string, global_index);
+		uint64_t start = nsec_now();
+		hash_table_v2_add_entry(hash_table, string, global_index);
+		uint64_t latency = nsec_now() - start;
+		++histogram[latency == 0 ? 0 : 63 - __builtin_clzll(latency)];
+		if (latency > latency_max[thread]) {
+			latency_max[thread] = latency;
+		}
+	}
+	return NULL;
+}
+
+/* The upper bound of the bucket the percentile falls in. */
+static uint64_t latency_percentile(const uint64_t *histogram, uint64_t total,
+                                   double percentile) {
+	uint64_t rank = ceil(total * percentile);
+	uint64_t seen = 0;
+	for (size_t i = 0; i < LATENCY_BUCKETS; ++i) {
+		seen += histogram[i];
+		if (seen >= rank) {
+			return (UINT64_C(2) << i) - 1;
+		}
+	}
+	return 0;
+}
+
+/* Starts the resizing table at `HASH_TABLE_CAPACITY` buckets with a load
+   factor of 1, so it doubles several times while the threads insert. */
+static int run_latency(pthread_t *threads) {
+	struct hash_table_options fixed = { 0 };
+	struct hash_table_options resizing = {
+		.initial_capacity = HASH_TABLE_CAPACITY,
+		.resize_load_factor = 1.0,
+	};
+	const struct hash_table_options *table_options[] = { &fixed, &resizing };
+	const char *names[] = { "fixed", "resizing" };
+	latency_histograms = calloc(arguments.threads, sizeof(*latency_histograms));
+	latency_max = calloc(arguments.threads, sizeof(uint64_t));
+	for (size_t i = 0; i < 2; ++i) {
+		memset(latency_histograms, 0, arguments.threads * sizeof(*latency_histograms));
+		memset(latency_max, 0, arguments.threads * sizeof(uint64_t));
+		hash_table = hash_table_v2_create_with(table_options[i]);
+
+		struct timeval start, end;
+		gettimeofday(&start, NULL);
+		int err = run_threads(threads, run_latency_add_entry);
+		if (err != 0) {
+			return err;
+		}
+		gettimeofday(&end, NULL);
+
+		uint64_t histogram[LATENCY_BUCKETS] = { 0 };
+		uint64_t max = 0;
+		for (uint32_t t = 0; t < arguments.threads; ++t) {
+			for (size_t b = 0; b < LATENCY_BUCKETS; ++b) {
+				histogram[b] += latency_histograms[t][b];
+			}
+			if (latency_max[t] > max) {
+				max = latency_max[t];
+			}
+		}
+		uint64_t total = (uint64_t) arguments.threads * arguments.size;
+		printf("Hash table v2 %s: %'lu usec\n", names[i], usec_diff(&start, &end));
+		printf("  - insert latency p50 < %'lu ns, p99 < %'lu ns, p99.9 < %'lu ns, max %'lu ns\n",
+		       latency_percentile(histogram, total, 0.5),
+		       latency_percentile(histogram, total, 0.99),
+		       latency_percentile(histogram, total, 0.999), max);
+		for (size_t b = 0; b < LATENCY_BUCKETS; ++b) {
+			if (histogram[b] != 0) {
+				printf("  - [%'lu, %'lu) ns: %'lu\n", UINT64_C(1) << b,
+				       UINT64_C(2) << b, histogram[b]);
+			}
+		}
+
+		size_t missing = 0;
+		for (uint32_t t = 0; t < arguments.threads; ++t) {
+			for (uint32_t j = 0; j < arguments.size; ++j) {
+				if (!hash_table_v2_contains(hash_table, get_string(get_global_index(t, j)))) {
+					++missing;
+				}
+			}
+		}
+		printf("  - %'lu missing\n", missing);
+		struct hash_table_stats stats;
+		hash_table_v2_stats(hash_table, &stats);
+		print_stats(&stats);
+		hash_table_v2_destroy(hash_table);
+	}
+	free(latency_histograms);
+	free(latency_max);
+	return 0;
+}
+
+/* The first half of every thread's keys go in before iterating, the second
+   half while iterating. */
+void *run_prefill(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	for (uint32_t j = 0; j < arguments.size / 2; ++j) {
+		size_t global_index = get_global_index(thread, j);
+		add_entry(hash_table, get_string(global_index), global_index);
+	}
+	return NULL;
+}
+
+void *run_writer(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	for (uint32_t j = arguments.size / 2; j < arguments.size; ++j) {
+		size_t global_index = get_global_index(thread, j);
+		add_entry(hash_table, get_string(global_index), global_index);
+	}
+	return NULL;
+}
+
+static void count_entry(const char *key, uint32_t value, void *arg) {
+	(void) key;
+	(void) value;
+	atomic_fetch_add_explicit((atomic_size_t *) arg, 1, memory_order_relaxed);
+}
+
+/* Snapshots the variant picked with `--variant` while writers keep inserting
+   (base has no writers, it can't run with them). The table grows from
+   `HASH_TABLE_CAPACITY` buckets where the variant can, so it stays fast to
+   fill at 10M entries, e.g. `-t 4 -s 2500000`. */
+static int run_iterate(pthread_t *threads) {
+	const struct hash_table_ops *ops = find_ops(arguments.variant);
+	struct hash_table_options table_options = {
+		.initial_capacity = HASH_TABLE_CAPACITY,
+		.resize_load_factor = 1.0,
+	};
+	hash_table = ops->create(&table_options);
+	add_entry = ops->add_entry;
+	struct timeval start, end;
+	int err = run_workers(ops, threads, run_prefill);
+	if (err != 0) {
+		return err;
+	}
+	size_t before = (size_t) arguments.threads * (arguments.size / 2);
+	size_t total = (size_t) arguments.threads * arguments.size;
+
+	for (uintptr_t i = 0; ops->threaded && i < arguments.threads; ++i) {
+		err = pthread_create(&threads[i], NULL, run_writer, (void*) i);
+		if (err != 0) {
+			printf("pthread_create returned %d\n", err);
+			return err;
+		}
+	}
+
+	gettimeofday(&start, NULL);
+	size_t seen = 0;
+	void *iterator = ops->iterator_create(hash_table);
+	const char *key;
+	uint32_t value;
+	while (ops->iterator_next(iterator, &key, &value)) {
+		++seen;
+	}
+	ops->iterator_destroy(iterator);
+	gettimeofday(&end, NULL);
+	printf("Hash table %s iterator: %'lu usec\n", ops->name, usec_diff(&start, &end));
+	printf("  - %'lu entries seen, %'lu keys before writers, %'lu after\n",
+	       seen, before, ops->threaded ? total : before);
+
+	gettimeofday(&start, NULL);
+	atomic_size_t foreach_seen = 0;
+	ops->foreach(hash_table, arguments.threads, count_entry, &foreach_seen);
+	gettimeofday(&end, NULL);
+	printf("Hash table %s foreach (%u threads): %'lu usec\n", ops->name,
+	       arguments.threads, usec_diff(&start, &end));
+	printf("  - %'lu entries seen\n", atomic_load(&foreach_seen));
+
+	for (uintptr_t i = 0; ops->threaded && i < arguments.threads; ++i) {
+		err = pthread_join(threads[i], NULL);
+		if (err != 0) {
+			printf("pthread_join returned %d\n", err);
+			return err;
+		}
+	}
+	/* Once the writers are done a snapshot has to see every entry. That's a
+	   few less than the keys at 10M, some random keys come up twice. */
+	foreach_seen = 0;
+	ops->foreach(hash_table, arguments.threads, count_entry, &foreach_seen);
+	printf("  - %'lu entries seen after the writers finished\n",
+	       atomic_load(&foreach_seen));
+	struct hash_table_stats stats;
+	ops->stats(hash_table, &stats);
+	print_stats(&stats);
+	ops->destroy(hash_table);
+	return 0;
+}
+
+static const struct hash_table_ops *bench_ops;
+static size_t bench_missing;
+
+void *run_contains(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	size_t missing = 0;
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		if (!bench_ops->contains(hash_table, get_string(get_global_index(thread, j)))) {
+			++missing;
+		}
+	}
+	__atomic_fetch_add(&bench_missing, missing, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+/* Times inserting every key into the base table, the reference `bench.py`
+   measures every workload against. Run in the same process right before the
+   workload, it slows down with the machine just like the workload does. */
+static int time_reference(pthread_t *threads, unsigned long *usec) {
+	struct hash_table_options table_options = { 0 };
+	hash_table = base_ops.create(&table_options);
+	add_entry = base_ops.add_entry;
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	int err = run_workers(&base_ops, threads, run_add_entry);
+	gettimeofday(&end, NULL);
+	base_ops.destroy(hash_table);
+	*usec = usec_diff(&start, &end);
+	return err;
+}
+
+/* One workload of the variant picked with `--variant`, for `bench.py`. The
+   last line of output is a JSON object with the timed number of operations
+   and how long the reference took, everything before it is for people. */
+static int run_bench(pthread_t *threads) {
+	const char *workload = arguments.bench;
+	const struct hash_table_ops *ops = find_ops(arguments.variant);
+	struct hash_table_options table_options = { 0 };
+	if (strcmp(workload, "fixed-keys") == 0) {
+		table_options.key_width = BYTES_PER_STRING;
+	}
+	else if (strcmp(workload, "huge") == 0) {
+		table_options.alloc = HASH_TABLE_ALLOC_HUGE;
+	}
+	else if (strcmp(workload, "insert") != 0 && strcmp(workload, "lookup") != 0
+	         && strcmp(workload, "iterate") != 0) {
+		printf("unknown workload %s\n", workload);
+		return EINVAL;
+	}
+	unsigned long reference_usec;
+	int err = time_reference(threads, &reference_usec);
+	if (err != 0) {
+		return err;
+	}
+	printf("Hash table base insert (reference): %'lu usec\n", reference_usec);
+
+	hash_table = ops->create(&table_options);
+	add_entry = ops->add_entry;
+	bench_ops = ops;
+	bench_missing = 0;
+	size_t operations = (size_t) arguments.threads * arguments.size;
+
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	err = run_workers(ops, threads, run_add_entry);
+	if (err != 0) {
+		return err;
+	}
+	gettimeofday(&end, NULL);
+	printf("Hash table %s insert: %'lu usec\n", ops->name, usec_diff(&start, &end));
+
+	if (strcmp(workload, "lookup") == 0) {
+		gettimeofday(&start, NULL);
+		err = run_workers(ops, threads, run_contains);
+		if (err != 0) {
+			return err;
+		}
+		gettimeofday(&end, NULL);
+		printf("Hash table %s lookup: %'lu usec\n", ops->name, usec_diff(&start, &end));
+		printf("  - %'lu missing\n", bench_missing);
+	}
+	else if (strcmp(workload, "iterate") == 0) {
+		atomic_size_t seen = 0;
+		gettimeofday(&start, NULL);
+		ops->foreach(hash_table, arguments.threads, count_entry, &seen);
+		gettimeofday(&end, NULL);
+		operations = atomic_load(&seen);
+		printf("Hash table %s foreach: %'lu usec\n", ops->name, usec_diff(&start, &end));
+	}
+	ops->destroy(hash_table);
+
+	printf("{\"variant\": \"%s\", \"workload\": \"%s\", \"threads\": %u, "
+	       "\"size\": %u, \"operations\": %zu, \"usec\": %lu, "
+	       "\"reference_operations\": %zu, \"reference_usec\": %lu}\n",
+	       ops->name, workload, arguments.threads, arguments.size, operations,
+	       usec_diff(&start, &end), (size_t) arguments.threads * arguments.size,
+	       reference_usec);
+	return bench_missing == 0 ? 0 : 1;
+}
+
+static struct hash_table_cache *hash_table_cache;
+static uint32_t *zipf_trace;
+
+/* Generates `arguments.size` accesses per thread over all the keys, where the
+   key with rank k is accessed with probability proportional to 1 / k^theta.
+   The keys are random, so the rank is just the global index. Each thread gets
+   its own seed so the trace doesn't depend on scheduling. */
+static void generate_zipf_trace(void)
+{
+	size_t keys = (size_t) arguments.threads * arguments.size;
+	double *cdf = calloc(keys, sizeof(double));
+	double sum = 0;
+	for (size_t i = 0; i < keys; ++i) {
+		sum += 1.0 / pow((double) (i + 1), arguments.zipf_theta);
+		cdf[i] = sum;
+	}
+
+	zipf_trace = calloc(keys, sizeof(uint32_t));
+	for (uint32_t i = 0; i < arguments.threads; ++i) {
+		unsigned int seed = i + 1;
+		for (uint32_t j = 0; j < arguments.size; ++j) {
+			double r = ((double) rand_r(&seed) / ((double) RAND_MAX + 1)) * sum;
+			size_t low = 0;
+			size_t high = keys - 1;
+			while (low < high) {
+				size_t middle = low + (high - low) / 2;
+				if (cdf[middle] <= r) {
+					low = middle + 1;
+				}
+				else {
+					high = middle;
+				}
+			}
+			zipf_trace[get_global_index(i, j)] = low;
+		}
+	}
+	free(cdf);
+}
+
+/* Replays this thread's part of the trace, a miss loads the key into the
+   cache like a read-through cache would. */
+void *run_cache(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		uint32_t key_index = zipf_trace[get_global_index(thread, j)];
+		char *string = get_string(key_index);
+		if (!hash_table_cache_get(hash_table_cache, string, NULL)) {
+			hash_table_cache_put(hash_table_cache, string, key_index);
+		}
 	}
 	return NULL;
 }
 
+/* Runs in a forked worker: attach to the table by name and insert this
+   worker's keys, looking every key up right after inserting it while the
+   other workers insert theirs. */
+static int run_shm(const char *name, uint32_t thread) {
+	struct hash_table_shm *hash_table_shm = hash_table_shm_attach(name);
+	if (hash_table_shm == NULL) {
+		return 1;
+	}
+	int missing = 0;
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		size_t global_index = get_global_index(thread, j);
+		char *string = get_string(global_index);
+		if (!hash_table_shm_add_entry(hash_table_shm, string, global_index)
+		    || hash_table_shm_get_value(hash_table_shm, string) != global_index) {
+			missing = 1;
+		}
+	}
+	hash_table_shm_detach(hash_table_shm);
+	return missing;
+}
+
 int main(int argc, char *argv[]) {
 	arguments.threads = 4;
 	arguments.size = 25000;
+	arguments.cache_capacity = 0;
+	arguments.zipf_theta = 0.99;
+	arguments.variant = "v2";
   
 	// static struct argp argp = { options, parse_opt };
 	static struct argp argp = { 0 };
@@ -134,6 +1198,14 @@ int main(int argc, char *argv[]) {
 
 	setlocale(LC_ALL, "en_US.UTF-8");
 
+	if (arguments.replay != NULL) {
+		return replay();
+	}
+	if (find_ops(arguments.variant) == NULL) {
+		printf("unknown variant %s\n", arguments.variant);
+		return EINVAL;
+	}
+
 	data = calloc(arguments.threads * arguments.size, BYTES_PER_STRING);
 
 	struct timeval start, end;
@@ -159,96 +1231,181 @@ int main(int argc, char *argv[]) {
 	gettimeofday(&end, NULL);
 	printf("Generation: %'lu usec\n", usec_diff(&start, &end));
 
-	struct hash_table_base *hash_table_base = hash_table_base_create();
-	gettimeofday(&start, NULL);
-	for (uint32_t i = 0; i < arguments.threads; ++i) {
-		for (uint32_t j = 0; j < arguments.size; ++j) {
-			size_t global_index = get_global_index(i, j);
-			char *string = get_string(global_index);
-			hash_table_base_add_entry(hash_table_base, string, global_index);
-		}
+	pthread_t *threads = calloc(arguments.threads, sizeof(pthread_t));
+
+	if (arguments.iterate || arguments.bench != NULL) {
+		int err = arguments.iterate ? run_iterate(threads) : run_bench(threads);
+		free(threads);
+		free(data);
+		return err;
 	}
-	gettimeofday(&end, NULL);
-	printf("Hash table base: %'lu usec\n", usec_diff(&start, &end));
 
-	size_t missing = 0;
-	for (uint32_t i = 0; i < arguments.threads; ++i) {
-		for (uint32_t j = 0; j < arguments.size; ++j) {
-			size_t global_index = get_global_index(i, j);
-			char *string = get_string(global_index);
-			if (!hash_table_base_contains(hash_table_base, string)) {
-				++missing;
+	const struct hash_table_ops *tables[] = { &base_ops, &v1_ops, &v2_ops };
+	for (size_t i = 0; i < sizeof(tables) / sizeof(tables[0]); ++i) {
+		struct hash_table_options table_options = { 0 };
+		int err = run_phase(tables[i], &table_options, threads);
+		if (err != 0) {
+			return err;
+		}
+		if (arguments.huge) {
+			table_options.alloc = HASH_TABLE_ALLOC_HUGE;
+			err = run_phase(tables[i], &table_options, threads);
+			if (err != 0) {
+				return err;
+			}
+		}
+		/* Our keys are 7 characters and a NUL, exactly one word. */
+		if (arguments.fixed_keys) {
+			table_options.alloc = HASH_TABLE_ALLOC_DEFAULT;
+			table_options.key_width = BYTES_PER_STRING;
+			err = run_phase(tables[i], &table_options, threads);
+			if (err != 0) {
+				return err;
 			}
 		}
 	}
-	printf("  - %'lu missing\n", missing);
-	hash_table_base_destroy(hash_table_base);
 
-	pthread_t *threads = calloc(arguments.threads, sizeof(pthread_t));
-
-	hash_table_v1 = hash_table_v1_create();
-	gettimeofday(&start, NULL);
-	for (uintptr_t i = 0; i < arguments.threads; ++i) {
-		int err = pthread_create(&threads[i], NULL, run_v1, (void*) i);
+	if (arguments.generic) {
+		generic_string = generic_string_create();
+		gettimeofday(&start, NULL);
+		int err = run_threads(threads, run_generic_string);
 		if (err != 0) {
-			printf("pthread_create returned %d\n", err);
 			return err;
 		}
-	}
-	for (uintptr_t i = 0; i < arguments.threads; ++i) {
-		int err = pthread_join(threads[i], NULL);
+		gettimeofday(&end, NULL);
+		printf("Hash table generic string: %'lu usec\n", usec_diff(&start, &end));
+
+		size_t missing = 0;
+		for (uint32_t i = 0; i < arguments.threads; ++i) {
+			for (uint32_t j = 0; j < arguments.size; ++j) {
+				size_t global_index = get_global_index(i, j);
+				char *string = get_string(global_index);
+				if (!generic_string_contains(generic_string, string)) {
+					++missing;
+				}
+			}
+		}
+		printf("  - %'lu missing\n", missing);
+		struct hash_table_stats stats;
+		generic_string_stats(generic_string, &stats);
+		print_stats(&stats);
+		generic_string_destroy(generic_string);
+
+		generic_uint64 = generic_uint64_create();
+		gettimeofday(&start, NULL);
+		err = run_threads(threads, run_generic_uint64);
 		if (err != 0) {
-			printf("pthread_join returned %d\n", err);
 			return err;
 		}
-	}
-	gettimeofday(&end, NULL);
-	printf("Hash table v1: %'lu usec\n", usec_diff(&start, &end));
+		gettimeofday(&end, NULL);
+		printf("Hash table generic uint64: %'lu usec\n", usec_diff(&start, &end));
 
-	missing = 0;
-	for (uint32_t i = 0; i < arguments.threads; ++i) {
-		for (uint32_t j = 0; j < arguments.size; ++j) {
-			size_t global_index = get_global_index(i, j);
-			char *string = get_string(global_index);
-			if (!hash_table_v1_contains(hash_table_v1, string)) {
-				++missing;
+		missing = 0;
+		for (uint32_t i = 0; i < arguments.threads; ++i) {
+			for (uint32_t j = 0; j < arguments.size; ++j) {
+				uint64_t key = get_uint64(get_global_index(i, j));
+				if (!generic_uint64_contains(generic_uint64, key)) {
+					++missing;
+				}
 			}
 		}
+		printf("  - %'lu missing\n", missing);
+		generic_uint64_stats(generic_uint64, &stats);
+		print_stats(&stats);
+		generic_uint64_destroy(generic_uint64);
 	}
-	printf("  - %'lu missing\n", missing);
-	hash_table_v1_destroy(hash_table_v1);
 
-	hash_table_v2 = hash_table_v2_create();
-	gettimeofday(&start, NULL);
-	for (uintptr_t i = 0; i < arguments.threads; ++i) {
-		int err = pthread_create(&threads[i], NULL, run_v2, (void*) i);
+	if (arguments.hopscotch) {
+		int err = run_hopscotch(threads);
 		if (err != 0) {
-			printf("pthread_create returned %d\n", err);
 			return err;
 		}
 	}
-	for (uintptr_t i = 0; i < arguments.threads; ++i) {
-		int err = pthread_join(threads[i], NULL);
+
+	if (arguments.latency) {
+		int err = run_latency(threads);
 		if (err != 0) {
-			printf("pthread_join returned %d\n", err);
 			return err;
 		}
 	}
-	gettimeofday(&end, NULL);
-	printf("Hash table v2: %'lu usec\n", usec_diff(&start, &end));
 
-	missing = 0;
-	for (uint32_t i = 0; i < arguments.threads; ++i) {
-		for (uint32_t j = 0; j < arguments.size; ++j) {
-			size_t global_index = get_global_index(i, j);
-			char *string = get_string(global_index);
-			if (!hash_table_v2_contains(hash_table_v2, string)) {
-				++missing;
+	if (arguments.cache_capacity > 0) {
+		generate_zipf_trace();
+		hash_table_cache = hash_table_cache_create(arguments.cache_capacity, NULL);
+		gettimeofday(&start, NULL);
+		int err = run_threads(threads, run_cache);
+		if (err != 0) {
+			return err;
+		}
+		gettimeofday(&end, NULL);
+		printf("Hash table cache: %'lu usec\n", usec_diff(&start, &end));
+
+		struct hash_table_cache_counters counters;
+		hash_table_cache_get_counters(hash_table_cache, &counters);
+		uint64_t lookups = counters.hits + counters.misses;
+		printf("  - %.2f%% hit rate (zipf %.2f), %'lu evictions, %'lu entries\n",
+		       lookups == 0 ? 0.0 : 100.0 * counters.hits / lookups,
+		       arguments.zipf_theta, counters.evictions, counters.entries);
+		struct hash_table_stats stats;
+		hash_table_cache_stats(hash_table_cache, &stats);
+		print_stats(&stats);
+		hash_table_cache_destroy(hash_table_cache);
+		free(zipf_trace);
+	}
+
+	if (arguments.shm) {
+		char name[64];
+		snprintf(name, sizeof(name), "/pht-tester-%d", getpid());
+		size_t entries = (size_t) arguments.threads * arguments.size;
+		struct hash_table_shm *hash_table_shm
+			= hash_table_shm_create(name, entries, entries * BYTES_PER_STRING);
+		if (hash_table_shm == NULL) {
+			perror("hash_table_shm_create");
+			return 1;
+		}
+
+		/* Don't let the children flush our buffered output again. */
+		fflush(stdout);
+		pid_t *pids = calloc(arguments.threads, sizeof(pid_t));
+		gettimeofday(&start, NULL);
+		for (uint32_t i = 0; i < arguments.threads; ++i) {
+			pids[i] = fork();
+			if (pids[i] == -1) {
+				perror("fork");
+				return 1;
+			}
+			if (pids[i] == 0) {
+				_exit(run_shm(name, i));
 			}
 		}
+		int failed = 0;
+		for (uint32_t i = 0; i < arguments.threads; ++i) {
+			int wstatus;
+			if (waitpid(pids[i], &wstatus, 0) == -1
+			    || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+				++failed;
+			}
+		}
+		gettimeofday(&end, NULL);
+		printf("Hash table shm: %'lu usec\n", usec_diff(&start, &end));
+
+		size_t missing = 0;
+		for (uint32_t i = 0; i < arguments.threads; ++i) {
+			for (uint32_t j = 0; j < arguments.size; ++j) {
+				size_t global_index = get_global_index(i, j);
+				char *string = get_string(global_index);
+				if (!hash_table_shm_contains(hash_table_shm, string)) {
+					++missing;
+				}
+			}
+		}
+		printf("  - %'lu missing, %d failed workers\n", missing, failed);
+		struct hash_table_stats stats;
+		hash_table_shm_stats(hash_table_shm, &stats);
+		print_stats(&stats);
+		hash_table_shm_destroy(hash_table_shm);
+		free(pids);
 	}
-	printf("  - %'lu missing\n", missing);
-	hash_table_v2_destroy(hash_table_v2);
 
 	free(threads);
 	free(data);
@@ -0,0 +1,191 @@
+#include "pht-trace.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t record_size(size_t key_size)
+{
+	size_t size = sizeof(struct pht_trace_record) + key_size;
+	return (size + PHT_TRACE_ALIGN - 1) & ~((size_t) PHT_TRACE_ALIGN - 1);
+}
+
+struct pht_trace_writer *pht_trace_writer_open(const char *path)
+{
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) {
+		return NULL;
+	}
+	struct pht_trace_writer *writer = calloc(1, sizeof(struct pht_trace_writer));
+	assert(writer != NULL);
+	writer->file = file;
+	pthread_mutex_init(&writer->mutex, NULL);
+	memcpy(writer->header.magic, PHT_TRACE_MAGIC, sizeof(writer->header.magic));
+	writer->header.version = PHT_TRACE_VERSION;
+
+	/* Reserve the header, it's rewritten once we know the counts. */
+	fwrite(&writer->header, sizeof(writer->header), 1, file);
+	return writer;
+}
+
+/* Appends one record, with the writer locked. */
+static void write_record(struct pht_trace_writer *writer,
+                         enum pht_trace_op op,
+                         uint32_t thread,
+                         const char *key,
+                         uint32_t value)
+{
+	size_t key_size = strlen(key) + 1;
+	assert(key_size <= UINT8_MAX);
+	assert(thread <= UINT16_MAX);
+
+	char buffer[sizeof(struct pht_trace_record) + UINT8_MAX + PHT_TRACE_ALIGN];
+	size_t size = record_size(key_size);
+	memset(buffer, 0, size);
+	struct pht_trace_record record = {
+		.op = op,
+		.key_size = key_size,
+		.thread = thread,
+		.value = value,
+	};
+	memcpy(buffer, &record, sizeof(record));
+	memcpy(buffer + sizeof(record), key, key_size);
+
+	fwrite(buffer, size, 1, writer->file);
+	writer->header.records += 1;
+	if (thread + 1 > writer->header.threads) {
+		writer->header.threads = thread + 1;
+	}
+}
+
+void pht_trace_write(struct pht_trace_writer *writer,
+                     enum pht_trace_op op,
+                     uint32_t thread,
+                     const char *key,
+                     uint32_t value)
+{
+	pthread_mutex_lock(&writer->mutex);
+	write_record(writer, op, thread, key, value);
+	pthread_mutex_unlock(&writer->mutex);
+}
+
+void pht_trace_write_barrier(struct pht_trace_writer *writer)
+{
+	pthread_mutex_lock(&writer->mutex);
+	uint32_t threads = writer->header.threads;
+	for (uint32_t t = 0; t < threads; ++t) {
+		write_record(writer, PHT_TRACE_BARRIER, t, "", 0);
+	}
+	writer->header.barriers += 1;
+	pthread_mutex_unlock(&writer->mutex);
+}
+
+int pht_trace_writer_close(struct pht_trace_writer *writer)
+{
+	int err = 0;
+	if (fseek(writer->file, 0, SEEK_SET) != 0
+	    || fwrite(&writer->header, sizeof(writer->header), 1, writer->file) != 1) {
+		err = errno;
+	}
+	if (fclose(writer->file) != 0 && err == 0) {
+		err = errno;
+	}
+	pthread_mutex_destroy(&writer->mutex);
+	free(writer);
+	return err;
+}
+
+const char *pht_trace_key(const struct pht_trace_record *record)
+{
+	return (const char *) (record + 1);
+}
+
+/* The record at `offset`, or `NULL` if it can't be replayed, so the replay
+   can trust its key without reading ahead. */
+static const struct pht_trace_record *check_record(const struct pht_trace *trace,
+                                                   size_t offset)
+{
+	if (offset + sizeof(struct pht_trace_record) > trace->size) {
+		return NULL;
+	}
+	const struct pht_trace_record *record = (const void *) (trace->data + offset);
+	if (record->op < PHT_TRACE_ADD_ENTRY || record->op > PHT_TRACE_BARRIER
+	    || record->key_size == 0 || record->thread >= trace->threads
+	    || offset + record_size(record->key_size) > trace->size
+	    || pht_trace_key(record)[record->key_size - 1] != 0) {
+		return NULL;
+	}
+	return record;
+}
+
+const struct pht_trace_record *pht_trace_first(const struct pht_trace *trace)
+{
+	if (trace->records == 0) {
+		return NULL;
+	}
+	return check_record(trace, sizeof(struct pht_trace_header));
+}
+
+const struct pht_trace_record *pht_trace_next(const struct pht_trace *trace,
+                                              const struct pht_trace_record *record)
+{
+	size_t offset = (const char *) record - trace->data + record_size(record->key_size);
+	return check_record(trace, offset);
+}
+
+struct pht_trace *pht_trace_open(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		int err = errno;
+		close(fd);
+		errno = err;
+		return NULL;
+	}
+	if ((size_t) st.st_size < sizeof(struct pht_trace_header)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	int err = errno;
+	close(fd);
+	if (data == MAP_FAILED) {
+		errno = err;
+		return NULL;
+	}
+	/* The replay reads the records front to back. */
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+	struct pht_trace *trace = calloc(1, sizeof(struct pht_trace));
+	assert(trace != NULL);
+	trace->data = data;
+	trace->size = st.st_size;
+
+	const struct pht_trace_header *header = data;
+	if (memcmp(header->magic, PHT_TRACE_MAGIC, sizeof(header->magic)) != 0
+	    || header->version != PHT_TRACE_VERSION) {
+		pht_trace_close(trace);
+		errno = EINVAL;
+		return NULL;
+	}
+	trace->threads = header->threads;
+	trace->records = header->records;
+	trace->barriers = header->barriers;
+	return trace;
+}
+
+void pht_trace_close(struct pht_trace *trace)
+{
+	munmap((void *) trace->data, trace->size);
+	free(trace);
+}
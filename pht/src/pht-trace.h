@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+/* A binary trace of hash table operations. The file starts with a header,
+   followed by variable-length records: a fixed 8 byte part, then the key
+   including its NUL terminator, padded so the next record is 8 byte aligned.
+   Keeping the terminator means a replay can hand the tables pointers straight
+   into the mapped file. */
+#define PHT_TRACE_MAGIC "PHTTRACE"
+#define PHT_TRACE_VERSION 3
+
+enum pht_trace_op {
+	PHT_TRACE_ADD_ENTRY = 1,
+	PHT_TRACE_CONTAINS = 2,
+	/* Every thread has one at the same point, with an empty key, and the
+	   header counts them. A replay doesn't go on past it until all threads
+	   got there. */
+	PHT_TRACE_BARRIER = 3,
+};
+
+struct pht_trace_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t threads;
+	uint64_t records;
+	/* Barrier records per thread. */
+	uint64_t barriers;
+};
+
+struct pht_trace_record {
+	uint8_t op;
+	/* Bytes of key that follow, including the NUL terminator. */
+	uint8_t key_size;
+	uint16_t thread;
+	uint32_t value;
+};
+
+/* Record sizes are rounded up to this. */
+#define PHT_TRACE_ALIGN 8
+
+/* Writes records as they come in. Any number of threads can write to the
+   same writer, records from one thread stay in the order they were written. */
+struct pht_trace_writer {
+	FILE *file;
+	pthread_mutex_t mutex;
+	struct pht_trace_header header;
+};
+
+/* Returns `NULL` and sets `errno` if the file can't be created. */
+struct pht_trace_writer *pht_trace_writer_open(const char *path);
+/* Keys can be at most 254 bytes long, threads up to 65535. */
+void pht_trace_write(struct pht_trace_writer *writer,
+                     enum pht_trace_op op,
+                     uint32_t thread,
+                     const char *key,
+                     uint32_t value);
+/* Ends a phase: writes a barrier for every thread that wrote so far. Only
+   call it while no other thread writes. */
+void pht_trace_write_barrier(struct pht_trace_writer *writer);
+/* Fills in the header and closes the file, returns 0 or an `errno` value. */
+int pht_trace_writer_close(struct pht_trace_writer *writer);
+
+/* A trace mapped read-only. Nothing is read ahead of time, the records are
+   walked straight from the mapping. */
+struct pht_trace {
+	const char *data;
+	size_t size;
+	uint32_t threads;
+	uint64_t records;
+	uint64_t barriers;
+};
+
+/* Returns `NULL` and sets `errno` if the file can't be mapped, or to `EINVAL`
+   if it isn't a trace. */
+struct pht_trace *pht_trace_open(const char *path);
+/* The key that follows `record`. */
+const char *pht_trace_key(const struct pht_trace_record *record);
+/* Walk every record in the order they were written, `NULL` at the end. A
+   record that doesn't fit in the file, has a thread or op the trace can't
+   have, or a key without its NUL ends the walk early. */
+const struct pht_trace_record *pht_trace_first(const struct pht_trace *trace);
+const struct pht_trace_record *pht_trace_next(const struct pht_trace *trace,
+                                              const struct pht_trace_record *record);
+void pht_trace_close(struct pht_trace *trace);
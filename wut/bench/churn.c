@@ -0,0 +1,115 @@
+#include "wut.h"
+
+#include <errno.h>    // errno
+#include <stdio.h>    // printf
+#include <stdlib.h>   // exit, strtol
+#include <sys/wait.h> // waitpid
+#include <time.h>     // clock_gettime
+#include <unistd.h>   // fork
+
+/* Creates and joins one short-lived thread after another, like
+   `tests/lots-of-threads.c` but flat, once with the stack pool and once
+   without it. Without the pool every thread costs an mmap, an mprotect for
+   the guard page and an munmap. Then, with the pool, it creates a batch of
+   threads at a time and joins them all, so that every batch reuses the
+   control blocks and stacks the one before it freed. Once the first batch
+   is done, neither should allocate anything. The batches are also created
+   with a single `wut_create_n` each, and both kinds of batches once more
+   without the pool, where `wut_create_n` maps all the stacks of a batch
+   at once. Pass the number of threads as the first argument. */
+
+#define BATCH 1000
+
+static long threads = 200000;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void run(void) {
+}
+
+static void *run_arg(void *arg) {
+    return arg;
+}
+
+static void measure(const char *name, size_t stack_cache) {
+    struct wut_config config = { .stack_cache = stack_cache };
+    wut_init_config(&config);
+    double start = now();
+    for (long i = 0; i < threads; ++i) {
+        int id = wut_create(run);
+        if (wut_join(id) != 0) {
+            exit(1);
+        }
+    }
+    double elapsed = now() - start;
+    printf("%s: %.1f ns per create and join, %.2f M threads/s\n", name,
+           elapsed * 1e9 / threads, threads / elapsed * 1e-6);
+    fflush(stdout);
+    exit(0);
+}
+
+static void measure_batches(const char *name, size_t stack_cache,
+                            int create_n) {
+    struct wut_config config = { .stack_cache = stack_cache };
+    wut_init_config(&config);
+    int ids[BATCH];
+    double start = now();
+    for (long i = 0; i < threads; i += BATCH) {
+        if (create_n) {
+            if (wut_create_n(run_arg, NULL, BATCH, ids) != 0) {
+                exit(1);
+            }
+        }
+        for (int j = 0; !create_n && j < BATCH; ++j) {
+            ids[j] = wut_create(run);
+        }
+        for (int j = 0; j < BATCH; ++j) {
+            if (wut_join(ids[j]) != 0) {
+                exit(1);
+            }
+        }
+    }
+    double elapsed = now() - start;
+    long done = (threads + BATCH - 1) / BATCH * BATCH;
+    printf("%s: %.1f ns per create and join, %.2f M threads/s\n", name,
+           elapsed * 1e9 / done, done / elapsed * 1e-6);
+    fflush(stdout);
+    exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        threads = strtol(argv[1], NULL, 10);
+    }
+    const char *names[] = {
+        "stack pool", "no stack pool", "batches", "wut_create_n batches",
+        "batches, no stack pool", "wut_create_n batches, no stack pool",
+    };
+    size_t caches[] = {
+        0, WUT_NO_STACK_CACHE, BATCH, BATCH,
+        WUT_NO_STACK_CACHE, WUT_NO_STACK_CACHE,
+    };
+    for (int i = 0; i < 6; ++i) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            return errno;
+        }
+        if (pid == 0) {
+            if (i < 2) {
+                measure(names[i], caches[i]);
+            }
+            measure_batches(names[i], caches[i], i % 2);
+        }
+        int wstatus;
+        if (waitpid(pid, &wstatus, 0) == -1 || !WIFEXITED(wstatus)
+            || WEXITSTATUS(wstatus) != 0) {
+            printf("%s: failed\n", names[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
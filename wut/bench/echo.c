@@ -0,0 +1,82 @@
+#include "wut.h"
+
+#include <stdio.h>      // printf
+#include <stdlib.h>     // exit, strtol
+#include <sys/socket.h> // socketpair
+#include <time.h>       // clock_gettime
+
+/* Many connections at once, like a server would have. Every connection is
+   a socket pair with an echo thread on one end and a client thread on the
+   other, which sends a message and waits for it to come back, over and
+   over. Whenever a thread waits, the others run, and once they all wait the
+   scheduler waits for the reactor. Pass the number of connections as the
+   first argument. */
+
+#define ROUND_TRIPS 10000000
+#define MESSAGE_SIZE 64
+
+static long connections = 1000;
+static long round_trips;
+static int (*pairs)[2];
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void echo(void) {
+    int fd = pairs[(wut_id() - 1) / 2][0];
+    char buffer[MESSAGE_SIZE];
+    for (;;) {
+        ssize_t length = wut_read(fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            return;
+        }
+        wut_write(fd, buffer, length);
+    }
+}
+
+static void client(void) {
+    int fd = pairs[(wut_id() - 1) / 2][1];
+    char buffer[MESSAGE_SIZE] = "ping";
+    for (long i = 0; i < round_trips; ++i) {
+        if (wut_write(fd, buffer, sizeof(buffer)) != sizeof(buffer)
+            || wut_read(fd, buffer, sizeof(buffer)) != sizeof(buffer)) {
+            exit(1);
+        }
+    }
+    wut_close(fd);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        connections = strtol(argv[1], NULL, 10);
+    }
+    round_trips = ROUND_TRIPS / 10 / connections;
+    if (round_trips == 0) {
+        round_trips = 1;
+    }
+    wut_init();
+    pairs = calloc(connections, sizeof(pairs[0]));
+    int *ids = calloc(connections * 2, sizeof(int));
+    for (long i = 0; i < connections; ++i) {
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, pairs[i]) == -1) {
+            perror("socketpair failed");
+            return 1;
+        }
+    }
+    double start = now();
+    for (long i = 0; i < connections; ++i) {
+        ids[2 * i] = wut_create(echo);
+        ids[2 * i + 1] = wut_create(client);
+    }
+    for (long i = 0; i < connections * 2; ++i) {
+        wut_join(ids[i]);
+    }
+    double elapsed = now() - start;
+    long total = round_trips * connections;
+    printf("%ld connections: %.2f us per round trip, %.0f round trips/s\n",
+           connections, elapsed * 1e6 / total, total / elapsed);
+    return 0;
+}
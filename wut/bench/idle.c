@@ -0,0 +1,164 @@
+#include "wut.h"
+
+#include <errno.h>    // errno
+#include <stdio.h>    // printf, fopen, fgets, fscanf
+#include <stdlib.h>   // exit, malloc, strtol
+#include <sys/wait.h> // waitpid
+#include <time.h>     // clock_gettime
+#include <unistd.h>   // fork, sysconf
+
+/* Creates a lot of threads that all park on a semaphore, and reports how
+   much memory each takes while they're parked: the growth of the resident
+   set per thread, and the resident part of its stack from
+   `wut_stack_resident`. Then it lets them all finish, joins them and
+   reports the resident set per thread once more, while the stack pool
+   keeps every stack. That's once with the default stacks, once with lazy
+   1 MiB stacks, and twice with lazy stacks whose threads first use
+   BURST bytes of stack before parking, with and without
+   `release_stacks`. Guard pages are off throughout, every one of them
+   splits a mapping and the kernel only allows so many. Pass the number of
+   threads as the first argument. A million idle threads need about 4 GB
+   with the default stacks and 6 GB with lazy ones, counting a page table
+   page per stack, and the ones with a burst take another BURST each. */
+
+#define BATCH 1000
+#define BURST (16 * 1024)
+
+static long threads = 100000;
+static int burst;
+static volatile int stack_sum;
+static struct wut_sem parked;
+static struct wut_sem go;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long resident(void) {
+    long size, pages = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL || fscanf(statm, "%ld %ld", &size, &pages) != 2) {
+        exit(1);
+    }
+    fclose(statm);
+    return pages * sysconf(_SC_PAGESIZE);
+}
+
+// the page tables don't count as resident, and a sparse stack needs its
+// own
+static long page_tables(void) {
+    char line[256];
+    long kb = 0;
+    FILE *status = fopen("/proc/self/status", "r");
+    if (status == NULL) {
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), status) != NULL) {
+        sscanf(line, "VmPTE: %ld kB", &kb);
+    }
+    fclose(status);
+    return kb * 1024;
+}
+
+// touch BURST bytes of the stack, and read them back so it isn't only set
+static void use_stack(void) {
+    volatile char buffer[BURST];
+    for (int i = 0; i < BURST; ++i) {
+        buffer[i] = 1;
+    }
+    int sum = 0;
+    for (int i = 0; i < BURST; ++i) {
+        sum += buffer[i];
+    }
+    stack_sum = sum;
+}
+
+static void *run(void *arg) {
+    if (burst) {
+        use_stack();
+    }
+    wut_sem_post(&parked);
+    wut_sem_wait(&go);
+    return arg;
+}
+
+static void measure(const char *name, int lazy, int release) {
+    struct wut_config config = {
+        .stack_cache = threads,
+        .no_guard_page = 1,
+        .lazy_stacks = lazy,
+        .release_stacks = release,
+    };
+    wut_init_config(&config);
+    wut_sem_init(&parked, 0);
+    wut_sem_init(&go, 0);
+    int *ids = malloc(threads * sizeof(int));
+    if (ids == NULL) {
+        exit(1);
+    }
+    long before = resident();
+    long tables_before = page_tables();
+    double start = now();
+    for (long i = 0; i < threads; i += BATCH) {
+        int n = threads - i < BATCH ? threads - i : BATCH;
+        if (wut_create_n(run, NULL, n, ids + i) != 0) {
+            exit(1);
+        }
+    }
+    for (long i = 0; i < threads; ++i) {
+        wut_sem_wait(&parked);
+    }
+    double elapsed = now() - start;
+    long parked_bytes = resident() - before;
+    long table_bytes = page_tables() - tables_before;
+    long stack_bytes = 0;
+    for (long i = 0; i < threads; ++i) {
+        stack_bytes += wut_stack_resident(ids[i]);
+    }
+    for (long i = 0; i < threads; ++i) {
+        wut_sem_post(&go);
+    }
+    for (long i = 0; i < threads; ++i) {
+        if (wut_join(ids[i]) != 0) {
+            exit(1);
+        }
+    }
+    long joined_bytes = resident() - before;
+    printf("%s: %.0f ns per thread to park, %ld B resident per parked "
+           "thread, %ld B of it stack, %ld B of page tables, "
+           "%ld B resident per thread after joining\n",
+           name, elapsed * 1e9 / threads, parked_bytes / threads,
+           stack_bytes / threads, table_bytes / threads,
+           joined_bytes / threads);
+    fflush(stdout);
+    exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        threads = strtol(argv[1], NULL, 10);
+    }
+    const char *names[] = {
+        "default stacks", "lazy stacks", "lazy stacks, burst",
+        "lazy stacks, burst, released",
+    };
+    for (int i = 0; i < 4; ++i) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            return errno;
+        }
+        if (pid == 0) {
+            burst = i >= 2;
+            measure(names[i], i > 0, i == 3);
+        }
+        int wstatus;
+        if (waitpid(pid, &wstatus, 0) == -1 || !WIFEXITED(wstatus)
+            || WEXITSTATUS(wstatus) != 0) {
+            printf("%s: failed\n", names[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
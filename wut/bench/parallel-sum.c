@@ -0,0 +1,109 @@
+#include "wut.h"
+
+#include <errno.h>     // errno
+#include <stdatomic.h> // atomic_fetch_add
+#include <stdint.h>    // uint64_t
+#include <stdio.h>     // printf
+#include <stdlib.h>    // exit, strtol
+#include <sys/wait.h>  // waitpid
+#include <time.h>      // clock_gettime
+#include <unistd.h>    // fork, sysconf
+
+/* Fork/join scaling across workers. The main thread creates a thread for
+   every chunk of a big sum and joins them all. They all start out in its
+   worker's deque, the other workers steal them from there. Every term is a
+   bit of hashing, so it's compute bound and doesn't wait on memory. Runs
+   with 1, 2, 4, ... workers up to the number of CPUs, or up to the first
+   argument, each in a fork. */
+
+#define CHUNKS 512
+#define TERMS_PER_CHUNK (1 << 16)
+
+static atomic_int next_chunk;
+static uint64_t partial[CHUNKS];
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
+static uint64_t sum_chunk(int chunk) {
+    uint64_t sum = 0;
+    uint64_t start = (uint64_t) chunk * TERMS_PER_CHUNK;
+    for (uint64_t i = start; i < start + TERMS_PER_CHUNK; ++i) {
+        sum += mix(i);
+    }
+    return sum;
+}
+
+static void run(void) {
+    int chunk = atomic_fetch_add(&next_chunk, 1);
+    partial[chunk] = sum_chunk(chunk);
+}
+
+static void measure(int workers, uint64_t expected, double baseline) {
+    struct wut_config config = { .workers = workers };
+    wut_init_config(&config);
+    int ids[CHUNKS];
+    double start = now();
+    for (int i = 0; i < CHUNKS; ++i) {
+        ids[i] = wut_create(run);
+    }
+    for (int i = 0; i < CHUNKS; ++i) {
+        if (wut_join(ids[i]) != 0) {
+            exit(1);
+        }
+    }
+    double elapsed = now() - start;
+    uint64_t sum = 0;
+    for (int i = 0; i < CHUNKS; ++i) {
+        sum += partial[i];
+    }
+    if (sum != expected) {
+        exit(1);
+    }
+    printf("%3d workers: %7.1f ms, %5.2fx a single thread\n", workers,
+           elapsed * 1e3, baseline / elapsed);
+    fflush(stdout);
+    exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    double start = now();
+    uint64_t expected = 0;
+    for (int i = 0; i < CHUNKS; ++i) {
+        expected += sum_chunk(i);
+    }
+    double baseline = now() - start;
+    printf("no threads:  %7.1f ms\n", baseline * 1e3);
+    fflush(stdout);
+
+    long max = sysconf(_SC_NPROCESSORS_ONLN);
+    if (argc > 1) {
+        max = strtol(argv[1], NULL, 10);
+    }
+    for (int workers = 1; workers <= max; workers *= 2) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            return errno;
+        }
+        if (pid == 0) {
+            measure(workers, expected, baseline);
+        }
+        int wstatus;
+        if (waitpid(pid, &wstatus, 0) == -1 || !WIFEXITED(wstatus)
+            || WEXITSTATUS(wstatus) != 0) {
+            printf("%3d workers: failed\n", workers);
+            return 1;
+        }
+    }
+    return 0;
+}
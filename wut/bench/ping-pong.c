@@ -0,0 +1,42 @@
+#include "wut.h"
+
+#include <stdio.h>  // printf
+#include <stdlib.h> // strtol
+#include <time.h>   // clock_gettime
+
+/* Two threads yield back and forth, every yield is one context switch. Pass
+   the number of round trips as the first argument. Built once against the
+   assembly context switch and once against ucontext to compare the two. */
+
+static long round_trips = 1000000;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void pong(void) {
+    for (long i = 0; i < round_trips; ++i) {
+        wut_yield();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        round_trips = strtol(argv[1], NULL, 10);
+    }
+    wut_init();
+    int id = wut_create(pong);
+    /* Let the other thread start before timing. */
+    wut_yield();
+    double start = now();
+    for (long i = 1; i < round_trips; ++i) {
+        wut_yield();
+    }
+    double elapsed = now() - start;
+    printf("%s: %.1f ns per switch\n", BACKEND,
+           elapsed * 1e9 / ((round_trips - 1) * 2));
+    wut_join(id);
+    return 0;
+}
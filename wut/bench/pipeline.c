@@ -0,0 +1,208 @@
+#include "wut.h"
+
+#include <errno.h>    // errno
+#include <stdio.h>    // printf
+#include <stdlib.h>   // exit, strtol
+#include <sys/wait.h> // waitpid
+#include <time.h>     // clock_gettime
+#include <unistd.h>   // fork
+
+/* Measures passing items down a pipeline of threads, each of which adds
+   one to every item. The throughput with as many items in flight as fit
+   goes first, then the latency with one item at a time, which the source
+   waits for at the end before it sends the next. The stages pass items on
+   with
+   - poll:      a one-item mailbox per stage in globals, polled with
+                wut_yield,
+   - chan:      unbuffered channels, so every item is handed from one stage
+                straight to the next,
+   - chan-64:   channels that buffer up to 64 items.
+   Every idle stage that polls gets switched to all the same. The stages
+   are created from the last one to the first, so unless the items follow
+   each other closely, a round through every stage moves them one hop.
+   Pass the largest number of stages as the first argument, the default
+   is 1000. */
+
+#define ITEMS 100000
+#define LATENCY_HOPS 200000
+#define DONE -1
+
+struct mailbox {
+    int full;
+    int item;
+};
+
+static int stages;
+static int latency;
+static int next_stage;
+static struct mailbox *mailboxes;
+static struct wut_chan **chans;
+static size_t capacity;
+static long long total = 0;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void poll_put(int index, int item) {
+    while (mailboxes[index].full) {
+        wut_yield();
+    }
+    mailboxes[index].item = item;
+    mailboxes[index].full = 1;
+}
+
+static int poll_get(int index) {
+    while (!mailboxes[index].full) {
+        wut_yield();
+    }
+    mailboxes[index].full = 0;
+    return mailboxes[index].item;
+}
+
+static void poll_stage(void) {
+    int index = next_stage--;
+    for (;;) {
+        int item = poll_get(index);
+        poll_put(index + 1, item == DONE ? DONE : item + 1);
+        if (item == DONE) {
+            return;
+        }
+    }
+}
+
+static void chan_stage(void) {
+    int index = next_stage--;
+    int item;
+    while (wut_chan_recv(chans[index], &item) == 0) {
+        item++;
+        wut_chan_send(chans[index + 1], &item);
+    }
+    wut_chan_close(chans[index + 1]);
+}
+
+static void poll_sink(void) {
+    for (;;) {
+        int item = poll_get(stages);
+        if (item == DONE) {
+            return;
+        }
+        total += item;
+    }
+}
+
+static void chan_sink(void) {
+    int item;
+    while (wut_chan_recv(chans[stages], &item) == 0) {
+        total += item;
+    }
+}
+
+/* The library can only be initialized once per process, so every
+   measurement gets a fresh child. The main thread is the source. For the
+   throughput there's a sink thread too, for the latency the source takes
+   the items back. */
+static void measure(int use_chans) {
+    wut_init();
+    mailboxes = calloc(stages + 1, sizeof(struct mailbox));
+    chans = calloc(stages + 1, sizeof(struct wut_chan *));
+    if (mailboxes == NULL || chans == NULL) {
+        exit(1);
+    }
+    for (int i = 0; i <= stages; ++i) {
+        chans[i] = wut_chan_create(sizeof(int), capacity);
+        if (chans[i] == NULL) {
+            exit(1);
+        }
+    }
+    int sink = -1;
+    if (!latency) {
+        sink = wut_create(use_chans ? chan_sink : poll_sink);
+    }
+    next_stage = stages - 1;
+    for (int i = 0; i < stages; ++i) {
+        wut_create(use_chans ? chan_stage : poll_stage);
+    }
+    int items = latency ? LATENCY_HOPS / stages : ITEMS;
+    double start = now();
+    for (int item = 0; item < items; ++item) {
+        if (use_chans) {
+            wut_chan_send(chans[0], &item);
+        }
+        else {
+            poll_put(0, item);
+        }
+        if (latency) {
+            int result;
+            if (use_chans) {
+                wut_chan_recv(chans[stages], &result);
+            }
+            else {
+                result = poll_get(stages);
+            }
+            total += result;
+        }
+    }
+    if (!latency) {
+        if (use_chans) {
+            wut_chan_close(chans[0]);
+        }
+        else {
+            poll_put(0, DONE);
+        }
+        wut_join(sink);
+    }
+    double elapsed = now() - start;
+    long long expected = (long long) items * (items - 1) / 2
+                         + (long long) items * stages;
+    if (total != expected) {
+        exit(1);
+    }
+    printf(" %8.1f", elapsed * 1e9 / ((double) items * (stages + 1)));
+    fflush(stdout);
+    exit(0);
+}
+
+static int in_child(int use_chans) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        return errno;
+    }
+    if (pid == 0) {
+        measure(use_chans);
+    }
+    int wstatus;
+    if (waitpid(pid, &wstatus, 0) == -1 || !WIFEXITED(wstatus)
+        || WEXITSTATUS(wstatus) != 0) {
+        printf(" failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    long max = 1000;
+    if (argc > 1) {
+        max = strtol(argv[1], NULL, 10);
+    }
+    for (latency = 0; latency <= 1; ++latency) {
+        printf("%s, ns per item and hop:\n", latency ? "latency" : "throughput");
+        printf("                 poll     chan  chan-64\n");
+        for (stages = 1; stages <= max; stages *= 10) {
+            printf("%5d stages:", stages);
+            fflush(stdout);
+            capacity = 0;
+            if (in_child(0) != 0 || in_child(1) != 0) {
+                return 1;
+            }
+            capacity = 64;
+            if (in_child(1) != 0) {
+                return 1;
+            }
+            printf("\n");
+        }
+    }
+    return 0;
+}
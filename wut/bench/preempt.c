@@ -0,0 +1,95 @@
+#include "wut.h"
+
+#include <errno.h>    // errno
+#include <stdio.h>    // printf
+#include <stdlib.h>   // exit, qsort
+#include <sys/wait.h> // waitpid
+#include <time.h>     // clock_gettime
+#include <unistd.h>   // fork
+
+/* Tail latency of an interactive thread next to batch threads that never
+   yield. The interactive thread wants to run every millisecond, and yields
+   until it's time. Every time it gets to run late, it records how late.
+   Without preemption it would never run again once a batch thread gets the
+   CPU, with it the delay is bounded by a time slice per batch thread. Runs
+   once for every quantum, each in a fork. */
+
+#define BATCH_THREADS 4
+#define SAMPLES 2000
+#define PERIOD 1e-3
+
+static volatile int done = 0;
+static double lateness[SAMPLES];
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void batch(void) {
+    while (!done) {
+    }
+}
+
+static void interactive(void) {
+    double deadline = now() + PERIOD;
+    for (int i = 0; i < SAMPLES; ++i) {
+        while (now() < deadline) {
+            wut_yield();
+        }
+        lateness[i] = now() - deadline;
+        deadline += PERIOD;
+    }
+    done = 1;
+}
+
+static int compare(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static void measure(unsigned long quantum_us) {
+    struct wut_config config = {
+        .preempt_quantum_us = quantum_us,
+    };
+    wut_init_config(&config);
+    int id = wut_create(interactive);
+    int batch_ids[BATCH_THREADS];
+    for (int i = 0; i < BATCH_THREADS; ++i) {
+        batch_ids[i] = wut_create(batch);
+    }
+    if (wut_join(id) != 0) {
+        exit(1);
+    }
+    for (int i = 0; i < BATCH_THREADS; ++i) {
+        wut_join(batch_ids[i]);
+    }
+    qsort(lateness, SAMPLES, sizeof(double), compare);
+    printf("%5lu us quantum: late by %7.1f us p50, %7.1f us p99, %7.1f us max\n",
+           quantum_us, lateness[SAMPLES / 2] * 1e6,
+           lateness[SAMPLES * 99 / 100] * 1e6, lateness[SAMPLES - 1] * 1e6);
+    fflush(stdout);
+    exit(0);
+}
+
+int main(void) {
+    unsigned long quanta[] = { 1000, 250, 50 };
+    for (int i = 0; i < 3; ++i) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            return errno;
+        }
+        if (pid == 0) {
+            measure(quanta[i]);
+        }
+        int wstatus;
+        if (waitpid(pid, &wstatus, 0) == -1 || !WIFEXITED(wstatus)
+            || WEXITSTATUS(wstatus) != 0) {
+            printf("%lu us quantum: failed\n", quanta[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include "wut.h"
+
+#include <errno.h>    // errno
+#include <stdio.h>    // printf
+#include <stdlib.h>   // exit, strtol
+#include <sys/wait.h> // waitpid
+#include <time.h>     // clock_gettime
+#include <unistd.h>   // fork
+
+/* Measures what sleeping threads cost everyone else. For a growing number
+   of sleepers, it first reports how long a `wut_yield` between a few
+   running threads takes while all of them sleep, which should stay the
+   same for any number of sleepers. Then every sleeper sleeps until a
+   random time up to SPREAD_MS after a common start and it reports how late
+   they woke up on average and at worst. The start leaves the sleepers as
+   much time to fall asleep as it took all of them to run once, so that
+   doesn't count as being late. Pass the largest number of sleepers as the first argument, the
+   default is 100k. */
+
+#define RUNNING 10
+#define YIELDS 2000000
+#define SPREAD_MS 1000
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void sleep_forever(void) {
+    wut_sleep_ns(3600 * 1000000000ULL);
+}
+
+static void run(void) {
+    for (;;) {
+        wut_yield();
+    }
+}
+
+static double start = 0;
+static double total_late = 0;
+static double max_late = 0;
+
+static void sleep_random(void) {
+    while (start == 0) {
+        wut_yield();
+    }
+    unsigned seed = wut_id();
+    double deadline = start + rand_r(&seed) % (SPREAD_MS * 1000) * 1e-6;
+    double duration = deadline - now();
+    if (duration > 0) {
+        wut_sleep_ns(duration * 1e9);
+    }
+    double late = now() - deadline;
+    total_late += late;
+    if (late > max_late) {
+        max_late = late;
+    }
+}
+
+/* The library can only be initialized once per process, so every
+   measurement gets a fresh child. */
+static void measure_yield(int sleepers) {
+    struct wut_config config = { .no_guard_page = 1 };
+    wut_init_config(&config);
+    for (int i = 0; i < sleepers; ++i) {
+        if (wut_create(sleep_forever) == -1) {
+            exit(1);
+        }
+    }
+    for (int i = 1; i < RUNNING; ++i) {
+        if (wut_create(run) == -1) {
+            exit(1);
+        }
+    }
+    /* Every sleeper goes to sleep in the first round. */
+    wut_yield();
+    int rounds = YIELDS / RUNNING;
+    double begin = now();
+    for (int i = 0; i < rounds; ++i) {
+        wut_yield();
+    }
+    double elapsed = now() - begin;
+    printf("%8d sleepers: %6.1f ns per yield", sleepers,
+           elapsed * 1e9 / ((double) rounds * RUNNING));
+    fflush(stdout);
+    exit(0);
+}
+
+static void measure_wake(int sleepers) {
+    struct wut_config config = { .no_guard_page = 1 };
+    wut_init_config(&config);
+    for (int i = 0; i < sleepers; ++i) {
+        if (wut_create(sleep_random) == -1) {
+            exit(1);
+        }
+    }
+    double first_round = now();
+    wut_yield();
+    start = now() + (now() - first_round);
+    for (int i = 1; i <= sleepers; ++i) {
+        wut_join(i);
+    }
+    printf(", %7.1f us late on average, %7.1f us at worst\n",
+           total_late * 1e6 / sleepers, max_late * 1e6);
+    fflush(stdout);
+    exit(0);
+}
+
+static int in_child(void (*measure)(int), int sleepers) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        return errno;
+    }
+    if (pid == 0) {
+        measure(sleepers);
+    }
+    int wstatus;
+    if (waitpid(pid, &wstatus, 0) == -1 || !WIFEXITED(wstatus)
+        || WEXITSTATUS(wstatus) != 0) {
+        printf("%8d sleepers: failed\n", sleepers);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    long max = 100000;
+    if (argc > 1) {
+        max = strtol(argv[1], NULL, 10);
+    }
+    for (long sleepers = 10; sleepers <= max; sleepers *= 10) {
+        if (in_child(measure_yield, sleepers) != 0
+            || in_child(measure_wake, sleepers) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,180 @@
+#include "wut.h"
+
+#include <errno.h>    // errno
+#include <stdio.h>    // printf
+#include <stdlib.h>   // exit, strtol
+#include <sys/wait.h> // waitpid
+#include <time.h>     // clock_gettime
+#include <unistd.h>   // fork
+
+/* Measures a producer handing items to a growing number of consumers
+   through a small bounded buffer, which the threads wait on by
+   - spin: yielding until there's an item or room,
+   - cond: parking on two condition variables,
+   - sem:  parking on two semaphores.
+   Waiters that spin all run every round, parked ones only when there's
+   something for them. Pass the largest number of consumers as the first
+   argument, the default is 1000. */
+
+#define ITEMS 1000000
+#define BUFFER 64
+#define DONE -1
+
+static int buffer[BUFFER];
+static int head = 0;
+static int tail = 0;
+static long long consumed = 0;
+
+static struct wut_mutex mutex;
+static struct wut_cond not_empty;
+static struct wut_cond not_full;
+static struct wut_sem items;
+static struct wut_sem slots;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void put(int item) {
+    buffer[tail++ % BUFFER] = item;
+}
+
+static int get(void) {
+    return buffer[head++ % BUFFER];
+}
+
+static void spin_produce(int item) {
+    while (tail - head == BUFFER) {
+        wut_yield();
+    }
+    put(item);
+}
+
+static void spin_consume(void) {
+    for (;;) {
+        while (tail == head) {
+            wut_yield();
+        }
+        int item = get();
+        if (item == DONE) {
+            return;
+        }
+        consumed += item;
+    }
+}
+
+static void cond_produce(int item) {
+    wut_mutex_lock(&mutex);
+    while (tail - head == BUFFER) {
+        wut_cond_wait(&not_full, &mutex);
+    }
+    put(item);
+    wut_cond_signal(&not_empty);
+    wut_mutex_unlock(&mutex);
+}
+
+static void cond_consume(void) {
+    for (;;) {
+        wut_mutex_lock(&mutex);
+        while (tail == head) {
+            wut_cond_wait(&not_empty, &mutex);
+        }
+        int item = get();
+        wut_cond_signal(&not_full);
+        wut_mutex_unlock(&mutex);
+        if (item == DONE) {
+            return;
+        }
+        consumed += item;
+    }
+}
+
+static void sem_produce(int item) {
+    wut_sem_wait(&slots);
+    put(item);
+    wut_sem_post(&items);
+}
+
+static void sem_consume(void) {
+    for (;;) {
+        wut_sem_wait(&items);
+        int item = get();
+        wut_sem_post(&slots);
+        if (item == DONE) {
+            return;
+        }
+        consumed += item;
+    }
+}
+
+struct variant {
+    const char *name;
+    void (*produce)(int item);
+    void (*consume)(void);
+};
+
+static const struct variant variants[] = {
+    { "spin", spin_produce, spin_consume },
+    { "cond", cond_produce, cond_consume },
+    { "sem", sem_produce, sem_consume },
+};
+
+/* The library can only be initialized once per process, so every
+   measurement gets a fresh child. */
+static void measure(const struct variant *variant, int consumers) {
+    wut_init();
+    wut_sem_init(&items, 0);
+    wut_sem_init(&slots, BUFFER);
+    for (int i = 0; i < consumers; ++i) {
+        if (wut_create(variant->consume) == -1) {
+            exit(1);
+        }
+    }
+    double start = now();
+    for (int i = 1; i <= ITEMS; ++i) {
+        variant->produce(1);
+    }
+    for (int i = 0; i < consumers; ++i) {
+        variant->produce(DONE);
+    }
+    for (int i = 1; i <= consumers; ++i) {
+        wut_join(i);
+    }
+    double elapsed = now() - start;
+    if (consumed != ITEMS) {
+        exit(1);
+    }
+    printf("  %s %8.1f ns", variant->name, elapsed * 1e9 / ITEMS);
+    fflush(stdout);
+    exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    long max = 1000;
+    if (argc > 1) {
+        max = strtol(argv[1], NULL, 10);
+    }
+    for (long consumers = 1; consumers <= max; consumers *= 10) {
+        printf("%5ld consumers, per item:", consumers);
+        fflush(stdout);
+        for (size_t i = 0; i < sizeof(variants) / sizeof(variants[0]); ++i) {
+            pid_t pid = fork();
+            if (pid == -1) {
+                return errno;
+            }
+            if (pid == 0) {
+                measure(&variants[i], consumers);
+            }
+            int wstatus;
+            if (waitpid(pid, &wstatus, 0) == -1 || !WIFEXITED(wstatus)
+                || WEXITSTATUS(wstatus) != 0) {
+                printf("  %s failed\n", variants[i].name);
+                return 1;
+            }
+        }
+        printf("\n");
+    }
+    return 0;
+}
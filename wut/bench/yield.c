@@ -0,0 +1,82 @@
+#include "wut.h"
+
+#include <errno.h>    // errno
+#include <stdio.h>    // printf
+#include <stdlib.h>   // exit, strtol
+#include <sys/wait.h> // waitpid
+#include <time.h>     // clock_gettime
+#include <unistd.h>   // fork
+
+/* Measures how long a `wut_yield` takes with a growing number of threads in
+   the ready queue. Every thread yields `rounds` times, so every round is one
+   yield per thread, and the total number of yields stays about the same for
+   every thread count. Pass the largest thread count as the first argument,
+   the default is 1M. Guard pages would take more mappings than the kernel
+   allows for that many threads, so they're off. */
+
+#define YIELDS 2000000
+
+static int rounds;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void run(void) {
+    for (int i = 0; i < rounds; ++i) {
+        wut_yield();
+    }
+}
+
+/* The library can only be initialized once per process, so every thread
+   count gets a fresh child. */
+static void measure(int threads) {
+    rounds = YIELDS / threads;
+    if (rounds < 2) {
+        rounds = 2;
+    }
+
+    struct wut_config config = { .no_guard_page = 1 };
+    wut_init_config(&config);
+    for (int i = 1; i < threads; ++i) {
+        if (wut_create(run) == -1) {
+            exit(1);
+        }
+    }
+    /* The first round also runs every thread for the first time. */
+    wut_yield();
+    double start = now();
+    for (int i = 1; i < rounds; ++i) {
+        wut_yield();
+    }
+    double elapsed = now() - start;
+    long yields = (long) (rounds - 1) * threads;
+    printf("%8d threads: %6.1f ns per yield\n", threads, elapsed * 1e9 / yields);
+    fflush(stdout);
+    exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    long max = 1000000;
+    if (argc > 1) {
+        max = strtol(argv[1], NULL, 10);
+    }
+    for (long threads = 10; threads <= max; threads *= 10) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            return errno;
+        }
+        if (pid == 0) {
+            measure(threads);
+        }
+        int wstatus;
+        if (waitpid(pid, &wstatus, 0) == -1 || !WIFEXITED(wstatus)
+            || WEXITSTATUS(wstatus) != 0) {
+            printf("%8ld threads: failed\n", threads);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -68,6 +68,9 @@ test_weights = {
 with open(testlog_path, 'r') as f:
     for line in f:
         test = json.loads(line)
+        # Tests for features beyond the assignment aren't graded
+        if test['name'] not in test_weights:
+            continue
         weight = test_weights[test['name']]
         if test['result'] == 'OK':
             print(test['name'], weight, sep=',')
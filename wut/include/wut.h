@@ -1,7 +1,61 @@
 #ifndef WUT_H
 #define WUT_H
 
+#include <stddef.h>
+#include <stdint.h>     // uint64_t
+#include <sys/socket.h> // struct sockaddr, socklen_t
+#include <sys/types.h>  // ssize_t
+
+// Every thread stack is this big unless wut_config says otherwise
+#define WUT_DEFAULT_STACK_SIZE 8192
+// How many stacks of finished threads are kept for new ones by default
+#define WUT_DEFAULT_STACK_CACHE 256
+// Set stack_cache to this to give every stack back right away
+#define WUT_NO_STACK_CACHE ((size_t) -1)
+// Every stack is this big with lazy_stacks unless wut_config says otherwise
+#define WUT_LAZY_STACK_SIZE (1024 * 1024)
+
+// A zeroed config gives the same library as wut_init
+struct wut_config {
+  size_t stack_size;
+  size_t stack_cache;
+  // Every stack has an inaccessible page below it, so an overflow
+  // crashes instead of corrupting memory. That's two mappings per
+  // thread, set this for more threads than vm.max_map_count allows
+  int no_guard_page;
+  // Map stacks without reserving memory for them, so a stack only takes
+  // the pages its thread has touched and can be much bigger than what
+  // most threads use, WUT_LAZY_STACK_SIZE by default. A stack that big
+  // also takes a page of page tables of its own. Touching a page for the
+  // first time when there's no memory left kills the process
+  int lazy_stacks;
+  // Give the pages of a finished thread's stack back to the kernel when
+  // it goes back to the stack pool, all but the top one which the next
+  // thread touches right away. Costs a madvise per thread, and page
+  // faults once the stack gets used again
+  int release_stacks;
+  // Switch threads every this many microseconds, even if the running
+  // one doesn't yield. 0 leaves threads to yield on their own.
+  // The switch happens in a signal handler on the thread's stack, which
+  // needs a few KiB of room on top of what the thread uses itself. Link
+  // with -z now, like the library is, or the first call through a lazily
+  // bound symbol in there saves every register state the CPU has on top
+  // of that
+  unsigned long preempt_quantum_us;
+  // Run threads on this many kernel threads, including the one that
+  // calls wut_init. Idle ones steal threads that are ready to run from
+  // busy ones, so a thread may run on a different kernel thread every
+  // time it gets switched to. 0 or 1 keeps them all on the calling one,
+  // in FIFO order. With several workers, a thread that's cancelled
+  // while it isn't blocked only exits when it starts running, yields,
+  // returns from wut_join or is about to wait for a mutex, cond, sem or
+  // barrier, and wut_yield always returns 0.
+  // Preemption needs a single worker
+  int workers;
+};
+
 void wut_init(void);
+void wut_init_config(const struct wut_config *config);
 int wut_create(void (*run)(void));
 int wut_id(void);
 int wut_yield(void);
@@ -9,4 +63,162 @@ int wut_cancel(int id);
 int wut_join(int id);
 void wut_exit(int status);
 
+// Threads that take an argument and return a result. What fn returns, or
+// what it passes to wut_exit_result, is the result wut_join_result gets,
+// and its status is 0. A thread that exits with wut_exit or from
+// wut_create has NULL as its result, a cancelled one WUT_CANCELED
+#define WUT_CANCELED ((void *) -1)
+int wut_create_arg(void *(*fn)(void *), void *arg);
+int wut_join_result(int id, void **result);
+void wut_exit_result(void *result);
+
+// Create n threads running fn(args[i]) at once, or fn(NULL) if args is
+// NULL, and put their ids into ids. That's cheaper than one at a time:
+// stacks that aren't in the pool come out of a single mmap
+int wut_create_n(void *(*fn)(void *), void **args, int n, int *ids);
+
+// Let the other threads run for at least ns nanoseconds. If none can,
+// the process sleeps instead of spinning in wut_yield
+void wut_sleep_ns(uint64_t ns);
+
+// Like wut_join, but give up after timeout_ns nanoseconds and fail with
+// errno set to ETIMEDOUT. The thread can be joined again later
+int wut_join_timeout(int id, uint64_t timeout_ns);
+
+// Keep the running thread from being preempted until the matching
+// wut_preempt_enable, these nest. Wrap calls into code that isn't
+// reentrant, like malloc or stdio, when threads are preempted
+void wut_preempt_disable(void);
+void wut_preempt_enable(void);
+
+// How many bytes of the stack of thread id are in memory, or -1 if there's
+// no such thread
+ssize_t wut_stack_resident(int id);
+
+// What a thread did so far, when the library is built with -Dtrace=true
+struct wut_trace_stats {
+  uint64_t runs;    // how many times it was switched to
+  uint64_t run_ns;  // how long it ran, up to now if it's the caller
+  uint64_t join_ns; // how long it waited to join other threads
+};
+
+// Get the stats of thread id, or -1 if there's no such thread. Without
+// tracing built in, this fails with ENOSYS
+int wut_trace_stats(int id, struct wut_trace_stats *stats);
+
+// Write what every worker did since wut_init or the last call to path as
+// Chrome trace-event JSON, for chrome://tracing or ui.perfetto.dev, and
+// forget it. Every wut thread is a track of when it ran and when it waited
+// in a join, and every worker has a counter of the threads that were ready
+// on it at each switch. Returns -1 with errno set if writing fails, or
+// with ENOSYS without tracing built in
+int wut_trace_write(const char *path);
+
+// Like read, write and accept, but if fd isn't ready, only the calling
+// thread waits for it, and the others keep running. fd is switched to
+// O_NONBLOCK the first time, close it with wut_close so a new fd with the
+// same number isn't taken for non-blocking too. At most one thread can
+// wait to read from and one to write to an fd at a time, others get EBUSY
+ssize_t wut_read(int fd, void *buf, size_t count);
+ssize_t wut_write(int fd, const void *buf, size_t count);
+int wut_accept(int fd, struct sockaddr *addr, socklen_t *addrlen);
+int wut_close(int fd);
+
+// Threads parked in a mutex, cond, sem or barrier, in the order they're
+// woken. Only the library looks inside
+struct TCB;
+struct wut_queue {
+  struct TCB *first;
+  struct TCB **last;
+  _Atomic int length;
+};
+
+// A mutex, condition variable, semaphore and barrier that take waiting
+// threads off the ready queue until they're woken, first come first
+// served, instead of having them spin in wut_yield. Locking a free mutex,
+// taking from a positive semaphore, and unlocking, posting or signalling
+// while nobody waits is one atomic operation. Waiting fails with -1 if no
+// other thread could ever wake the caller, like wut_join. A zeroed mutex,
+// cond or sem is the same as an initialized one with a value of 0
+struct wut_mutex {
+  _Atomic int state;
+  struct wut_queue waiting;
+};
+
+struct wut_cond {
+  struct wut_queue waiting;
+};
+
+struct wut_sem {
+  _Atomic int value;
+  struct wut_queue waiting;
+};
+
+struct wut_barrier {
+  int count;
+  struct wut_queue waiting;
+};
+
+// What wut_barrier_wait returns to the thread that completes the barrier
+#define WUT_BARRIER_SERIAL_THREAD 1
+
+void wut_mutex_init(struct wut_mutex *mutex);
+int wut_mutex_lock(struct wut_mutex *mutex);
+void wut_mutex_unlock(struct wut_mutex *mutex);
+
+void wut_cond_init(struct wut_cond *cond);
+int wut_cond_wait(struct wut_cond *cond, struct wut_mutex *mutex);
+void wut_cond_signal(struct wut_cond *cond);
+void wut_cond_broadcast(struct wut_cond *cond);
+
+void wut_sem_init(struct wut_sem *sem, int value);
+int wut_sem_wait(struct wut_sem *sem);
+void wut_sem_post(struct wut_sem *sem);
+
+void wut_barrier_init(struct wut_barrier *barrier, int count);
+int wut_barrier_wait(struct wut_barrier *barrier);
+
+// Channels pass values of a fixed size from thread to thread, in order.
+// A channel buffers up to capacity values, 0 makes every send wait for a
+// receiver and WUT_CHAN_UNBOUNDED never makes senders wait. A sender and
+// a receiver that meet copy the value straight from one to the other.
+// Sending and receiving fail with EPIPE once the channel is closed and
+// empty, and with EDEADLK if no other thread could ever go on the other
+// side
+#define WUT_CHAN_UNBOUNDED ((size_t) -1)
+
+struct wut_chan;
+
+struct wut_chan *wut_chan_create(size_t size, size_t capacity);
+void wut_chan_destroy(struct wut_chan *chan);
+int wut_chan_send(struct wut_chan *chan, const void *value);
+int wut_chan_recv(struct wut_chan *chan, void *value);
+void wut_chan_close(struct wut_chan *chan);
+
+enum {
+  WUT_CHAN_SEND,
+  WUT_CHAN_RECV,
+};
+
+// One of the sends or receives wut_chan_select waits for. It's also what
+// a waiting thread is queued with, so the cases have to stay put until
+// wut_chan_select returns
+struct wut_select;
+struct wut_chan_case {
+  struct wut_chan *chan;
+  int op;      // WUT_CHAN_SEND or WUT_CHAN_RECV
+  void *value; // sent from or received into
+  int ok;      // set to 0 if it went because the channel is closed
+  // only the library looks at these
+  struct wut_chan_case *next;
+  struct wut_chan_case **previous;
+  struct wut_select *select;
+};
+
+// Wait until one of the cases can go, do that one and return its index.
+// If several can, the first one goes. Fails with EDEADLK like sending or
+// receiving. wut_chan_try_select fails with EAGAIN instead of waiting
+int wut_chan_select(struct wut_chan_case *cases, int count);
+int wut_chan_try_select(struct wut_chan_case *cases, int count);
+
 #endif
@@ -0,0 +1,62 @@
+#include "context.h"
+#include <stdint.h> // uintptr_t
+#include <string.h> // memset
+
+#ifdef WUT_UCONTEXT
+
+void wut_context_init(struct wut_context *context, char *stack, size_t size,
+                      void (*entry)(void)) {
+  getcontext(&context->uc);
+  context->uc.uc_stack.ss_sp = stack;
+  context->uc.uc_stack.ss_size = size;
+  context->uc.uc_link = NULL;
+  makecontext(&context->uc, entry, 0);
+}
+
+void wut_context_switch(struct wut_context *from, struct wut_context *to) {
+  swapcontext(&from->uc, &to->uc);
+}
+
+#else
+
+// defined next to wut_context_switch, calls the entry function that
+// wut_context_init left in a callee-saved register
+void wut_context_start(void);
+
+#if defined(__x86_64__)
+
+// wut_context_switch pushes rbp, rbx, r12 to r15 and then the MXCSR and x87
+// control words, and returns through the address above them. The first
+// switch returns into wut_context_start with the entry function in rbx and
+// the stack 16 byte aligned for its call
+void wut_context_init(struct wut_context *context, char *stack, size_t size,
+                      void (*entry)(void)) {
+  uintptr_t top = ((uintptr_t) stack + size) & ~(uintptr_t) 15;
+  uint64_t *sp = (uint64_t *) (top - 64);
+  memset(sp, 0, 64);
+  uint32_t *control = (uint32_t *) sp;
+  control[0] = 0x1f80; // MXCSR, all exceptions masked
+  control[1] = 0x037f; // x87 control word, the same
+  sp[5] = (uintptr_t) entry;             // rbx
+  sp[7] = (uintptr_t) wut_context_start; // return address
+  context->sp = sp;
+}
+
+#elif defined(__aarch64__)
+
+// wut_context_switch stores x19 to x30 and d8 to d15 in a 160 byte frame and
+// returns to x30. The first switch returns into wut_context_start with the
+// entry function in x19
+void wut_context_init(struct wut_context *context, char *stack, size_t size,
+                      void (*entry)(void)) {
+  uintptr_t top = ((uintptr_t) stack + size) & ~(uintptr_t) 15;
+  uint64_t *sp = (uint64_t *) (top - 160);
+  memset(sp, 0, 160);
+  sp[0] = (uintptr_t) entry;             // x19
+  sp[11] = (uintptr_t) wut_context_start; // x30
+  context->sp = sp;
+}
+
+#endif
+
+#endif
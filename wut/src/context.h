@@ -0,0 +1,38 @@
+#ifndef WUT_CONTEXT_H
+#define WUT_CONTEXT_H
+
+#include <stddef.h> // size_t
+
+// Switching with swapcontext saves and restores the signal mask, which is a
+// system call every time. On x86-64 and aarch64 we switch in assembly
+// instead, saving only the registers a function call has to preserve.
+// Build with -Dcontext=ucontext (or define WUT_UCONTEXT) to use ucontext on
+// those too, it's always used elsewhere.
+#if !defined(WUT_UCONTEXT) && !defined(__x86_64__) && !defined(__aarch64__)
+#define WUT_UCONTEXT
+#endif
+
+#ifdef WUT_UCONTEXT
+#include <ucontext.h>
+
+struct wut_context {
+  ucontext_t uc;
+};
+#else
+// The registers are pushed on the thread's own stack, so all we need to
+// keep is where its stack pointer was
+struct wut_context {
+  void *sp;
+};
+#endif
+
+// set up a context that calls entry on the given stack the first time it's
+// switched to, entry must never return
+void wut_context_init(struct wut_context *context, char *stack, size_t size,
+                      void (*entry)(void));
+
+// save the running thread into from and continue the one in to, returns
+// once something switches back to from
+void wut_context_switch(struct wut_context *from, struct wut_context *to);
+
+#endif
@@ -0,0 +1,102 @@
+#include "deque.h"
+#include <stdio.h>  // perror
+#include <stdlib.h> // malloc, exit
+
+static struct deque_array *array_new(size_t size) {
+  struct deque_array *array = malloc(sizeof(struct deque_array)
+                                     + size * sizeof(array->items[0]));
+  if (array == NULL) {
+    perror("deque malloc failed");
+    exit(1);
+  }
+  array->size = size;
+  array->previous = NULL;
+  return array;
+}
+
+void deque_init(struct deque *deque, size_t size) {
+  atomic_init(&deque->top, 0);
+  atomic_init(&deque->bottom, 0);
+  atomic_init(&deque->array, array_new(size));
+}
+
+// Thieves may still be reading the old array, so it's only kept around,
+// never freed. It's half the size of the new one, so all of them together
+// never take up more than the newest one
+static struct deque_array *grow(struct deque *deque, struct deque_array *old,
+                                long top, long bottom) {
+  struct deque_array *array = array_new(old->size * 2);
+  array->previous = old;
+  for (long i = top; i < bottom; i++) {
+    atomic_store_explicit(&array->items[i & (array->size - 1)],
+                          atomic_load_explicit(&old->items[i & (old->size - 1)],
+                                               memory_order_relaxed),
+                          memory_order_relaxed);
+  }
+  atomic_store_explicit(&deque->array, array, memory_order_release);
+  return array;
+}
+
+void deque_push(struct deque *deque, void *item) {
+  long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+  long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+  struct deque_array *array = atomic_load_explicit(&deque->array,
+                                                   memory_order_relaxed);
+  if (bottom - top > (long) array->size - 1) {
+    array = grow(deque, array, top, bottom);
+  }
+  atomic_store_explicit(&array->items[bottom & (array->size - 1)], item,
+                        memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+}
+
+void *deque_pop(struct deque *deque) {
+  long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+  struct deque_array *array = atomic_load_explicit(&deque->array,
+                                                   memory_order_relaxed);
+  atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  long top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+  if (top > bottom) {
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return NULL;
+  }
+  void *item = atomic_load_explicit(&array->items[bottom & (array->size - 1)],
+                                    memory_order_relaxed);
+  if (top == bottom) {
+    // the last one, a thief may be taking it right now
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed)) {
+      item = NULL;
+    }
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+  }
+  return item;
+}
+
+void *deque_steal(struct deque *deque) {
+  long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  long bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+  if (top >= bottom) {
+    return NULL;
+  }
+  struct deque_array *array = atomic_load_explicit(&deque->array,
+                                                   memory_order_acquire);
+  void *item = atomic_load_explicit(&array->items[top & (array->size - 1)],
+                                    memory_order_relaxed);
+  if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                               memory_order_seq_cst,
+                                               memory_order_relaxed)) {
+    return DEQUE_ABORT;
+  }
+  return item;
+}
+
+long deque_size(struct deque *deque) {
+  long top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+  long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+  return bottom > top ? bottom - top : 0;
+}
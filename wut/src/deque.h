@@ -0,0 +1,43 @@
+#ifndef WUT_DEQUE_H
+#define WUT_DEQUE_H
+
+#include <stdatomic.h> // atomic_*
+#include <stddef.h>    // size_t
+
+// A Chase-Lev work-stealing deque, with the memory orders from "Correct and
+// Efficient Work-Stealing for Weak Memory Models" (Lê et al., 2013). The
+// worker that owns it pushes and pops at the bottom, any other worker steals
+// from the top. It only holds pointers, and grows when it's full.
+
+struct deque_array {
+  size_t size; // a power of two
+  struct deque_array *previous; // the smaller one this replaced
+  _Atomic(void *) items[];
+};
+
+struct deque {
+  atomic_long top;
+  char padding[64 - sizeof(atomic_long)]; // thieves only touch top
+  atomic_long bottom;
+  _Atomic(struct deque_array *) array;
+};
+
+// steal lost a race against another thief or the owner, try again
+#define DEQUE_ABORT ((void *) 1)
+
+void deque_init(struct deque *deque, size_t size);
+
+// only for the owner
+void deque_push(struct deque *deque, void *item);
+
+// only for the owner, returns NULL if it's empty
+void *deque_pop(struct deque *deque);
+
+// for anyone, returns NULL if it's empty or DEQUE_ABORT. The owner gets
+// the oldest item with it
+void *deque_steal(struct deque *deque);
+
+// for anyone, how many items there are, which may have changed already
+long deque_size(struct deque *deque);
+
+#endif
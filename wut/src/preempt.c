@@ -0,0 +1,91 @@
+#include "preempt.h"
+#include <errno.h>  // errno
+#include <signal.h> // sigaction, SIGVTALRM
+#include <stdio.h>  // perror
+#include <stdlib.h> // exit
+#include <string.h> // memset
+#include <time.h>   // timer_create, timer_settime
+
+atomic_int preempt_depth;
+atomic_int preempt_pending;
+
+static void (*preempt_tick)(void);
+
+// Runs on the stack of whatever thread the timer interrupted, and switches
+// away from it right there. Once that thread gets switched back to, this
+// returns and the kernel restores the registers it interrupted. The kernel
+// blocks the signal while it sets this up, and once the handler counts as
+// a section with preemption disabled, it's unblocked for the threads this
+// switches to. A tick that comes while the handler is still on the stack
+// then only leaves a note, and it goes around once more instead of
+// stacking another signal frame. It's blocked again before this returns,
+// and sigreturn unblocks it, so not even the way out can be interrupted
+static void on_timer(int signal) {
+  (void) signal;
+  if (atomic_load_explicit(&preempt_depth, memory_order_relaxed) != 0) {
+    atomic_store_explicit(&preempt_pending, 1, memory_order_relaxed);
+    return;
+  }
+  int err = errno;
+  atomic_store_explicit(&preempt_depth, 1, memory_order_relaxed);
+  atomic_signal_fence(memory_order_seq_cst);
+  sigset_t timer_signal;
+  sigemptyset(&timer_signal);
+  sigaddset(&timer_signal, SIGVTALRM);
+  sigprocmask(SIG_UNBLOCK, &timer_signal, NULL);
+  for (;;) {
+    atomic_store_explicit(&preempt_pending, 0, memory_order_relaxed);
+    preempt_tick();
+    sigprocmask(SIG_BLOCK, &timer_signal, NULL);
+    if (!atomic_load_explicit(&preempt_pending, memory_order_relaxed)) {
+      break;
+    }
+    sigprocmask(SIG_UNBLOCK, &timer_signal, NULL);
+  }
+  atomic_store_explicit(&preempt_depth, 0, memory_order_relaxed);
+  errno = err;
+}
+
+void preempt_run_pending(void) {
+  atomic_store_explicit(&preempt_pending, 0, memory_order_relaxed);
+  preempt_tick();
+}
+
+void preempt_start(unsigned long quantum_us, void (*tick)(void)) {
+  preempt_tick = tick;
+
+  // SIGVTALRM is only otherwise used by ITIMER_VIRTUAL, which is a lot
+  // less likely to be in use than SIGALRM. No SA_NODEFER: once the timer
+  // falls behind, it's due again as soon as its signal is taken, and the
+  // kernel would deliver it right on top of the handler it just set up
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = on_timer;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGVTALRM, &action, NULL) == -1) {
+    perror("sigaction failed");
+    exit(errno);
+  }
+
+  // A CPU time clock would fit better, but its timers only fire on the
+  // kernel's scheduler tick, which can be several milliseconds apart no
+  // matter how short the quantum is
+  struct sigevent event;
+  memset(&event, 0, sizeof(event));
+  event.sigev_notify = SIGEV_SIGNAL;
+  event.sigev_signo = SIGVTALRM;
+  timer_t timer;
+  if (timer_create(CLOCK_MONOTONIC, &event, &timer) == -1) {
+    perror("timer_create failed");
+    exit(errno);
+  }
+  struct itimerspec slice;
+  slice.it_value.tv_sec = quantum_us / 1000000;
+  slice.it_value.tv_nsec = quantum_us % 1000000 * 1000;
+  slice.it_interval = slice.it_value;
+  if (timer_settime(timer, 0, &slice, NULL) == -1) {
+    perror("timer_settime failed");
+    exit(errno);
+  }
+}
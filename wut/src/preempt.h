@@ -0,0 +1,45 @@
+#ifndef WUT_PREEMPT_H
+#define WUT_PREEMPT_H
+
+#include <stdatomic.h> // atomic_*
+
+// Time slices for the preemptive mode. A timer signal switches threads at
+// the end of every slice, unless it interrupts a section with preemption
+// disabled, which is what the scheduler wraps every change to its own state
+// in. Then it only leaves a note, and the switch happens when the section
+// ends. Disabling is just a counter, not sigprocmask, so it costs nothing
+// like a system call, and the library does it in cooperative mode too.
+
+// How deep in sections with preemption disabled the running thread is.
+// With several workers there's no timer, and every kernel thread changes
+// these at once, so what they hold means nothing then. They're atomics so
+// that's no data race, relaxed loads and stores are plain moves
+extern atomic_int preempt_depth;
+
+// Set by the timer if the slice ended while preemption was disabled
+extern atomic_int preempt_pending;
+
+// start a timer that calls tick every quantum_us microseconds, from a
+// signal handler on the running thread's stack
+void preempt_start(unsigned long quantum_us, void (*tick)(void));
+
+// call tick for a slice that ended while preemption was disabled
+void preempt_run_pending(void);
+
+static inline void preempt_disable(void) {
+  int depth = atomic_load_explicit(&preempt_depth, memory_order_relaxed);
+  atomic_store_explicit(&preempt_depth, depth + 1, memory_order_relaxed);
+  atomic_signal_fence(memory_order_seq_cst);
+}
+
+static inline void preempt_enable(void) {
+  atomic_signal_fence(memory_order_seq_cst);
+  int depth = atomic_load_explicit(&preempt_depth, memory_order_relaxed) - 1;
+  atomic_store_explicit(&preempt_depth, depth, memory_order_relaxed);
+  if (depth == 0
+      && atomic_load_explicit(&preempt_pending, memory_order_relaxed)) {
+    preempt_run_pending();
+  }
+}
+
+#endif
@@ -0,0 +1,176 @@
+#include "reactor.h"
+#include <errno.h>     // errno
+#include <fcntl.h>     // fcntl, O_NONBLOCK
+#include <stdint.h>    // uint32_t
+#include <stdio.h>     // perror
+#include <stdlib.h>    // reallocarray, exit
+#include <sys/epoll.h> // epoll_*
+
+struct fd_state {
+  int reader; // the thread waiting to read, or -1
+  int writer; // the thread waiting to write, or -1
+  unsigned char registered; // it's been added to epoll
+  unsigned char nonblocking; // we made sure of O_NONBLOCK
+};
+
+atomic_int reactor_waiting;
+
+// Created the first time a thread waits, so it costs nothing without I/O
+static int epoll_fd = -1;
+
+// Indexed by fd
+static struct fd_state *fds;
+static int fd_capacity;
+
+static struct fd_state *get_state(int fd) {
+  if (fd >= fd_capacity) {
+    int capacity = fd_capacity == 0 ? 64 : fd_capacity;
+    while (capacity <= fd) {
+      capacity <<= 1;
+    }
+    fds = reallocarray(fds, capacity, sizeof(struct fd_state));
+    if (fds == NULL) {
+      perror("reactor fds re-alloc failed");
+      exit(1);
+    }
+    for (int i = fd_capacity; i < capacity; i++) {
+      fds[i] = (struct fd_state) { .reader = -1, .writer = -1 };
+    }
+    fd_capacity = capacity;
+  }
+  return &fds[fd];
+}
+
+int reactor_nonblocking(int fd) {
+  if (fd < 0) {
+    errno = EBADF;
+    return -1;
+  }
+  struct fd_state *state = get_state(fd);
+  if (state->nonblocking) {
+    return 0;
+  }
+  int flags = fcntl(fd, F_GETFL);
+  if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+    return -1;
+  }
+  state->nonblocking = 1;
+  return 0;
+}
+
+// (re-)arm fd for whatever its waiters wait for
+static int arm(int fd, struct fd_state *state) {
+  uint32_t events = EPOLLONESHOT;
+  if (state->reader != -1) {
+    events |= EPOLLIN | EPOLLRDHUP;
+  }
+  if (state->writer != -1) {
+    events |= EPOLLOUT;
+  }
+  struct epoll_event event = { .events = events, .data.fd = fd };
+  if (state->registered) {
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) == 0) {
+      return 0;
+    }
+    // it was closed without reactor_close, and the fd reused
+    if (errno != ENOENT) {
+      return -1;
+    }
+  }
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+    return -1;
+  }
+  state->registered = 1;
+  return 0;
+}
+
+int reactor_wait(int fd, int direction, int id) {
+  if (epoll_fd == -1) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) {
+      return -1;
+    }
+  }
+  struct fd_state *state = get_state(fd);
+  int *waiter = direction == REACTOR_READ ? &state->reader : &state->writer;
+  if (*waiter != -1) {
+    errno = EBUSY;
+    return -1;
+  }
+  *waiter = id;
+  if (arm(fd, state) == -1) {
+    *waiter = -1;
+    return -1;
+  }
+  atomic_fetch_add_explicit(&reactor_waiting, 1, memory_order_relaxed);
+  return 0;
+}
+
+void reactor_forget(int fd, int id) {
+  if (id == -1) {
+    return;
+  }
+  struct fd_state *state = get_state(fd);
+  if (state->reader == id) {
+    state->reader = -1;
+    atomic_fetch_sub_explicit(&reactor_waiting, 1, memory_order_relaxed);
+  }
+  if (state->writer == id) {
+    state->writer = -1;
+    atomic_fetch_sub_explicit(&reactor_waiting, 1, memory_order_relaxed);
+  }
+}
+
+void reactor_close(int fd, int ids[2]) {
+  ids[0] = -1;
+  ids[1] = -1;
+  if (fd < 0 || fd >= fd_capacity) {
+    return;
+  }
+  struct fd_state *state = &fds[fd];
+  ids[0] = state->reader;
+  ids[1] = state->writer;
+  reactor_forget(fd, ids[0]);
+  reactor_forget(fd, ids[1]);
+  if (state->registered) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+  }
+  *state = (struct fd_state) { .reader = -1, .writer = -1 };
+}
+
+int reactor_collect(struct epoll_event *events, int max, int timeout_ms) {
+  if (epoll_fd == -1) {
+    return 0;
+  }
+  int count = epoll_wait(epoll_fd, events, max, timeout_ms);
+  return count == -1 ? 0 : count;
+}
+
+void reactor_dispatch(struct epoll_event *events, int count,
+                      void (*wake)(int id)) {
+  for (int i = 0; i < count; i++) {
+    int fd = events[i].data.fd;
+    uint32_t ready = events[i].events;
+    struct fd_state *state = get_state(fd);
+    int reader = -1;
+    int writer = -1;
+    if (ready & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) {
+      reader = state->reader;
+    }
+    if (ready & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+      writer = state->writer;
+    }
+    if (reader != -1) {
+      reactor_forget(fd, reader);
+      wake(reader);
+    }
+    if (writer != -1) {
+      reactor_forget(fd, writer);
+      wake(writer);
+    }
+    // one-shot disarmed it, but someone may still wait the other way
+    if (state->reader != -1 || state->writer != -1) {
+      arm(fd, state);
+    }
+  }
+}
@@ -0,0 +1,41 @@
+#ifndef WUT_REACTOR_H
+#define WUT_REACTOR_H
+
+#include <stdatomic.h>   // atomic_int
+#include <sys/epoll.h>   // struct epoll_event
+
+// Threads waiting for file descriptors to become readable or writable. Each
+// fd has at most one reader and one writer waiting on it, registered with
+// epoll as one-shot, so an fd nobody waits on anymore doesn't keep waking
+// the poller. The reactor only knows thread ids, the scheduler makes the
+// threads ready. With several workers the scheduler lock protects it, but
+// reactor_collect can run without it.
+
+#define REACTOR_READ 1
+#define REACTOR_WRITE 2
+
+// How many threads wait for an fd right now
+extern atomic_int reactor_waiting;
+
+// make sure fd is non-blocking, the first time it's used
+int reactor_nonblocking(int fd);
+
+// register thread id to wait for fd in direction, returns -1 with errno
+// set if someone already does
+int reactor_wait(int fd, int direction, int id);
+
+// forget that thread id waits for fd, if it was cancelled
+void reactor_forget(int fd, int id);
+
+// forget everything about fd before it gets closed, returns the ids of
+// the threads that waited for it in ids[2], or -1
+void reactor_close(int fd, int ids[2]);
+
+// wait up to timeout_ms for fds to become ready, -1 waits for good
+int reactor_collect(struct epoll_event *events, int max, int timeout_ms);
+
+// call wake for every thread whose fd is ready
+void reactor_dispatch(struct epoll_event *events, int count,
+                      void (*wake)(int id));
+
+#endif
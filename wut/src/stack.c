@@ -0,0 +1,113 @@
+#include "stack.h"
+#include <stdlib.h>   // reallocarray
+#include <sys/mman.h> // mmap, mprotect, munmap, madvise, mincore
+#include <unistd.h>   // sysconf
+#include <valgrind/valgrind.h> // VALGRIND_STACK_REGISTER
+
+static size_t page_size;
+static size_t usable_size;
+// page_size with guard pages, 0 without
+static size_t guard_size;
+static int map_flags;
+static int release_pages;
+
+// The free stacks, used last in first out since those are the most likely
+// to still be cached
+static char **pool;
+static size_t pool_count;
+static size_t pool_capacity;
+
+void stack_pool_init(size_t size, size_t cache, int guard, int lazy,
+                     int release) {
+  page_size = sysconf(_SC_PAGESIZE);
+  usable_size = (size + page_size - 1) & ~(page_size - 1);
+  guard_size = guard ? page_size : 0;
+  map_flags = MAP_ANONYMOUS | MAP_PRIVATE | MAP_STACK;
+  if (lazy) {
+    map_flags |= MAP_NORESERVE;
+  }
+  release_pages = release;
+  pool_capacity = cache;
+  pool_count = 0;
+  pool = reallocarray(NULL, cache, sizeof(char *));
+}
+
+size_t stack_size(void) {
+  return usable_size;
+}
+
+char *stack_get(void) {
+  if (pool_count > 0) {
+    return pool[--pool_count];
+  }
+  char *mapping = mmap(NULL, guard_size + usable_size, PROT_READ | PROT_WRITE,
+                       map_flags, -1, 0);
+  if (mapping == MAP_FAILED) {
+    return NULL;
+  }
+  if (guard_size > 0 && mprotect(mapping, guard_size, PROT_NONE) == -1) {
+    munmap(mapping, guard_size + usable_size);
+    return NULL;
+  }
+  char *stack = mapping + guard_size;
+  VALGRIND_STACK_REGISTER(stack, stack + usable_size);
+  return stack;
+}
+
+bool stack_get_n(char **stacks, size_t n) {
+  size_t from_pool = n < pool_count ? n : pool_count;
+  size_t fresh = n - from_pool;
+  size_t size = guard_size + usable_size;
+  char *mapping = NULL;
+  if (fresh > 0) {
+    // any part of a mapping can be unmapped on its own, so these go back
+    // one at a time like any other
+    mapping = mmap(NULL, fresh * size, PROT_READ | PROT_WRITE, map_flags,
+                   -1, 0);
+    if (mapping == MAP_FAILED) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < fresh; i++) {
+    if (guard_size > 0 && mprotect(mapping + i * size, guard_size,
+                                   PROT_NONE) == -1) {
+      munmap(mapping, fresh * size);
+      return false;
+    }
+    char *stack = mapping + i * size + guard_size;
+    VALGRIND_STACK_REGISTER(stack, stack + usable_size);
+    stacks[from_pool + i] = stack;
+  }
+  for (size_t i = 0; i < from_pool; i++) {
+    stacks[i] = pool[--pool_count];
+  }
+  return true;
+}
+
+void stack_put(char *stack) {
+  if (pool != NULL && pool_count < pool_capacity) {
+    // the next thread touches the top page right away, so that one stays
+    if (release_pages && usable_size > page_size) {
+      madvise(stack, usable_size - page_size, MADV_DONTNEED);
+    }
+    pool[pool_count++] = stack;
+    return;
+  }
+  munmap(stack - guard_size, guard_size + usable_size);
+}
+
+size_t stack_resident(char *stack) {
+  unsigned char pages[256];
+  size_t count = usable_size / page_size;
+  size_t resident = 0;
+  for (size_t done = 0; done < count; done += sizeof(pages)) {
+    size_t chunk = count - done < sizeof(pages) ? count - done : sizeof(pages);
+    if (mincore(stack + done * page_size, chunk * page_size, pages) == -1) {
+      break;
+    }
+    for (size_t i = 0; i < chunk; i++) {
+      resident += pages[i] & 1;
+    }
+  }
+  return resident * page_size;
+}
@@ -0,0 +1,37 @@
+#ifndef WUT_STACK_H
+#define WUT_STACK_H
+
+#include <stdbool.h> // bool
+#include <stddef.h> // size_t
+
+// Thread stacks, each with a PROT_NONE guard page below it so running off
+// the end faults instead of overwriting whatever is mapped there. Stacks of
+// threads that are done go back into a pool, so a create/join loop doesn't
+// mmap, mprotect and munmap for every thread.
+
+// set the usable size of every stack, rounded up to whole pages, how
+// many free stacks the pool keeps around at most and whether they get a
+// guard page. Lazy stacks are mapped with MAP_NORESERVE, so only the pages
+// a thread touches count against memory. With release, a stack that goes
+// back to the pool gives its pages back with MADV_DONTNEED
+void stack_pool_init(size_t size, size_t cache, int guard, int lazy,
+                     int release);
+
+// the usable size of the stacks from stack_get
+size_t stack_size(void);
+
+// returns the lowest usable address of a stack, or NULL with errno set
+char *stack_get(void);
+
+// get n stacks at once into stacks, the ones the pool doesn't have come
+// out of a single mmap. Returns false with errno set if that fails, and
+// then there's none to hand back
+bool stack_get_n(char **stacks, size_t n);
+
+// hand a stack from stack_get back, it goes to the pool if there's room
+void stack_put(char *stack);
+
+// how many bytes of a stack are resident in memory
+size_t stack_resident(char *stack);
+
+#endif
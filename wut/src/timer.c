@@ -0,0 +1,209 @@
+#include "timer.h"
+#include <stdio.h>  // perror
+#include <stdlib.h> // calloc, reallocarray, exit
+#include <time.h>   // clock_gettime
+
+#define LEVEL_BITS 6
+#define SLOTS (1 << LEVEL_BITS)
+// enough levels for any tick of a 64 bit deadline
+#define LEVELS ((64 - TIMER_TICK_SHIFT + LEVEL_BITS - 1) / LEVEL_BITS)
+
+// Nodes are allocated in chunks per range of ids, like the tcb
+#define NODE_CHUNK_SHIFT 10
+#define NODE_CHUNK_SIZE (1 << NODE_CHUNK_SHIFT)
+
+// The timer of a thread, in a doubly linked list of ids per slot
+struct node {
+  int next;
+  int previous;
+  // level * SLOTS + index, or -1 without a timer
+  int slot;
+  uint64_t tick;
+};
+
+atomic_int timer_count;
+atomic_uint_fast64_t timer_deadline = UINT64_MAX;
+
+static struct node **chunks;
+static int chunk_count;
+
+// The first id in every slot or -1, and a bit per non-empty slot
+static int heads[LEVELS * SLOTS];
+static uint64_t occupied[LEVELS];
+
+// Every timer up to this tick has expired
+static uint64_t now_tick;
+
+uint64_t timer_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static struct node *get_node(int id) {
+  int chunk = id >> NODE_CHUNK_SHIFT;
+  if (chunk >= chunk_count) {
+    int count = chunk_count == 0 ? 16 : chunk_count;
+    while (count <= chunk) {
+      count <<= 1;
+    }
+    struct node **grown = reallocarray(chunks, count, sizeof(struct node *));
+    if (grown == NULL) {
+      perror("timer node chunks re-alloc failed");
+      exit(1);
+    }
+    for (int i = chunk_count; i < count; i++) {
+      grown[i] = NULL;
+    }
+    if (chunk_count == 0) {
+      for (int i = 0; i < LEVELS * SLOTS; i++) {
+        heads[i] = -1;
+      }
+    }
+    chunks = grown;
+    chunk_count = count;
+  }
+  if (chunks[chunk] == NULL) {
+    chunks[chunk] = calloc(NODE_CHUNK_SIZE, sizeof(struct node));
+    if (chunks[chunk] == NULL) {
+      perror("timer node chunk calloc failed");
+      exit(1);
+    }
+    for (int i = 0; i < NODE_CHUNK_SIZE; i++) {
+      chunks[chunk][i].slot = -1;
+    }
+  }
+  return &chunks[chunk][id & (NODE_CHUNK_SIZE - 1)];
+}
+
+static void link(int id, struct node *node) {
+  uint64_t tick = node->tick < now_tick ? now_tick : node->tick;
+  int level = 0;
+  if (tick != now_tick) {
+    // the highest level where tick and now_tick differ
+    level = (63 - __builtin_clzll(tick ^ now_tick)) / LEVEL_BITS;
+  }
+  int index = (tick >> (LEVEL_BITS * level)) & (SLOTS - 1);
+  node->slot = level * SLOTS + index;
+  node->previous = -1;
+  node->next = heads[node->slot];
+  if (node->next != -1) {
+    get_node(node->next)->previous = id;
+  }
+  heads[node->slot] = id;
+  occupied[level] |= (uint64_t) 1 << index;
+}
+
+static void unlink(struct node *node) {
+  if (node->previous != -1) {
+    get_node(node->previous)->next = node->next;
+  }
+  else {
+    heads[node->slot] = node->next;
+  }
+  if (node->next != -1) {
+    get_node(node->next)->previous = node->previous;
+  }
+  if (heads[node->slot] == -1) {
+    occupied[node->slot / SLOTS] &= ~((uint64_t) 1 << (node->slot % SLOTS));
+  }
+  node->slot = -1;
+}
+
+// The first tick of the earliest non-empty slot, UINT64_MAX if there's
+// none. Every slot in use on a level is after the current tick, so the
+// lowest bit is the earliest one of that level
+static uint64_t next_slot(int *level_out) {
+  uint64_t earliest = UINT64_MAX;
+  for (int level = 0; level < LEVELS; level++) {
+    if (occupied[level] == 0) {
+      continue;
+    }
+    int shift = LEVEL_BITS * level;
+    uint64_t start = now_tick & ~(((uint64_t) 1 << (shift + LEVEL_BITS)) - 1);
+    start |= (uint64_t) __builtin_ctzll(occupied[level]) << shift;
+    if (start < earliest) {
+      earliest = start;
+      *level_out = level;
+    }
+  }
+  return earliest;
+}
+
+static void update_deadline(void) {
+  int level;
+  uint64_t tick = next_slot(&level);
+  atomic_store_explicit(&timer_deadline,
+                        tick == UINT64_MAX ? UINT64_MAX
+                                           : tick << TIMER_TICK_SHIFT,
+                        memory_order_relaxed);
+}
+
+void timer_add(int id, uint64_t deadline) {
+  struct node *node = get_node(id);
+  if (atomic_load_explicit(&timer_count, memory_order_relaxed) == 0) {
+    // nothing can expire in between, so skip right to now
+    now_tick = timer_now() >> TIMER_TICK_SHIFT;
+  }
+  // that's forever anyway, and it keeps the tick within the levels
+  if (deadline > UINT64_MAX >> 1) {
+    deadline = UINT64_MAX >> 1;
+  }
+  // round up so it never expires early
+  node->tick = (deadline >> TIMER_TICK_SHIFT)
+               + ((deadline & ((1 << TIMER_TICK_SHIFT) - 1)) != 0);
+  link(id, node);
+  atomic_fetch_add_explicit(&timer_count, 1, memory_order_relaxed);
+  if (node->tick << TIMER_TICK_SHIFT
+      < atomic_load_explicit(&timer_deadline, memory_order_relaxed)) {
+    update_deadline();
+  }
+}
+
+void timer_remove(int id) {
+  if (id >> NODE_CHUNK_SHIFT >= chunk_count) {
+    return;
+  }
+  struct node *node = get_node(id);
+  if (node->slot == -1) {
+    return;
+  }
+  unlink(node);
+  if (atomic_fetch_sub_explicit(&timer_count, 1, memory_order_relaxed) == 1) {
+    atomic_store_explicit(&timer_deadline, UINT64_MAX, memory_order_relaxed);
+  }
+  // otherwise timer_deadline may be early now, which only costs a look
+}
+
+void timer_expire(uint64_t now, void (*wake)(int id)) {
+  uint64_t target = now >> TIMER_TICK_SHIFT;
+  // jump from slot to slot instead of tick to tick, so a long sleep costs
+  // nothing if no timer is due in between
+  int level;
+  uint64_t start;
+  while ((start = next_slot(&level)) <= target) {
+    now_tick = start;
+    int index = (start >> (LEVEL_BITS * level)) & (SLOTS - 1);
+    int id = heads[level * SLOTS + index];
+    heads[level * SLOTS + index] = -1;
+    occupied[level] &= ~((uint64_t) 1 << index);
+    while (id != -1) {
+      struct node *node = get_node(id);
+      int next = node->next;
+      if (level == 0) {
+        node->slot = -1;
+        atomic_fetch_sub_explicit(&timer_count, 1, memory_order_relaxed);
+        wake(id);
+      }
+      else {
+        // the current tick is in its slot now, so it goes a level down
+        link(id, node);
+      }
+      id = next;
+    }
+  }
+  if (target > now_tick) {
+    now_tick = target;
+  }
+  update_deadline();
+}
@@ -0,0 +1,37 @@
+#ifndef WUT_TIMER_H
+#define WUT_TIMER_H
+
+#include <stdatomic.h> // atomic_*
+#include <stdint.h>    // uint64_t
+
+// A hierarchical timer wheel of threads waiting for a deadline. Time is
+// counted in ticks of 2^TIMER_TICK_SHIFT ns, every level has 64 slots and a
+// slot on level l spans 64^l ticks. A timer sits on the lowest level whose
+// slot tells it apart from the current tick, and moves down when the
+// current tick gets into its slot, so adding and removing one is O(1) and
+// every timer moves at most once per level before it expires. Like the
+// reactor it only knows thread ids; with several workers the scheduler
+// lock protects it.
+
+#define TIMER_TICK_SHIFT 10
+
+// How many threads wait for a deadline
+extern atomic_int timer_count;
+
+// The earliest deadline in ns or a little before it, UINT64_MAX without
+// timers. Can be read without the scheduler lock
+extern atomic_uint_fast64_t timer_deadline;
+
+// the current CLOCK_MONOTONIC time in ns
+uint64_t timer_now(void);
+
+// wake thread id at deadline, which may have passed already
+void timer_add(int id, uint64_t deadline);
+
+// forget the timer of thread id, if it has one
+void timer_remove(int id);
+
+// call wake for every thread whose deadline is not after now
+void timer_expire(uint64_t now, void (*wake)(int id));
+
+#endif
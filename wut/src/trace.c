@@ -0,0 +1,193 @@
+#include "trace.h"
+#include "timer.h"
+#include <pthread.h> // pthread_mutex_*
+#include <stdio.h>   // fopen, fprintf, perror
+#include <stdlib.h>  // calloc, reallocarray, exit
+
+enum event_kind {
+  EVENT_RUN,   // thread id ran for duration
+  EVENT_JOIN,  // thread id waited duration to join thread value
+  EVENT_READY, // value threads were ready on the worker
+};
+
+struct event {
+  uint64_t time;
+  uint64_t duration;
+  int id;
+  int value;
+  enum event_kind kind;
+};
+
+// A worker's events. Only that worker appends to it, the lock is for
+// trace_write
+struct buffer {
+  pthread_mutex_t lock;
+  struct event *events;
+  size_t count;
+  size_t capacity;
+  uint64_t switches;
+} __attribute__((aligned(64)));
+
+static struct buffer *buffers;
+static int buffer_count;
+
+// Event times are written relative to this
+static uint64_t epoch;
+
+void trace_init(int workers) {
+  buffers = calloc(workers, sizeof(struct buffer));
+  if (buffers == NULL) {
+    perror("trace buffers calloc failed");
+    exit(1);
+  }
+  for (int i = 0; i < workers; i++) {
+    pthread_mutex_init(&buffers[i].lock, NULL);
+  }
+  buffer_count = workers;
+  epoch = timer_now();
+}
+
+static void record(struct buffer *buffer, struct event event) {
+  if (buffer->count == buffer->capacity) {
+    size_t capacity = buffer->capacity == 0 ? 1024 : buffer->capacity * 2;
+    struct event *grown = reallocarray(buffer->events, capacity,
+                                       sizeof(struct event));
+    if (grown == NULL) {
+      perror("trace events re-alloc failed");
+      exit(1);
+    }
+    buffer->events = grown;
+    buffer->capacity = capacity;
+  }
+  buffer->events[buffer->count++] = event;
+}
+
+// the halves of a switch, with the buffer locked
+static void stopped(struct buffer *buffer, int worker, int id,
+                    struct trace_thread *thread, uint64_t now) {
+  uint64_t duration = now - thread->started;
+  thread->run_ns += duration;
+  record(buffer, (struct event) {
+    .time = thread->started, .duration = duration, .id = id,
+    .value = worker, .kind = EVENT_RUN,
+  });
+  thread->started = 0;
+}
+
+static void started(struct buffer *buffer, struct trace_thread *thread,
+                    long ready, uint64_t now) {
+  thread->started = now;
+  thread->runs++;
+  buffer->switches++;
+  record(buffer, (struct event) {
+    .time = now, .value = (int) ready, .kind = EVENT_READY,
+  });
+}
+
+void trace_start(int worker, struct trace_thread *thread, long ready) {
+  uint64_t now = timer_now();
+  struct buffer *buffer = &buffers[worker];
+  pthread_mutex_lock(&buffer->lock);
+  started(buffer, thread, ready, now);
+  pthread_mutex_unlock(&buffer->lock);
+}
+
+void trace_stop(int worker, int id, struct trace_thread *thread) {
+  if (thread->started == 0) {
+    return;
+  }
+  uint64_t now = timer_now();
+  struct buffer *buffer = &buffers[worker];
+  pthread_mutex_lock(&buffer->lock);
+  stopped(buffer, worker, id, thread, now);
+  pthread_mutex_unlock(&buffer->lock);
+}
+
+void trace_switch(int worker, int from_id, struct trace_thread *from,
+                  struct trace_thread *to, long ready) {
+  uint64_t now = timer_now();
+  struct buffer *buffer = &buffers[worker];
+  pthread_mutex_lock(&buffer->lock);
+  if (from->started != 0) {
+    stopped(buffer, worker, from_id, from, now);
+  }
+  started(buffer, to, ready, now);
+  pthread_mutex_unlock(&buffer->lock);
+}
+
+void trace_join_start(struct trace_thread *thread) {
+  thread->blocked = timer_now();
+}
+
+void trace_join_end(int worker, int id, struct trace_thread *thread,
+                    int target) {
+  uint64_t duration = timer_now() - thread->blocked;
+  thread->join_ns += duration;
+  struct buffer *buffer = &buffers[worker];
+  pthread_mutex_lock(&buffer->lock);
+  record(buffer, (struct event) {
+    .time = thread->blocked, .duration = duration, .id = id,
+    .value = target, .kind = EVENT_JOIN,
+  });
+  pthread_mutex_unlock(&buffer->lock);
+}
+
+// in the µs the format wants, relative to epoch
+static double micros(uint64_t ns) {
+  return (ns > epoch ? ns - epoch : 0) / 1e3;
+}
+
+static void write_event(FILE *file, int worker, const struct event *event) {
+  switch (event->kind) {
+  case EVENT_RUN:
+    fprintf(file, ",\n{\"name\":\"run\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+            "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"worker\":%d}}",
+            event->id, micros(event->time), event->duration / 1e3,
+            event->value);
+    break;
+  case EVENT_JOIN:
+    fprintf(file, ",\n{\"name\":\"join\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+            "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"thread\":%d}}",
+            event->id, micros(event->time), event->duration / 1e3,
+            event->value);
+    break;
+  case EVENT_READY:
+    fprintf(file, ",\n{\"name\":\"ready on worker %d\",\"ph\":\"C\","
+            "\"pid\":0,\"ts\":%.3f,\"args\":{\"threads\":%d}}",
+            worker, micros(event->time), event->value);
+    break;
+  }
+}
+
+int trace_write(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    return -1;
+  }
+  for (int i = 0; i < buffer_count; i++) {
+    pthread_mutex_lock(&buffers[i].lock);
+  }
+  fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+          "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+          "\"args\":{\"name\":\"wut\"}}");
+  uint64_t switches = 0;
+  for (int i = 0; i < buffer_count; i++) {
+    struct buffer *buffer = &buffers[i];
+    for (size_t j = 0; j < buffer->count; j++) {
+      write_event(file, i, &buffer->events[j]);
+    }
+    switches += buffer->switches;
+    buffer->count = 0;
+    buffer->switches = 0;
+  }
+  fprintf(file, "\n],\"otherData\":{\"switches\":\"%llu\"}}\n",
+          (unsigned long long) switches);
+  for (int i = 0; i < buffer_count; i++) {
+    pthread_mutex_unlock(&buffers[i].lock);
+  }
+  int failed = ferror(file);
+  if (fclose(file) != 0 || failed) {
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,52 @@
+#ifndef WUT_TRACE_H
+#define WUT_TRACE_H
+
+#include <stdint.h> // uint64_t
+
+// Scheduler events for wut_trace_write, only with -DWUT_TRACE. Every
+// worker records when each thread it runs starts and stops, how many
+// threads are ready on it at every switch, and how long threads wait in
+// join, into a buffer of its own. Without WUT_TRACE, TRACE drops the hooks
+// before they're compiled, so they cost nothing, not even a branch.
+
+#ifdef WUT_TRACE
+#define TRACE(hook) hook
+#else
+#define TRACE(hook) ((void) 0)
+#endif
+
+// What a thread did so far, in its tcb
+struct trace_thread {
+  uint64_t started; // when it last started running, 0 while it isn't
+  uint64_t blocked; // when it started waiting in join
+  uint64_t runs;
+  uint64_t run_ns;
+  uint64_t join_ns;
+};
+
+// make room for the events of this many workers
+void trace_init(int workers);
+
+// thread starts running on worker, with ready threads waiting there
+void trace_start(int worker, struct trace_thread *thread, long ready);
+
+// thread id stops running on worker, if it was running
+void trace_stop(int worker, int id, struct trace_thread *thread);
+
+// thread from_id stops running on worker and thread to starts, the two
+// above with one clock read
+void trace_switch(int worker, int from_id, struct trace_thread *from,
+                  struct trace_thread *to, long ready);
+
+// thread starts waiting in join
+void trace_join_start(struct trace_thread *thread);
+
+// thread id on worker is done waiting in join for thread target
+void trace_join_end(int worker, int id, struct trace_thread *thread,
+                    int target);
+
+// write the events so far as Chrome trace-event JSON and forget them,
+// returns -1 with errno set if that fails
+int trace_write(const char *path);
+
+#endif
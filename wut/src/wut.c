@@ -1,56 +1,216 @@
 #include "wut.h"
+#include "context.h"
+#include "deque.h"
+#include "preempt.h"
+#include "reactor.h"
+#include "stack.h"
+#include "timer.h"
+#include "trace.h"
 #include <assert.h>     // assert
 #include <errno.h>      // errno
+#include <limits.h>     // INT_MAX
+#include <pthread.h>    // pthread_*
+#include <sched.h>      // sched_yield
+#include <stdatomic.h>  // atomic_*
+#include <stdbool.h>    // bool
 #include <stddef.h>     // NULL
+#include <stdint.h>     // uint64_t, UINT64_MAX
 #include <stdio.h>      // perror
 #include <stdlib.h>     // reallocarray
-#include <sys/mman.h>   // mmap, munmap
+#include <string.h>     // memset
 #include <sys/queue.h>  // TAILQ_*
-#include <sys/signal.h> // SIGSTKSZ
+#include <sys/socket.h> // accept
 #include <sys/types.h>
-#include <sys/ucontext.h>
-#include <ucontext.h> // getcontext, makecontext, setcontext, swapcontext
-#include <valgrind/valgrind.h> // VALGRIND_STACK_REGISTER
+#include <time.h>       // clock_gettime, clock_nanosleep
+#include <unistd.h>     // read, write, close
 
 
-double load_factor = 0.9;
+// Thread control blocks are allocated in chunks of this many, and a
+// chunk never moves once it's allocated
+#define TCB_CHUNK_SHIFT 10
+#define TCB_CHUNK_SIZE (1 << TCB_CHUNK_SHIFT)
 
+TAILQ_HEAD(queue_head, TCB);
 
-struct queue_entry {
-  int id;
-  TAILQ_ENTRY(queue_entry) pointers;
-};
-
-TAILQ_HEAD(queue_head, queue_entry);
-
-// A FIFO Queue that keeps track of runnable threads
+// A FIFO Queue that keeps track of runnable threads, with a single
+// worker
 struct queue_head queue_head;
 
+// Every thread is in exactly one of these states. With a single
+// worker, only READY threads are in the FIFO queue, and only the
+// current thread is RUNNING. With several, a thread stays READY
+// while it runs, only its worker knows that it's running
+enum state {
+  STATE_FREE,       // the id can be handed out by wut_create
+  STATE_RUNNING,
+  STATE_READY,
+  STATE_BLOCKED,    // waiting in wut_join, maybe with a deadline
+  STATE_WAITING,    // waiting for an fd in the reactor
+  STATE_SLEEPING,   // waiting for a deadline in wut_sleep_ns
+  STATE_PARKED,     // waiting in a mutex, cond, sem or barrier queue
+  STATE_SELECTING,  // waiting to send or receive on channels
+  STATE_TERMINATED, // exited or cancelled, waiting to be joined
+};
 
+// Everything a switch touches is in the TCB itself, and with the
+// assembly switch the whole TCB fits in one cache line, unless it
+// has room for the trace too
 struct TCB {
+  struct wut_context context;
   char *stack;
-  ucontext_t *context;
-  struct queue_entry entry;
-  void (*pointer)(void);
+  // in the ready queue, or the wut_queue it's PARKED in
+  TAILQ_ENTRY(TCB) pointers;
+  union {
+    void (*pointer)(void); // until it starts
+    void *result; // once it's TERMINATED
+  };
+  union {
+    int joining;    // the thread this one waits to join, or -1
+    int waiting_fd; // the fd this one waits for, when it's WAITING
+    struct wut_queue *parked_in; // when it's PARKED
+    struct wut_select *selecting; // when it's SELECTING
+  };
   int id;
-  int run;
-  int available;
-  int blocker_id;
-  int blocked_id;
+  int joined_by; // the thread waiting to join this one, or -1
   int status;
+  short preempt_depth; // while it's switched out
+  atomic_bool cancel_pending; // it runs on another worker right now
+  unsigned char state; // an enum state, a byte is all there's room for
+#ifdef WUT_TRACE
+  struct trace_thread trace;
+#endif
+} __attribute__((aligned(64)));
+
+// What a worker's scheduler does with the thread that just switched
+// to it, once that thread is no longer running on its own stack
+enum after_switch {
+  AFTER_NOTHING,
+  AFTER_UNLOCK, // it blocked or exited with scheduler_lock held
+  AFTER_YIELD,  // it's still ready, but something else runs first
+};
+
+// A kernel thread that runs wut threads. With a single worker it's
+// just the thread that called wut_init, and threads switch straight
+// to each other. With several, every worker has a scheduler that
+// threads switch to when they stop running, and which picks the next
+// one from its own deque, or steals one from another worker's
+struct worker {
+  struct deque ready;
+  struct wut_context scheduler;
+  struct TCB *current;
+  enum after_switch after;
+  int index;
+  int next_victim;
+  // counts switches, to check the reactor and the timers every so
+  // often
+  unsigned switches;
+} __attribute__((aligned(64)));
+
+// Idle workers spin this many rounds of stealing before they sleep
+#define IDLE_SPINS 64
+
+// While threads wait for I/O, the reactor is checked every this many
+// switches even if there's always a thread ready, a power of two
+#define REACTOR_POLL_INTERVAL 64
+
+// While threads wait for a deadline, the clock is read every this
+// many switches, or whenever no thread is ready, a power of two.
+// Reading it costs more than a switch
+#define TIMER_CHECK_INTERVAL 16
+
+// How many ready fds the reactor hands over at once
+#define REACTOR_EVENTS 64
+
+// Idle workers wake up at least this often, in ns
+#define IDLE_TIMEOUT 1000000
+
+// A join without a deadline
+#define NO_DEADLINE UINT64_MAX
+
+// A thread waiting in wut_chan_select, or to send or receive, which
+// is the same with a single case. It's on the waiting thread's stack
+struct wut_select {
+  struct TCB *thread;
+  struct wut_chan_case *cases;
+  int count;
+  int done; // the case that went, once one did
+};
+
+// The cases waiting on one side of a channel, oldest first
+struct case_queue {
+  struct wut_chan_case *first;
+  struct wut_chan_case **last;
 };
 
-// A thread control block pointer that keeps track of various
-// information about threads
-struct TCB *tcb;
+// The values in the buffer are a ring of capacity slots, it only
+// grows if the channel is unbounded
+struct wut_chan {
+  size_t size;
+  size_t limit; // at most this many values, or WUT_CHAN_UNBOUNDED
+  size_t capacity;
+  size_t head;
+  size_t count;
+  char *buffer;
+  bool closed;
+  struct case_queue senders;
+  struct case_queue receivers;
+};
+
+// The stack for the first worker's scheduler, the others run it on
+// their own kernel thread's stack
+#define SCHEDULER_STACK_SIZE (64 * 1024)
+
+struct worker *workers;
+int worker_count = 1;
+
+// Which worker the calling kernel thread is, with several. This is
+// looked up through libc every time since a wut thread can move to
+// another kernel thread whenever it switches, and the compiler would
+// assume a _Thread_local variable stays at the same address
+pthread_key_t worker_key;
+
+// Protects everything but the deques with several workers: thread
+// states, the tcb, the free ids and the stack pool
+pthread_mutex_t scheduler_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The number of threads that are READY or RUNNING, with several
+// workers
+int runnable = 0;
+
+#ifdef WUT_TRACE
+// How many threads are in the FIFO queue, with a single worker
+long queue_length = 0;
+#endif
+
+// With several workers, one idle worker at a time waits for the
+// reactor instead of sleeping
+atomic_bool polling = false;
+
+// Idle workers sleep on this until a thread becomes ready
+atomic_int sleeping = 0;
+pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
 
-// The size of the tcb array to be implmented
-int size = 256;
+// The chunks of thread control blocks that keep track of various
+// information about threads, thread `id` is at offset
+// `id % TCB_CHUNK_SIZE` of chunk `id / TCB_CHUNK_SIZE`. Only this
+// array of chunk pointers gets re-allocated as it grows. Chunks are
+// never freed, so together with the stack pool, creating a thread in
+// place of one that has been joined allocates nothing
+struct TCB **tcb_chunks;
 
-// The number of lots that have been used at least once in tcb
-// array
+// The number of chunks tcb_chunks has room for
+int chunk_capacity = 0;
+
+// The number of ids that have been used at least once
 int count = 0;
 
+// A min-heap of the ids below count that are free again, so the
+// lowest one is always at the top
+int *free_heap;
+int free_heap_size = 0;
+int free_heap_capacity = 0;
+
 //print error messages and exit
 static void die(const char *message) {
   int err = errno;
@@ -58,277 +218,1648 @@ static void die(const char *message) {
   exit(err);
 }
 
-//allocate a new stack on heap
+//get a stack from the pool, or a new one
 static char *new_stack(void) {
-  char *stack = mmap(NULL, SIGSTKSZ, PROT_READ | PROT_WRITE | PROT_EXEC,
-                     MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-  if (stack == MAP_FAILED) {
+  char *stack = stack_get();
+  if (stack == NULL) {
     die("mmap stack failed");
   }
-  VALGRIND_STACK_REGISTER(stack, stack + SIGSTKSZ);
   return stack;
 }
 
-//check the number of used threads in tcb
-//and re-size the array if necessary
-void check_and_resize_tcb() {
-  if (count > size * load_factor) {
-    size = size << 2;
-    tcb = reallocarray(tcb, size, sizeof(struct TCB));
-    if (tcb == NULL) {
-      die("tcb re-alloc failed\n");
+//get the thread control block of an id below count
+static struct TCB *get_tcb(int id) {
+  return &tcb_chunks[id >> TCB_CHUNK_SHIFT][id & (TCB_CHUNK_SIZE - 1)];
+}
+
+//make room for the thread control block of id count, by
+//allocating a new chunk if the last one is full
+static void grow_tcb(void) {
+  int chunk = count >> TCB_CHUNK_SHIFT;
+  if ((count & (TCB_CHUNK_SIZE - 1)) != 0) {
+    return;
+  }
+  if (chunk == chunk_capacity) {
+    chunk_capacity = chunk_capacity == 0 ? 16 : chunk_capacity << 1;
+    tcb_chunks = reallocarray(tcb_chunks, chunk_capacity,
+                              sizeof(struct TCB *));
+    if (tcb_chunks == NULL) {
+      die("tcb chunks re-alloc failed");
     }
   }
+  tcb_chunks[chunk] = aligned_alloc(_Alignof(struct TCB),
+                                    TCB_CHUNK_SIZE * sizeof(struct TCB));
+  if (tcb_chunks[chunk] == NULL) {
+    die("tcb chunk alloc failed");
+  }
 }
 
-//check if a thread assosciated with the
-//id is in the FIFO queue
-int id_in_ready_queue(int id) {
-  struct queue_entry *entry;
-  if (TAILQ_EMPTY(&queue_head)) {
-    return 0;
+//add a free id to the min-heap
+static void free_heap_push(int id) {
+  if (free_heap_size == free_heap_capacity) {
+    free_heap_capacity = free_heap_capacity == 0 ? 256
+                                                 : free_heap_capacity << 1;
+    free_heap = reallocarray(free_heap, free_heap_capacity, sizeof(int));
+    if (free_heap == NULL) {
+      die("free id heap re-alloc failed");
+    }
+  }
+  int i = free_heap_size++;
+  while (i > 0 && free_heap[(i - 1) / 2] > id) {
+    free_heap[i] = free_heap[(i - 1) / 2];
+    i = (i - 1) / 2;
   }
+  free_heap[i] = id;
+}
 
-  if (queue_head.tqh_first == *(queue_head.tqh_last)) {
-    if (queue_head.tqh_first->id != id)
-      return 0;
+//remove the lowest free id from the min-heap, which must not be
+//empty, and return it
+static int free_heap_pop(void) {
+  int lowest = free_heap[0];
+  int last = free_heap[--free_heap_size];
+  int i = 0;
+  for (;;) {
+    int child = 2 * i + 1;
+    if (child >= free_heap_size) {
+      break;
+    }
+    if (child + 1 < free_heap_size && free_heap[child + 1] < free_heap[child]) {
+      child++;
+    }
+    if (free_heap[child] >= last) {
+      break;
+    }
+    free_heap[i] = free_heap[child];
+    i = child;
   }
+  free_heap[i] = last;
+  return lowest;
+}
+
+//Delete a stack, or keep it for the next thread
+static void delete_stack(char *stack) {
+  stack_put(stack);
+}
 
-  TAILQ_FOREACH(entry, &queue_head, pointers) {
-    if (entry->id == id)
-      return 1;
+//the worker the calling kernel thread runs
+static struct worker *this_worker(void) {
+  if (worker_count == 1) {
+    return workers;
   }
-  return 0;
+  return pthread_getspecific(worker_key);
 }
 
+//the thread that is running right now
+static struct TCB *current(void) {
+  return this_worker()->current;
+}
 
-//Delete a stack
-static void delete_stack(char *stack) {
-  if (munmap(stack, SIGSTKSZ) == -1) {
-    die("munmap stack failed");
+//with several workers, only one kernel thread at a time may
+//change the state of threads
+static void lock_scheduler(void) {
+  if (worker_count > 1) {
+    pthread_mutex_lock(&scheduler_lock);
   }
 }
 
-//run the function passed in
-//to the current running thread
-//in FIFO queue and call wut_eixt
-//if it has been called
-void run_and_switch() {
-  int current_id = wut_id();
-  tcb[current_id].pointer();
-  if (tcb[current_id].status == -1) {
-    wut_exit(0);
+static void unlock_scheduler(void) {
+  if (worker_count > 1) {
+    pthread_mutex_unlock(&scheduler_lock);
+  }
+}
+
+//push a thread onto a worker's deque, and wake up a worker
+//that sleeps for lack of work to steal it
+static void push_ready(struct worker *worker, struct TCB *thread) {
+  deque_push(&worker->ready, thread);
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&sleeping, memory_order_relaxed) > 0) {
+    pthread_mutex_lock(&idle_lock);
+    pthread_cond_signal(&idle_cond);
+    pthread_mutex_unlock(&idle_lock);
+  }
+}
+
+//add a thread to the back of the FIFO queue, or with several
+//workers, onto this worker's deque
+static void make_ready(struct TCB *thread) {
+  thread->state = STATE_READY;
+  if (worker_count == 1) {
+    TAILQ_INSERT_TAIL(&queue_head, thread, pointers);
+    TRACE(queue_length++);
+    return;
+  }
+  runnable++;
+  push_ready(this_worker(), thread);
+}
+
+//make a thread whose fd is ready READY again
+static void wake(int id) {
+  make_ready(get_tcb(id));
+}
+
+//make the threads whose fds are ready READY, waiting up to
+//timeout_ms for any to be
+static void poll_reactor(int timeout_ms) {
+  struct epoll_event events[REACTOR_EVENTS];
+  int count = reactor_collect(events, REACTOR_EVENTS, timeout_ms);
+  reactor_dispatch(events, count, wake);
+}
+
+//with several workers, check the reactor unless another worker
+//does already. Only handing out the threads takes the lock.
+//Returns whether any thread became ready
+static bool poll_reactor_unlocked(int timeout_ms) {
+  if (atomic_exchange(&polling, true)) {
+    return false;
+  }
+  struct epoll_event events[REACTOR_EVENTS];
+  int count = reactor_collect(events, REACTOR_EVENTS, timeout_ms);
+  if (count > 0) {
+    pthread_mutex_lock(&scheduler_lock);
+    reactor_dispatch(events, count, wake);
+    pthread_mutex_unlock(&scheduler_lock);
+  }
+  atomic_store(&polling, false);
+  return count > 0;
+}
+
+//whether any thread waits for I/O
+static bool io_waiting(void) {
+  return atomic_load_explicit(&reactor_waiting, memory_order_relaxed) != 0;
+}
+
+//whether any thread waits for a deadline
+static bool timers_waiting(void) {
+  return atomic_load_explicit(&timer_count, memory_order_relaxed) != 0;
+}
+
+//whether it's time to look at the timers again, on every
+//TIMER_CHECK_INTERVAL-th switch
+static bool timers_check(unsigned switch_count) {
+  return (switch_count & (TIMER_CHECK_INTERVAL - 1)) == 0 && timers_waiting();
+}
+
+//whether a deadline may have passed. Only reads the clock if a
+//thread waits for one
+static bool timers_due(void) {
+  uint64_t deadline = atomic_load_explicit(&timer_deadline,
+                                           memory_order_relaxed);
+  return deadline != UINT64_MAX && timer_now() >= deadline;
+}
+
+//make a thread whose deadline passed READY again. One that
+//waits in wut_join_timeout gives up joining, which it notices
+//by joining being -1
+static void expire(int id) {
+  struct TCB *thread = get_tcb(id);
+  if (thread->state == STATE_BLOCKED) {
+    get_tcb(thread->joining)->joined_by = -1;
+    thread->joining = -1;
+  }
+  make_ready(thread);
+}
+
+//make the threads whose deadline passed READY
+static void expire_timers(void) {
+  timer_expire(timer_now(), expire);
+}
+
+//with several workers, make the threads whose deadline passed
+//READY, if any may have
+static void expire_timers_unlocked(void) {
+  if (timers_due()) {
+    pthread_mutex_lock(&scheduler_lock);
+    expire_timers();
+    pthread_mutex_unlock(&scheduler_lock);
+  }
+}
+
+//the deadline `ns` from now, which can't wrap around
+static uint64_t deadline_after(uint64_t ns) {
+  uint64_t now = timer_now();
+  return ns < NO_DEADLINE - now ? now + ns : NO_DEADLINE - 1;
+}
+
+//make the thread that joins `thread` READY if there is one,
+//its deadline doesn't matter anymore
+static void wake_joiner(struct TCB *thread) {
+  if (thread->joined_by != -1) {
+    timer_remove(thread->joined_by);
+    make_ready(get_tcb(thread->joined_by));
+  }
+}
+
+//take a thread off this worker's deque, or steal one from
+//another worker's
+static struct TCB *find_work(struct worker *worker) {
+  struct TCB *thread = deque_pop(&worker->ready);
+  if (thread != NULL) {
+    return thread;
+  }
+  int start = worker->next_victim++;
+  for (int i = 0; i < worker_count - 1; i++) {
+    int victim = (start + i) % (worker_count - 1);
+    if (victim >= worker->index) {
+      victim++;
+    }
+    void *stolen;
+    do {
+      stolen = deque_steal(&workers[victim].ready);
+    } while (stolen == DEQUE_ABORT);
+    if (stolen != NULL) {
+      return stolen;
+    }
+  }
+  return NULL;
+}
+
+//take the thread that has been ready on this worker the longest,
+//from the end of the deque that thieves take from, or any other
+//work. A thread that yields goes behind all of them, rather than
+//trading places with the one that got ready last
+static struct TCB *find_oldest_work(struct worker *worker) {
+  void *thread;
+  do {
+    thread = deque_steal(&worker->ready);
+  } while (thread == DEQUE_ABORT);
+  if (thread != NULL) {
+    return thread;
+  }
+  return find_work(worker);
+}
+
+//find a thread to run, sleeping once there's been nothing for a
+//while, until the next deadline at the latest. The timeout covers
+//a wake-up that came in between looking and sleeping
+static struct TCB *wait_for_work(struct worker *worker) {
+  for (int spins = 0; ; spins++) {
+    struct TCB *thread = find_work(worker);
+    if (thread != NULL) {
+      return thread;
+    }
+    if (spins < IDLE_SPINS) {
+      sched_yield();
+      continue;
+    }
+    if (timers_due()) {
+      expire_timers_unlocked();
+      continue;
+    }
+    if (io_waiting() && poll_reactor_unlocked(1)) {
+      continue;
+    }
+    uint64_t timeout = IDLE_TIMEOUT;
+    uint64_t next = atomic_load_explicit(&timer_deadline,
+                                         memory_order_relaxed);
+    if (next != UINT64_MAX) {
+      uint64_t now = timer_now();
+      if (next < now + timeout) {
+        timeout = next > now ? next - now : 0;
+      }
+    }
+    pthread_mutex_lock(&idle_lock);
+    atomic_fetch_add(&sleeping, 1);
+    thread = find_work(worker);
+    if (thread == NULL) {
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_nsec += timeout;
+      if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&idle_cond, &idle_lock, &deadline);
+    }
+    atomic_fetch_sub(&sleeping, 1);
+    pthread_mutex_unlock(&idle_lock);
+    if (thread != NULL) {
+      return thread;
+    }
   }
-  exit(0);
+}
+
+//a worker's scheduler, threads switch to it when they stop
+//running. It never returns
+static void schedule(struct worker *worker) {
+  for (;;) {
+    struct TCB *next = NULL;
+    if (worker->after == AFTER_UNLOCK) {
+      pthread_mutex_unlock(&scheduler_lock);
+    }
+    else if (worker->after == AFTER_YIELD) {
+      next = find_oldest_work(worker);
+      if (next == NULL) {
+        next = worker->current;
+      }
+      else {
+        push_ready(worker, worker->current);
+      }
+    }
+    worker->after = AFTER_NOTHING;
+    unsigned switch_count = ++worker->switches;
+    if (io_waiting() && (switch_count & (REACTOR_POLL_INTERVAL - 1)) == 0) {
+      poll_reactor_unlocked(0);
+    }
+    if (timers_check(switch_count)) {
+      expire_timers_unlocked();
+    }
+    if (next == NULL) {
+      next = wait_for_work(worker);
+    }
+    worker->current = next;
+    TRACE(trace_start(worker->index, &next->trace,
+                      deque_size(&worker->ready)));
+    wut_context_switch(&worker->scheduler, &next->context);
+  }
+}
+
+//the first worker's scheduler runs on a stack of its own
+static void schedule_first_worker(void) {
+  schedule(workers);
+}
+
+//the other workers run their scheduler on their own kernel thread
+static void *worker_main(void *arg) {
+  struct worker *worker = arg;
+  pthread_setspecific(worker_key, worker);
+  schedule(worker);
+  return NULL;
+}
+
+//hand the control over to this worker's scheduler, which
+//does `after` once the current thread is switched out
+static void switch_to_scheduler(enum after_switch after) {
+  struct worker *worker = this_worker();
+  worker->after = after;
+  TRACE(trace_stop(worker->index, worker->current->id,
+                   &worker->current->trace));
+  wut_context_switch(&worker->current->context, &worker->scheduler);
+}
+
+//exit with 128 if another worker cancelled this thread while it
+//was running
+static void check_cancel(void) {
+  if (worker_count > 1
+      && atomic_load_explicit(&current()->cancel_pending,
+                              memory_order_relaxed)) {
+    wut_exit(128);
+  }
+}
+
+//hand the control over to the thread at the front of the FIFO
+//queue, which must not be empty. The caller has already set its
+//own state and disabled preemption, and continues once another
+//thread switches back to it
+static void switch_to_next(void) {
+  unsigned switch_count = ++this_worker()->switches;
+  if (io_waiting() && (switch_count & (REACTOR_POLL_INTERVAL - 1)) == 0) {
+    poll_reactor(0);
+  }
+  if (timers_check(switch_count) && timers_due()) {
+    expire_timers();
+  }
+  struct TCB *next = TAILQ_FIRST(&queue_head);
+  assert(next != NULL);
+  TAILQ_REMOVE(&queue_head, next, pointers);
+  TRACE(queue_length--);
+  struct worker *worker = this_worker();
+  struct TCB *curr = worker->current;
+  next->state = STATE_RUNNING;
+  // it waited for I/O, and that was all there was to wait for
+  if (next == curr) {
+    TRACE(trace_start(0, &curr->trace, queue_length));
+    return;
+  }
+  worker->current = next;
+  TRACE(trace_switch(0, curr->id, &curr->trace, &next->trace,
+                     queue_length));
+  curr->preempt_depth = atomic_load_explicit(&preempt_depth,
+                                             memory_order_relaxed);
+  wut_context_switch(&curr->context, &next->context);
+  atomic_store_explicit(&preempt_depth, curr->preempt_depth,
+                        memory_order_relaxed);
+}
+
+//sleep until deadline, or until an fd is ready before that if
+//threads wait for I/O
+static void wait_until(uint64_t deadline) {
+  uint64_t now = timer_now();
+  if (deadline <= now) {
+    return;
+  }
+  if (io_waiting()) {
+    uint64_t timeout_ms = (deadline - now + 999999) / 1000000;
+    poll_reactor(timeout_ms > INT_MAX ? INT_MAX : (int) timeout_ms);
+    return;
+  }
+  struct timespec ts = {
+    .tv_sec = deadline / 1000000000,
+    .tv_nsec = deadline % 1000000000,
+  };
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+//whether there's a thread to switch to with a single worker,
+//waiting for I/O or the next deadline if none is ready but some
+//wait for either
+static bool wait_for_ready(void) {
+  while (TAILQ_EMPTY(&queue_head)) {
+    // the worker waits then, not the thread
+    if (timers_waiting()) {
+      TRACE(trace_stop(0, current()->id, &current()->trace));
+      wait_until(atomic_load_explicit(&timer_deadline, memory_order_relaxed));
+      expire_timers();
+    }
+    else if (io_waiting()) {
+      TRACE(trace_stop(0, current()->id, &current()->trace));
+      poll_reactor(-1);
+    }
+    else {
+      return false;
+    }
+  }
+  return true;
+}
+
+//whether the current thread can wait for something without
+//waiting for good, since another thread can still run
+static bool can_block(void) {
+  if (worker_count == 1) {
+    return wait_for_ready();
+  }
+  return runnable > 1 || io_waiting() || timers_waiting();
+}
+
+//switch away from the current thread, which isn't READY anymore.
+//Returns once another thread made it ready again
+static void block(void) {
+  if (worker_count == 1) {
+    wait_for_ready();
+    switch_to_next();
+  }
+  else {
+    runnable--;
+    switch_to_scheduler(AFTER_UNLOCK);
+    lock_scheduler();
+  }
+}
+
+//run the function passed in to the current running
+//thread and exit with 0 if it returns. It starts out in
+//the section with preemption disabled that switched to it
+void run_and_switch() {
+  atomic_store_explicit(&preempt_depth, 1, memory_order_relaxed);
+  preempt_enable();
+  check_cancel();
+  current()->pointer();
+  wut_exit(0);
+}
+
+//What wut_create_arg passes on, at the top of the thread's
+//stack since the tcb has no room for it
+struct start_arg {
+  void *(*fn)(void *);
+  void *arg;
+} __attribute__((aligned(16)));
+
+static struct start_arg *start_arg(struct TCB *thread) {
+  return (struct start_arg *) (thread->stack + stack_size()) - 1;
+}
+
+//run the function passed to wut_create_arg with its
+//argument, and exit with what it returns
+void run_arg_and_switch() {
+  atomic_store_explicit(&preempt_depth, 1, memory_order_relaxed);
+  preempt_enable();
+  check_cancel();
+  struct start_arg *start = start_arg(current());
+  wut_exit_result(start->fn(start->arg));
 }
 
 //get the lowest available id
 //for use in wut_create
 int get_lowest_available_id() {
-  for (int i = 0; i < count; i++) {
-    if (tcb[i].available == 1)
-      return i;
+  if (free_heap_size == 0) {
+    grow_tcb();
+    return count;
   }
-  return count;
-}
-
-//tcb initialization 
-void tcb_init(int id, int run, void (*pointer)(void)) {
-  tcb[id].id = id;
-  tcb[id].stack = new_stack();
-  tcb[id].context = malloc(sizeof(ucontext_t));
-  tcb[id].context->uc_stack.ss_sp = tcb[id].stack;
-  tcb[id].context->uc_stack.ss_size = SIGSTKSZ;
-  tcb[id].pointer = pointer;
-  tcb[id].run = run;
-  tcb[id].entry.id = id;
-  tcb[id].available = 0;
-  tcb[id].status = -1;
-  tcb[id].blocker_id = -1;
-  tcb[id].blocked_id = -1;
+  return free_heap_pop();
+}
+
+//tcb initialization, the main thread runs on the
+//process stack so it doesn't get one
+void tcb_init(int id, enum state state, void (*pointer)(void)) {
   if (id == count) {
     count++;
   }
+  struct TCB *thread = get_tcb(id);
+  thread->id = id;
+  thread->stack = NULL;
+  if (pointer != NULL) {
+    thread->stack = new_stack();
+    wut_context_init(&thread->context, thread->stack, stack_size(),
+                     run_and_switch);
+  }
+  thread->pointer = pointer;
+  thread->state = state;
+  thread->status = -1;
+  thread->joined_by = -1;
+  thread->joining = -1;
+  thread->cancel_pending = false;
+  TRACE(thread->trace = (struct trace_thread) { 0 });
+}
+
+//tcb initialization for wut_create_arg, with a stack that's
+//already there
+static void tcb_init_arg(int id, void *(*fn)(void *), void *arg,
+                         char *stack) {
+  tcb_init(id, STATE_READY, NULL);
+  struct TCB *thread = get_tcb(id);
+  thread->stack = stack;
+  *start_arg(thread) = (struct start_arg) { .fn = fn, .arg = arg };
+  wut_context_init(&thread->context, stack,
+                   stack_size() - sizeof(struct start_arg),
+                   run_arg_and_switch);
+}
+
+//free what a thread still holds once it has terminated, its
+//stack is gone already if it got cancelled
+static void release(int id) {
+  struct TCB *thread = get_tcb(id);
+  if (thread->stack != NULL) {
+    delete_stack(thread->stack);
+    thread->stack = NULL;
+  }
 }
 
 //clean up a thread when it exits and gets acknowledgaed
-void tcb_cleanup(int id, int cancelled){
-  tcb[id].available = 1;
-  tcb[id].run = 0;
-  tcb[id].pointer = NULL;
-  if(cancelled == 1) return;
-  delete_stack(tcb[id].stack);
-  free(tcb[id].context);
+void tcb_cleanup(int id){
+  struct TCB *thread = get_tcb(id);
+  release(id);
+  thread->state = STATE_FREE;
+  free_heap_push(id);
+  thread->pointer = NULL;
 }
 
-//libarary initialization. We set main thread as thread 0
-//in tcb and allocate the tcb array on heap and setup the context
-//of thread 0
+//switch to the next thread once the running thread's time
+//slice is up, from the timer's signal handler
+static void preempt_yield(void) {
+  wut_yield();
+}
+
+//start the kernel threads of all workers but the first, which
+//is the one that called wut_init
+static void start_workers(const struct wut_config *config) {
+  if (config->preempt_quantum_us != 0) {
+    errno = EINVAL;
+    die("preemption needs a single worker");
+  }
+  get_tcb(0)->state = STATE_READY;
+  runnable = 1;
+  for (int i = 0; i < worker_count; i++) {
+    deque_init(&workers[i].ready, 256);
+  }
+  if (pthread_key_create(&worker_key, NULL) != 0) {
+    die("pthread_key_create failed");
+  }
+  pthread_setspecific(worker_key, workers);
+  char *stack = malloc(SCHEDULER_STACK_SIZE);
+  if (stack == NULL) {
+    die("scheduler stack malloc failed");
+  }
+  wut_context_init(&workers[0].scheduler, stack, SCHEDULER_STACK_SIZE,
+                   schedule_first_worker);
+  for (int i = 1; i < worker_count; i++) {
+    pthread_t thread;
+    errno = pthread_create(&thread, NULL, worker_main, &workers[i]);
+    if (errno != 0) {
+      die("pthread_create failed");
+    }
+    pthread_detach(thread);
+  }
+}
+
+//libarary initialization with the defaults
 void wut_init() {
+  struct wut_config config = { 0 };
+  wut_init_config(&config);
+}
+
+//libarary initialization. We set main thread as thread 0
+//in tcb and allocate the first chunk of the tcb on heap
+void wut_init_config(const struct wut_config *config) {
+  size_t stack_size = config->stack_size;
+  if (stack_size == 0) {
+    stack_size = config->lazy_stacks ? WUT_LAZY_STACK_SIZE
+                                     : WUT_DEFAULT_STACK_SIZE;
+  }
+  size_t stack_cache = config->stack_cache;
+  if (stack_cache == 0) {
+    stack_cache = WUT_DEFAULT_STACK_CACHE;
+  }
+  else if (stack_cache == WUT_NO_STACK_CACHE) {
+    stack_cache = 0;
+  }
+  stack_pool_init(stack_size, stack_cache, !config->no_guard_page,
+                  config->lazy_stacks, config->release_stacks);
+
+  worker_count = config->workers > 1 ? config->workers : 1;
+  workers = aligned_alloc(_Alignof(struct worker),
+                          worker_count * sizeof(struct worker));
+  if (workers == NULL) {
+    die("workers alloc failed");
+  }
+  memset(workers, 0, worker_count * sizeof(struct worker));
+  for (int i = 0; i < worker_count; i++) {
+    workers[i].index = i;
+  }
+
   TAILQ_INIT(&queue_head);
   assert(TAILQ_EMPTY(&queue_head));
-  tcb = reallocarray(tcb, size, sizeof(struct TCB));
-  assert(tcb != NULL);
-  tcb_init(0, 1, NULL);
-  getcontext(tcb[0].context);
-  makecontext(tcb[0].context, run_and_switch, 0);
+  TRACE(trace_init(worker_count));
+  grow_tcb();
+  tcb_init(0, STATE_RUNNING, NULL);
+  workers[0].current = get_tcb(0);
+  TRACE(trace_start(0, &get_tcb(0)->trace, 0));
+  if (worker_count > 1) {
+    start_workers(config);
+  }
+  else if (config->preempt_quantum_us != 0) {
+    preempt_start(config->preempt_quantum_us, preempt_yield);
+  }
 }
 
-//get the current running id in the FIFO queue
+//get the id of the current running thread
 int wut_id() {
-  for (int i = 0; i < count; i++) {
-    if (tcb[i].run == 1)
-      return i;
-  }
-  die("error: no thread is running in FIFO Queue\n");
-  return -1;
+  return current()->id;
+}
+
+//whether `id` belongs to a thread that hasn't been joined yet
+static int is_valid_id(int id) {
+  return id >= 0 && id < count && get_tcb(id)->state != STATE_FREE;
 }
 
 //create a thread with the lowest available id
 //and add it to the back of the FIFO queue
 //this function returns the id of thread created
 int wut_create(void (*run)(void)) {
-  check_and_resize_tcb();
+  preempt_disable();
+  lock_scheduler();
+  int id = get_lowest_available_id();
+  tcb_init(id, STATE_READY, run);
+  make_ready(get_tcb(id));
+  unlock_scheduler();
+  preempt_enable();
+  return id;
+}
+
+//create a thread like wut_create that
+//runs fn(arg), and exits with what it
+//returns as its result
+int wut_create_arg(void *(*fn)(void *), void *arg) {
+  preempt_disable();
+  lock_scheduler();
   int id = get_lowest_available_id();
-  tcb_init(id, 0, run);
-  TAILQ_INSERT_TAIL(&queue_head, &tcb[id].entry, pointers);
-  getcontext(tcb[id].context);
-  makecontext(tcb[id].context, run_and_switch, 0);
+  tcb_init_arg(id, fn, arg, new_stack());
+  make_ready(get_tcb(id));
+  unlock_scheduler();
+  preempt_enable();
   return id;
 }
 
+//create n threads like wut_create_arg
+//that run fn(args[i]), with the lowest
+//available ids in order. They take the
+//lock once and their stacks come in one
+//go, from the pool or a single mapping
+int wut_create_n(void *(*fn)(void *), void **args, int n, int *ids) {
+  if (n <= 0)
+    return n == 0 ? 0 : -1;
+  // malloc isn't reentrant, so a tick must not switch away in there
+  preempt_disable();
+  char **stacks = reallocarray(NULL, n, sizeof(char *));
+  if (stacks == NULL) {
+    preempt_enable();
+    return -1;
+  }
+  lock_scheduler();
+  if (!stack_get_n(stacks, n)) {
+    die("mmap stacks failed");
+  }
+  for (int i = 0; i < n; i++) {
+    ids[i] = get_lowest_available_id();
+    tcb_init_arg(ids[i], fn, args == NULL ? NULL : args[i], stacks[i]);
+  }
+  for (int i = 0; i < n; i++) {
+    make_ready(get_tcb(ids[i]));
+  }
+  unlock_scheduler();
+  free(stacks);
+  preempt_enable();
+  return 0;
+}
+
+//add a thread to the back of a wut_queue, which is empty
+//when it's zeroed
+static void queue_push(struct wut_queue *queue, struct TCB *thread) {
+  if (queue->last == NULL) {
+    queue->last = &queue->first;
+  }
+  TAILQ_NEXT(thread, pointers) = NULL;
+  thread->pointers.tqe_prev = queue->last;
+  *queue->last = thread;
+  queue->last = &TAILQ_NEXT(thread, pointers);
+  atomic_fetch_add(&queue->length, 1);
+}
+
+//take a thread out of the wut_queue it's in, from anywhere
+static void queue_remove(struct wut_queue *queue, struct TCB *thread) {
+  struct TCB *next = TAILQ_NEXT(thread, pointers);
+  if (next != NULL) {
+    next->pointers.tqe_prev = thread->pointers.tqe_prev;
+  }
+  else {
+    queue->last = thread->pointers.tqe_prev;
+  }
+  *thread->pointers.tqe_prev = next;
+  atomic_fetch_sub(&queue->length, 1);
+}
+
+//take the thread at the front of a wut_queue out, or NULL
+static struct TCB *queue_pop(struct wut_queue *queue) {
+  struct TCB *first = queue->first;
+  if (first != NULL) {
+    queue_remove(queue, first);
+  }
+  return first;
+}
+
+//the queue a waiting case is in
+static struct case_queue *case_queue(struct wut_chan_case *c) {
+  return c->op == WUT_CHAN_SEND ? &c->chan->senders : &c->chan->receivers;
+}
+
+//add a case to the back of the queue of its channel
+static void case_push(struct wut_chan_case *c) {
+  struct case_queue *queue = case_queue(c);
+  c->next = NULL;
+  c->previous = queue->last;
+  *queue->last = c;
+  queue->last = &c->next;
+}
+
+//take a case out of the queue of its channel
+static void case_remove(struct wut_chan_case *c) {
+  if (c->next != NULL) {
+    c->next->previous = c->previous;
+  }
+  else {
+    case_queue(c)->last = c->previous;
+  }
+  *c->previous = c->next;
+}
+
+//take all cases of a select out of their channels' queues
+static void abandon(struct wut_select *selection) {
+  for (int i = 0; i < selection->count; i++) {
+    case_remove(&selection->cases[i]);
+  }
+}
+
 //cancel a thread with the specified id if the thread
-//of the id is not terminated
-int wut_cancel(int id) {
+//of the id is not terminated. With several workers, a
+//thread that isn't blocked may be running on another one,
+//so it's only told to exit the next time it gets to run,
+//yields or returns from wut_join
+static int cancel(int id) {
   if (id == wut_id())
     return -1;
-  if (id >= count)
+  if (!is_valid_id(id))
     return -1;
-  if (tcb[id].status != -1) {
+  struct TCB *thread = get_tcb(id);
+  if (thread->state == STATE_TERMINATED)
     return -1;
+
+  if (worker_count > 1 && thread->state == STATE_READY) {
+    atomic_store_explicit(&thread->cancel_pending, true,
+                          memory_order_relaxed);
+    return 0;
   }
-  if (id_in_ready_queue(id)) {
-    TAILQ_REMOVE(&queue_head, &tcb[id].entry, pointers);
+  if (thread->state == STATE_READY) {
+    TAILQ_REMOVE(&queue_head, thread, pointers);
+    TRACE(queue_length--);
   }
+  else if (thread->state == STATE_BLOCKED) {
+    get_tcb(thread->joining)->joined_by = -1;
+    thread->joining = -1;
+    timer_remove(id);
+  }
+  else if (thread->state == STATE_SLEEPING) {
+    timer_remove(id);
+  }
+  else if (thread->state == STATE_PARKED) {
+    queue_remove(thread->parked_in, thread);
+  }
+  else if (thread->state == STATE_SELECTING) {
+    abandon(thread->selecting);
+  }
+  else if (thread->state == STATE_WAITING) {
+    reactor_forget(thread->waiting_fd, id);
+    thread->joining = -1;
+  }
+
+  wake_joiner(thread);
 
-  if (tcb[id].blocker_id != -1) {
-    int block_id = tcb[id].blocker_id;
-    TAILQ_INSERT_TAIL(&queue_head, &tcb[block_id].entry, pointers);
+  if (thread->stack != NULL) {
+    delete_stack(thread->stack);
+    thread->stack = NULL;
   }
+  thread->state = STATE_TERMINATED;
+  thread->status = 128;
+  thread->result = WUT_CANCELED;
 
-  delete_stack(tcb[id].stack);
-  free(tcb[id].context);
-  tcb[id].status = 128;
-  
   return 0;
 }
 
-// wait for the thread of joined id 
+// wait for the thread of joined id
 // to terminate and release all of its
-// resources and mkae it available for 
-// new threads. The waiting thread will
-// not be added to the back of the queue
-// unless the waited on thread has termianted
-// after keeping track of necessary info for
-// join function. control goes to next thread in
-// the FIFO queue
-int wut_join(int id) {
-  if (id >= count)
+// resources and make it available for
+// new threads. The waiting thread is
+// blocked until the waited on thread
+// has terminated, and control goes to
+// next thread in the FIFO queue. If no
+// thread is ready, the waited on thread
+// is blocked as well and can never
+// terminate, so this fails instead.
+// With a deadline, it gives up once
+// that has passed and fails with
+// ETIMEDOUT
+static int join(int id, uint64_t deadline, void **result) {
+  if (!is_valid_id(id))
     return -1;
   if (id == wut_id())
     return -1;
-  if (tcb[id].blocker_id != -1)
+  struct TCB *thread = get_tcb(id);
+  if (thread->joined_by != -1)
     return -1;
 
-  int curr_id = wut_id();
-
-  if (tcb[id].status == 128) {
-    if (tcb[id].blocked_id != -1) {
-      tcb[tcb[id].blocked_id].blocker_id = -1;
+  if (thread->state != STATE_TERMINATED) {
+    if (deadline == NO_DEADLINE && !can_block())
+      return -1;
+    struct TCB *curr = current();
+    thread->joined_by = curr->id;
+    curr->joining = id;
+    curr->state = STATE_BLOCKED;
+    if (deadline != NO_DEADLINE)
+      timer_add(curr->id, deadline);
+    TRACE(trace_join_start(&curr->trace));
+    block();
+    TRACE(trace_join_end(this_worker()->index, curr->id, &curr->trace,
+                         id));
+    if (curr->joining == -1) {
+      errno = ETIMEDOUT;
+      return -1;
     }
-    tcb_cleanup(id, 1);
-    return tcb[id].status;
+    curr->joining = -1;
   }
-  else if (tcb[id].status > -1) {
-    tcb_cleanup(id, 0);
-    return tcb[id].status;
+
+  int status = thread->status;
+  if (result != NULL)
+    *result = thread->result;
+  tcb_cleanup(id);
+  return status;
+}
+
+//yield to next thread in the FIFO queue
+//and add the current running one to the
+//back of the queue. With several workers,
+//let the scheduler run something else if
+//it finds anything
+static int yield(void) {
+  if (worker_count > 1) {
+    switch_to_scheduler(AFTER_YIELD);
+    return 0;
+  }
+  if (TAILQ_EMPTY(&queue_head) && io_waiting()) {
+    poll_reactor(0);
+  }
+  if (TAILQ_EMPTY(&queue_head) && timers_due()) {
+    expire_timers();
+  }
+  if (TAILQ_EMPTY(&queue_head)) {
+    return -1;
+  }
+
+  make_ready(current());
+  switch_to_next();
+
+  return 0;
+}
+
+int wut_cancel(int id) {
+  preempt_disable();
+  lock_scheduler();
+  int result = cancel(id);
+  unlock_scheduler();
+  preempt_enable();
+  return result;
+}
+
+int wut_join(int id) {
+  preempt_disable();
+  lock_scheduler();
+  int status = join(id, NO_DEADLINE, NULL);
+  unlock_scheduler();
+  preempt_enable();
+  check_cancel();
+  return status;
+}
+
+int wut_join_result(int id, void **result) {
+  preempt_disable();
+  lock_scheduler();
+  int status = join(id, NO_DEADLINE, result);
+  unlock_scheduler();
+  preempt_enable();
+  check_cancel();
+  return status;
+}
+
+int wut_join_timeout(int id, uint64_t timeout_ns) {
+  preempt_disable();
+  lock_scheduler();
+  int status = join(id, deadline_after(timeout_ns), NULL);
+  unlock_scheduler();
+  preempt_enable();
+  check_cancel();
+  return status;
+}
+
+// let the other threads run for at least
+// ns nanoseconds, without being switched
+// back to in the meantime
+void wut_sleep_ns(uint64_t ns) {
+  preempt_disable();
+  lock_scheduler();
+  struct TCB *curr = current();
+  timer_add(curr->id, deadline_after(ns));
+  curr->state = STATE_SLEEPING;
+  block();
+  unlock_scheduler();
+  preempt_enable();
+  check_cancel();
+}
+
+int wut_yield() {
+  preempt_disable();
+  int result = yield();
+  preempt_enable();
+  check_cancel();
+  return result;
+}
+
+// how many bytes of a thread's stack are
+// in memory, 0 for the main thread which
+// runs on the process stack
+ssize_t wut_stack_resident(int id) {
+  preempt_disable();
+  lock_scheduler();
+  ssize_t result = -1;
+  if (is_valid_id(id)) {
+    char *stack = get_tcb(id)->stack;
+    result = stack == NULL ? 0 : (ssize_t) stack_resident(stack);
   }
+  unlock_scheduler();
+  preempt_enable();
+  return result;
+}
 
-  if (tcb[queue_head.tqh_first->id].run == 1) {
-    TAILQ_REMOVE(&queue_head, queue_head.tqh_first, pointers);
+int wut_trace_stats(int id, struct wut_trace_stats *stats) {
+#ifdef WUT_TRACE
+  preempt_disable();
+  lock_scheduler();
+  int result = -1;
+  if (is_valid_id(id)) {
+    struct TCB *thread = get_tcb(id);
+    stats->runs = thread->trace.runs;
+    stats->run_ns = thread->trace.run_ns;
+    stats->join_ns = thread->trace.join_ns;
+    // the slice it's in right now counts too
+    if (thread == current()) {
+      stats->run_ns += timer_now() - thread->trace.started;
+    }
+    result = 0;
   }
+  unlock_scheduler();
+  preempt_enable();
+  return result;
+#else
+  (void) id;
+  (void) stats;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
 
-  tcb[curr_id].run = 0;
-  tcb[id].blocker_id = curr_id;
-  tcb[curr_id].blocked_id = id;
+int wut_trace_write(const char *path) {
+#ifdef WUT_TRACE
+  // a switch in the middle would record into a buffer this holds
+  preempt_disable();
+  int result = trace_write(path);
+  preempt_enable();
+  return result;
+#else
+  (void) path;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
 
-  int next_id = TAILQ_FIRST(&queue_head)->id;
-  tcb[next_id].run = 1;
-  TAILQ_REMOVE(&queue_head, queue_head.tqh_first, pointers);
-  swapcontext(tcb[curr_id].context, tcb[next_id].context);
-  if (TAILQ_EMPTY(&queue_head)) {
-    tcb[curr_id].run = 1;
+void wut_preempt_disable() {
+  preempt_disable();
+}
+
+void wut_preempt_enable() {
+  preempt_enable();
+}
+
+// set the status and result of the current
+// running thread. hand the control over to
+// the next thread in the FIFO queue, or exit
+// the process if there's none
+static void exit_thread(int status, void *result) {
+  preempt_disable();
+  lock_scheduler();
+  struct TCB *thread = current();
+
+  thread->status = status & 0xff;
+  thread->result = result;
+  thread->state = STATE_TERMINATED;
+
+  wake_joiner(thread);
+  if (worker_count > 1) {
+    if (--runnable == 0 && !io_waiting() && !timers_waiting()) {
+      exit(0);
+    }
+    switch_to_scheduler(AFTER_UNLOCK);
+    return;
   }
-  TAILQ_INSERT_TAIL(&queue_head, &tcb[curr_id].entry, pointers);
-  if (tcb[id].status == 128) {
-    tcb_cleanup(id, 1);
+  if (!wait_for_ready()) {
+    exit(0);
   }
-  else if (tcb[id].status > -1) {
-    tcb_cleanup(id, 0);
+
+  switch_to_next();
+}
+
+void wut_exit(int status) {
+  exit_thread(status, NULL);
+}
+
+void wut_exit_result(void *result) {
+  exit_thread(0, result);
+}
+
+//park the current thread until fd is ready to be read or
+//written, other threads keep running meanwhile
+static int wait_io(int fd, int direction) {
+  preempt_disable();
+  lock_scheduler();
+  struct TCB *curr = current();
+  int result = reactor_wait(fd, direction, curr->id);
+  if (result == 0) {
+    curr->state = STATE_WAITING;
+    curr->waiting_fd = fd;
+    block();
+    curr->joining = -1;
   }
+  unlock_scheduler();
+  preempt_enable();
+  check_cancel();
+  return result;
+}
 
-  return tcb[id].status;
+//switch fd to O_NONBLOCK the first time it's used, so trying
+//it never blocks the kernel thread
+static int make_nonblocking(int fd) {
+  preempt_disable();
+  lock_scheduler();
+  int result = reactor_nonblocking(fd);
+  unlock_scheduler();
+  preempt_enable();
+  return result;
 }
 
-//yield to next thread in the FIFO queue
-//and add the current running one to the
-//back of the queue
-int wut_yield() {
-  if (TAILQ_EMPTY(&queue_head)) {
+// read like read(2), but only the calling
+// thread waits until there's something to
+// read, the others keep running
+ssize_t wut_read(int fd, void *buf, size_t count) {
+  if (make_nonblocking(fd) == -1)
     return -1;
+  for (;;) {
+    ssize_t result = read(fd, buf, count);
+    if (result != -1 || (errno != EAGAIN && errno != EWOULDBLOCK))
+      return result;
+    if (wait_io(fd, REACTOR_READ) == -1)
+      return -1;
   }
+}
 
-  int curr_id = wut_id();
+// write like write(2), but only the calling
+// thread waits until there's room to write
+ssize_t wut_write(int fd, const void *buf, size_t count) {
+  if (make_nonblocking(fd) == -1)
+    return -1;
+  for (;;) {
+    ssize_t result = write(fd, buf, count);
+    if (result != -1 || (errno != EAGAIN && errno != EWOULDBLOCK))
+      return result;
+    if (wait_io(fd, REACTOR_WRITE) == -1)
+      return -1;
+  }
+}
+
+// accept like accept(2), but only the calling
+// thread waits for a connection
+int wut_accept(int fd, struct sockaddr *addr, socklen_t *addrlen) {
+  if (make_nonblocking(fd) == -1)
+    return -1;
+  for (;;) {
+    int result = accept(fd, addr, addrlen);
+    if (result != -1 || (errno != EAGAIN && errno != EWOULDBLOCK))
+      return result;
+    if (wait_io(fd, REACTOR_READ) == -1)
+      return -1;
+  }
+}
 
-  tcb[curr_id].run = 0;
+// close like close(2), and forget about fd
+// in the reactor. Threads that wait for it
+// wake up and fail with EBADF
+int wut_close(int fd) {
+  preempt_disable();
+  lock_scheduler();
+  int ids[2];
+  reactor_close(fd, ids);
+  int result = close(fd);
+  for (int i = 0; i < 2; i++) {
+    if (ids[i] != -1) {
+      wake(ids[i]);
+    }
+  }
+  unlock_scheduler();
+  preempt_enable();
+  return result;
+}
 
-  TAILQ_INSERT_TAIL(&queue_head, &tcb[curr_id].entry, pointers);
-  int next_id = TAILQ_FIRST(&queue_head)->id;
-  tcb[next_id].run = 1;
-  TAILQ_REMOVE(&queue_head, queue_head.tqh_first, pointers);
-  swapcontext(tcb[curr_id].context, tcb[next_id].context);
+// The state of a wut_mutex
+enum {
+  MUTEX_UNLOCKED,
+  MUTEX_LOCKED,
+  MUTEX_CONTENDED, // locked, and threads may be parked in it
+};
 
-  return 0;
+//park the current thread, which is in queue already, until
+//another one takes it out and makes it READY. The caller has
+//made sure it can block
+static void park_queued(struct wut_queue *queue) {
+  struct TCB *curr = current();
+  curr->state = STATE_PARKED;
+  curr->parked_in = queue;
+  block();
 }
 
-// set the status of current running thread
-// to a number specified by status. hand the
-// control over to the next thread in the FIFO
-// queue
-void wut_exit(int status) {
-  int id = wut_id(); 
-  status &= 0xff;
+//get in the back of queue and park there
+static void park(struct wut_queue *queue) {
+  queue_push(queue, current());
+  park_queued(queue);
+}
 
-  if (id_in_ready_queue(id)) {
-    TAILQ_REMOVE(&queue_head, &tcb[id].entry, pointers);
+//make the thread at the front of queue READY, if there is one
+static bool unpark(struct wut_queue *queue) {
+  struct TCB *thread = queue_pop(queue);
+  if (thread == NULL) {
+    return false;
   }
+  make_ready(thread);
+  return true;
+}
 
-  tcb[id].status = status;
-  tcb[id].run = 0;
-  int front_id = -1000;
+//unlock a contended mutex. The thread at the front of its queue
+//gets it straight away, so nobody can barge in ahead of it
+static void release_mutex(struct wut_mutex *mutex) {
+  if (!unpark(&mutex->waiting)) {
+    atomic_store(&mutex->state, MUTEX_UNLOCKED);
+  }
+  else if (atomic_load(&mutex->waiting.length) == 0) {
+    atomic_store(&mutex->state, MUTEX_LOCKED);
+  }
+}
+
+void wut_mutex_init(struct wut_mutex *mutex) {
+  memset(mutex, 0, sizeof(*mutex));
+}
 
-  if (tcb[id].blocker_id != -1) {
-    int block_id = tcb[id].blocker_id;
-    tcb[block_id].blocked_id = -1;
-    TAILQ_INSERT_TAIL(&queue_head, &tcb[block_id].entry, pointers);
+// lock a mutex, or park in its queue
+// until it's handed over. Fails if no
+// other thread could ever unlock it
+int wut_mutex_lock(struct wut_mutex *mutex) {
+  int unlocked = MUTEX_UNLOCKED;
+  if (atomic_compare_exchange_strong(&mutex->state, &unlocked,
+                                     MUTEX_LOCKED))
+    return 0;
+  check_cancel();
+  preempt_disable();
+  lock_scheduler();
+  int result = 0;
+  if (atomic_exchange(&mutex->state, MUTEX_CONTENDED) != MUTEX_UNLOCKED) {
+    if (can_block())
+      park(&mutex->waiting);
+    else
+      result = -1;
   }
-  if (TAILQ_EMPTY(&queue_head)) {
-    tcb[id].status = 0;
-    exit(0);
+  unlock_scheduler();
+  preempt_enable();
+  return result;
+}
+
+void wut_mutex_unlock(struct wut_mutex *mutex) {
+  int locked = MUTEX_LOCKED;
+  if (atomic_compare_exchange_strong(&mutex->state, &locked,
+                                     MUTEX_UNLOCKED))
+    return;
+  preempt_disable();
+  lock_scheduler();
+  release_mutex(mutex);
+  unlock_scheduler();
+  preempt_enable();
+}
+
+void wut_cond_init(struct wut_cond *cond) {
+  memset(cond, 0, sizeof(*cond));
+}
+
+// unlock mutex and park until signalled,
+// then lock it again. Fails with mutex
+// still locked if no other thread could
+// ever signal, or without it if no other
+// thread could ever unlock it after that
+int wut_cond_wait(struct wut_cond *cond, struct wut_mutex *mutex) {
+  check_cancel();
+  preempt_disable();
+  lock_scheduler();
+  // get in the queue before letting go of the mutex, so whoever takes
+  // it next on another worker and signals sees the queue isn't empty
+  struct TCB *curr = current();
+  queue_push(&cond->waiting, curr);
+  int locked = MUTEX_LOCKED;
+  if (!atomic_compare_exchange_strong(&mutex->state, &locked,
+                                      MUTEX_UNLOCKED))
+    release_mutex(mutex);
+  // a thread parked in the mutex may just have been handed it, so only
+  // now is it clear whether any other thread could signal
+  int result = 0;
+  if (!can_block()) {
+    queue_remove(&cond->waiting, curr);
+    result = -1;
+  }
+  else {
+    park_queued(&cond->waiting);
   }
+  unlock_scheduler();
+  preempt_enable();
+  int relocked = wut_mutex_lock(mutex);
+  return result == 0 ? relocked : result;
+}
+
+void wut_cond_signal(struct wut_cond *cond) {
+  if (atomic_load(&cond->waiting.length) == 0)
+    return;
+  preempt_disable();
+  lock_scheduler();
+  unpark(&cond->waiting);
+  unlock_scheduler();
+  preempt_enable();
+}
 
-  front_id = TAILQ_FIRST(&queue_head)->id; // 0
-  tcb[TAILQ_FIRST(&queue_head)->id].run = 1;
-  TAILQ_REMOVE(&queue_head, queue_head.tqh_first, pointers);
-  swapcontext(tcb[id].context, tcb[front_id].context);
+void wut_cond_broadcast(struct wut_cond *cond) {
+  if (atomic_load(&cond->waiting.length) == 0)
+    return;
+  preempt_disable();
+  lock_scheduler();
+  while (unpark(&cond->waiting))
+    ;
+  unlock_scheduler();
+  preempt_enable();
+}
+
+void wut_sem_init(struct wut_sem *sem, int value) {
+  memset(sem, 0, sizeof(*sem));
+  sem->value = value;
+}
+
+//take one from a semaphore's value if it's positive
+static bool sem_take(struct wut_sem *sem) {
+  int value = atomic_load(&sem->value);
+  while (value > 0) {
+    if (atomic_compare_exchange_weak(&sem->value, &value, value - 1))
+      return true;
+  }
+  return false;
+}
+
+// take one from the value of a semaphore,
+// parking until there's one to take. A
+// wut_sem_post hands it over directly
+int wut_sem_wait(struct wut_sem *sem) {
+  if (sem_take(sem))
+    return 0;
+  check_cancel();
+  preempt_disable();
+  lock_scheduler();
+  // get in the queue before looking at the value again, so a post
+  // either sees the queue isn't empty or leaves a value to take
+  struct TCB *curr = current();
+  queue_push(&sem->waiting, curr);
+  int result = 0;
+  if (sem_take(sem)) {
+    queue_remove(&sem->waiting, curr);
+  }
+  else if (!can_block()) {
+    queue_remove(&sem->waiting, curr);
+    result = -1;
+  }
+  else {
+    park_queued(&sem->waiting);
+  }
+  unlock_scheduler();
+  preempt_enable();
+  return result;
+}
+
+void wut_sem_post(struct wut_sem *sem) {
+  atomic_fetch_add(&sem->value, 1);
+  if (atomic_load(&sem->waiting.length) == 0)
+    return;
+  preempt_disable();
+  lock_scheduler();
+  while (atomic_load(&sem->waiting.length) > 0 && sem_take(sem))
+    unpark(&sem->waiting);
+  unlock_scheduler();
+  preempt_enable();
+}
+
+void wut_barrier_init(struct wut_barrier *barrier, int count) {
+  memset(barrier, 0, sizeof(*barrier));
+  barrier->count = count;
+}
+
+// park until count threads are waiting,
+// then let all of them go. The last one
+// to get there doesn't park and gets
+// WUT_BARRIER_SERIAL_THREAD
+int wut_barrier_wait(struct wut_barrier *barrier) {
+  check_cancel();
+  preempt_disable();
+  lock_scheduler();
+  int result = 0;
+  if (atomic_load(&barrier->waiting.length) + 1 >= barrier->count) {
+    while (unpark(&barrier->waiting))
+      ;
+    result = WUT_BARRIER_SERIAL_THREAD;
+  }
+  else if (can_block()) {
+    park(&barrier->waiting);
+  }
+  else {
+    result = -1;
+  }
+  unlock_scheduler();
+  preempt_enable();
+  return result;
+}
+
+//the slot of the index-th value from the start of the buffer
+static char *chan_slot(struct wut_chan *chan, size_t index) {
+  return chan->buffer + (index % chan->capacity) * chan->size;
+}
+
+//make room for twice as many values in an unbounded channel
+static void chan_grow(struct wut_chan *chan) {
+  size_t capacity = chan->capacity == 0 ? 16 : chan->capacity * 2;
+  char *buffer = reallocarray(NULL, capacity, chan->size);
+  if (buffer == NULL) {
+    die("channel buffer alloc failed");
+  }
+  for (size_t i = 0; i < chan->count; i++) {
+    memcpy(buffer + i * chan->size, chan_slot(chan, chan->head + i),
+           chan->size);
+  }
+  free(chan->buffer);
+  chan->buffer = buffer;
+  chan->capacity = capacity;
+  chan->head = 0;
+}
+
+//finish the select a waiting case belongs to with that case, and
+//make its thread READY
+static void fire(struct wut_chan_case *c, int ok) {
+  struct wut_select *selection = c->select;
+  abandon(selection);
+  c->ok = ok;
+  selection->done = c - selection->cases;
+  make_ready(selection->thread);
+}
+
+//do what a case asks for if that doesn't take waiting, and return
+//whether it did. A waiting case on the other side gets its value
+//copied straight from or to the other thread's memory
+static bool chan_try(struct wut_chan_case *c) {
+  struct wut_chan *chan = c->chan;
+  if (c->op == WUT_CHAN_SEND) {
+    struct wut_chan_case *receiver = chan->receivers.first;
+    if (chan->closed) {
+      c->ok = 0;
+    }
+    else if (receiver != NULL) {
+      memcpy(receiver->value, c->value, chan->size);
+      fire(receiver, 1);
+      c->ok = 1;
+    }
+    else if (chan->count < chan->limit) {
+      if (chan->count == chan->capacity) {
+        chan_grow(chan);
+      }
+      memcpy(chan_slot(chan, chan->head + chan->count), c->value,
+             chan->size);
+      chan->count++;
+      c->ok = 1;
+    }
+    else {
+      return false;
+    }
+    return true;
+  }
+
+  struct wut_chan_case *sender = chan->senders.first;
+  if (chan->count > 0) {
+    memcpy(c->value, chan_slot(chan, chan->head), chan->size);
+    chan->head = (chan->head + 1) % chan->capacity;
+    chan->count--;
+    // the buffer was full, the oldest sender's value goes behind
+    if (sender != NULL) {
+      memcpy(chan_slot(chan, chan->head + chan->count), sender->value,
+             chan->size);
+      chan->count++;
+      fire(sender, 1);
+    }
+    c->ok = 1;
+  }
+  else if (sender != NULL) {
+    memcpy(c->value, sender->value, chan->size);
+    fire(sender, 1);
+    c->ok = 1;
+  }
+  else if (chan->closed) {
+    memset(c->value, 0, chan->size);
+    c->ok = 0;
+  }
+  else {
+    return false;
+  }
+  return true;
+}
+
+//go with the first case that can, or wait until one can if `wait`
+//and another thread could make it. Returns its index or -1
+static int chan_select(struct wut_chan_case *cases, int count, bool wait) {
+  for (int i = 0; i < count; i++) {
+    if (chan_try(&cases[i])) {
+      return i;
+    }
+  }
+  if (!wait) {
+    errno = EAGAIN;
+    return -1;
+  }
+  if (!can_block()) {
+    errno = EDEADLK;
+    return -1;
+  }
+  struct TCB *curr = current();
+  struct wut_select selection = {
+    .thread = curr,
+    .cases = cases,
+    .count = count,
+    .done = -1,
+  };
+  for (int i = 0; i < count; i++) {
+    cases[i].select = &selection;
+    case_push(&cases[i]);
+  }
+  curr->state = STATE_SELECTING;
+  curr->selecting = &selection;
+  block();
+  return selection.done;
+}
+
+// malloc isn't reentrant, so neither of these
+// may be preempted
+struct wut_chan *wut_chan_create(size_t size, size_t capacity) {
+  preempt_disable();
+  struct wut_chan *chan = calloc(1, sizeof(struct wut_chan));
+  if (chan == NULL) {
+    preempt_enable();
+    return NULL;
+  }
+  chan->size = size;
+  chan->limit = capacity;
+  chan->senders.last = &chan->senders.first;
+  chan->receivers.last = &chan->receivers.first;
+  if (capacity != WUT_CHAN_UNBOUNDED && capacity > 0) {
+    chan->buffer = reallocarray(NULL, capacity, size);
+    if (chan->buffer == NULL) {
+      free(chan);
+      chan = NULL;
+    }
+    else {
+      chan->capacity = capacity;
+    }
+  }
+  preempt_enable();
+  return chan;
+}
+
+void wut_chan_destroy(struct wut_chan *chan) {
+  preempt_disable();
+  free(chan->buffer);
+  free(chan);
+  preempt_enable();
+}
+
+// wake every thread waiting on a channel,
+// they fail like any sending or receiving
+// once the buffer is empty
+void wut_chan_close(struct wut_chan *chan) {
+  preempt_disable();
+  lock_scheduler();
+  chan->closed = true;
+  while (chan->receivers.first != NULL) {
+    memset(chan->receivers.first->value, 0, chan->size);
+    fire(chan->receivers.first, 0);
+  }
+  while (chan->senders.first != NULL) {
+    fire(chan->senders.first, 0);
+  }
+  unlock_scheduler();
+  preempt_enable();
+}
+
+int wut_chan_select(struct wut_chan_case *cases, int count) {
+  check_cancel();
+  preempt_disable();
+  lock_scheduler();
+  int result = chan_select(cases, count, true);
+  unlock_scheduler();
+  preempt_enable();
+  return result;
+}
+
+int wut_chan_try_select(struct wut_chan_case *cases, int count) {
+  preempt_disable();
+  lock_scheduler();
+  int result = chan_select(cases, count, false);
+  unlock_scheduler();
+  preempt_enable();
+  return result;
+}
+
+int wut_chan_send(struct wut_chan *chan, const void *value) {
+  struct wut_chan_case c = {
+    .chan = chan,
+    .op = WUT_CHAN_SEND,
+    .value = (void *) value,
+  };
+  if (wut_chan_select(&c, 1) == -1)
+    return -1;
+  if (!c.ok) {
+    errno = EPIPE;
+    return -1;
+  }
+  return 0;
+}
+
+int wut_chan_recv(struct wut_chan *chan, void *value) {
+  struct wut_chan_case c = {
+    .chan = chan,
+    .op = WUT_CHAN_RECV,
+    .value = value,
+  };
+  if (wut_chan_select(&c, 1) == -1)
+    return -1;
+  if (!c.ok) {
+    errno = EPIPE;
+    return -1;
+  }
+  return 0;
 }
@@ -0,0 +1,60 @@
+#include "test.h"
+
+#include "wut.h"
+
+static struct wut_chan *bounded;
+static int sent = 0;
+
+void sender(void) {
+    for (int i = 1; i <= 5; ++i) {
+        wut_chan_send(bounded, &i);
+        sent = i;
+    }
+}
+
+void test(void) {
+    wut_init();
+    bounded = wut_chan_create(sizeof(int), 2);
+    int id = wut_create(sender);
+    wut_yield();
+    shared_memory[0] = sent;
+    int in_order = 1;
+    for (int i = 1; i <= 5; ++i) {
+        int value;
+        wut_chan_recv(bounded, &value);
+        in_order &= value == i;
+    }
+    shared_memory[1] = in_order;
+    wut_join(id);
+    wut_chan_destroy(bounded);
+
+    struct wut_chan *unbounded = wut_chan_create(sizeof(long), WUT_CHAN_UNBOUNDED);
+    int sent_all = 1;
+    for (long i = 0; i < 1000; ++i) {
+        sent_all &= wut_chan_send(unbounded, &i) == 0;
+    }
+    shared_memory[2] = sent_all;
+    in_order = 1;
+    for (long i = 0; i < 1000; ++i) {
+        long value;
+        wut_chan_recv(unbounded, &value);
+        in_order &= value == i;
+    }
+    shared_memory[3] = in_order;
+    wut_chan_destroy(unbounded);
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], 2, "sends should only wait once the buffer is full"
+    );
+    expect(
+        shared_memory[1], 1, "values should be received in order"
+    );
+    expect(
+        shared_memory[2], 1, "an unbounded channel should never wait"
+    );
+    expect(
+        shared_memory[3], 1, "an unbounded channel should keep the order"
+    );
+}
@@ -0,0 +1,71 @@
+#include "test.h"
+
+#include "wut.h"
+
+#include <errno.h> // errno, EAGAIN
+
+static struct wut_chan *numbers;
+static struct wut_chan *quit;
+static struct wut_chan *results;
+
+void worker(void) {
+    int sum = 0;
+    for (;;) {
+        int number;
+        int unused;
+        struct wut_chan_case cases[] = {
+            { .chan = numbers, .op = WUT_CHAN_RECV, .value = &number },
+            { .chan = quit, .op = WUT_CHAN_RECV, .value = &unused },
+        };
+        if (wut_chan_select(cases, 2) == 1) {
+            break;
+        }
+        sum += number;
+    }
+    wut_chan_send(results, &sum);
+}
+
+void test(void) {
+    wut_init();
+    numbers = wut_chan_create(sizeof(int), 0);
+    quit = wut_chan_create(sizeof(int), 0);
+    results = wut_chan_create(sizeof(int), 1);
+
+    int value = 0;
+    struct wut_chan_case nothing = {
+        .chan = numbers, .op = WUT_CHAN_RECV, .value = &value,
+    };
+    errno = 0;
+    shared_memory[0] = wut_chan_try_select(&nothing, 1);
+    shared_memory[1] = errno;
+
+    int id = wut_create(worker);
+    for (int i = 1; i <= 4; ++i) {
+        wut_chan_send(numbers, &i);
+    }
+    wut_chan_close(quit);
+    int sum = 0;
+    wut_chan_recv(results, &sum);
+    shared_memory[2] = sum;
+    wut_join(id);
+
+    struct wut_chan_case send = {
+        .chan = results, .op = WUT_CHAN_SEND, .value = &sum,
+    };
+    shared_memory[3] = wut_chan_try_select(&send, 1);
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], -1, "trying should fail if nothing can go"
+    );
+    expect(
+        shared_memory[1], EAGAIN, "errno should be EAGAIN"
+    );
+    expect(
+        shared_memory[2], 10, "select should receive from the ready channel"
+    );
+    expect(
+        shared_memory[3], 0, "select should send into a buffer with room"
+    );
+}
@@ -0,0 +1,50 @@
+#include "test.h"
+
+#include "wut.h"
+
+static struct wut_chan *chan;
+static int sent = 0;
+
+void sender(void) {
+    for (int i = 1; i <= 3; ++i) {
+        wut_chan_send(chan, &i);
+        sent = i;
+    }
+    wut_chan_close(chan);
+}
+
+void test(void) {
+    wut_init();
+    chan = wut_chan_create(sizeof(int), 0);
+    int id = wut_create(sender);
+    wut_yield();
+    shared_memory[0] = sent;
+    int sum = 0;
+    int value;
+    while (wut_chan_recv(chan, &value) == 0) {
+        sum += value;
+    }
+    shared_memory[1] = sum;
+    wut_join(id);
+    shared_memory[2] = wut_chan_send(chan, &value);
+    wut_chan_destroy(chan);
+
+    chan = wut_chan_create(sizeof(int), 0);
+    shared_memory[3] = wut_chan_recv(chan, &value);
+    wut_chan_destroy(chan);
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], 0, "a send should wait for a receiver"
+    );
+    expect(
+        shared_memory[1], 6, "every value sent should be received"
+    );
+    expect(
+        shared_memory[2], -1, "sending should fail once it's closed"
+    );
+    expect(
+        shared_memory[3], -1, "receiving should fail if nobody could send"
+    );
+}
@@ -0,0 +1,63 @@
+#include "test.h"
+
+#include "wut.h"
+
+#include <stdint.h> // intptr_t
+
+void *square(void *arg) {
+    intptr_t value = (intptr_t) arg;
+    return (void *) (value * value);
+}
+
+void *exit_early(void *arg) {
+    wut_exit_result(arg);
+    return NULL;
+}
+
+void *yield_forever(void *arg) {
+    (void) arg;
+    for (;;) {
+        wut_yield();
+    }
+}
+
+void test(void) {
+    wut_init();
+    void *result = NULL;
+    int id = wut_create_arg(square, (void *) 1000);
+    shared_memory[0] = id;
+    shared_memory[1] = wut_join_result(id, &result);
+    shared_memory[2] = (intptr_t) result == 1000000;
+
+    static int object;
+    id = wut_create_arg(exit_early, &object);
+    wut_join_result(id, &result);
+    shared_memory[3] = result == &object;
+
+    id = wut_create_arg(yield_forever, NULL);
+    wut_yield();
+    wut_cancel(id);
+    shared_memory[4] = wut_join_result(id, &result);
+    shared_memory[5] = result == WUT_CANCELED;
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], 1, "wut_create_arg should use the lowest id"
+    );
+    expect(
+        shared_memory[1], 0, "a thread that returns should have status 0"
+    );
+    expect(
+        shared_memory[2], 1, "the result should be what the function returned"
+    );
+    expect(
+        shared_memory[3], 1, "wut_exit_result should set the result"
+    );
+    expect(
+        shared_memory[4], 128, "a cancelled thread should have status 128"
+    );
+    expect(
+        shared_memory[5], 1, "a cancelled thread's result should be WUT_CANCELED"
+    );
+}
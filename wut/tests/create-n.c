@@ -0,0 +1,63 @@
+#include "test.h"
+
+#include "wut.h"
+
+#define THREADS 1000
+
+static int values[THREADS];
+static int ran = 0;
+
+void *twice(void *arg) {
+    ran++;
+    *(int *) arg *= 2;
+    return arg;
+}
+
+void test(void) {
+    wut_init();
+    void *args[THREADS];
+    for (int i = 0; i < THREADS; ++i) {
+        values[i] = i;
+        args[i] = &values[i];
+    }
+    int ids[THREADS];
+    shared_memory[0] = wut_create_n(twice, args, THREADS, ids);
+    shared_memory[1] = ran;
+    int in_order = 1;
+    int correct = 1;
+    for (int i = 0; i < THREADS; ++i) {
+        void *result;
+        in_order &= ids[i] == i + 1;
+        correct &= wut_join_result(ids[i], &result) == 0
+                   && result == &values[i] && values[i] == 2 * i;
+    }
+    shared_memory[2] = in_order;
+    shared_memory[3] = correct;
+
+    shared_memory[4] = wut_create_n(twice, args, 10, ids);
+    shared_memory[5] = ids[0];
+    for (int i = 0; i < 10; ++i) {
+        wut_join(ids[i]);
+    }
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], 0, "wut_create_n should succeed"
+    );
+    expect(
+        shared_memory[1], 0, "the threads shouldn't run before a yield"
+    );
+    expect(
+        shared_memory[2], 1, "the threads should get the lowest ids in order"
+    );
+    expect(
+        shared_memory[3], 1, "every thread should get its own argument"
+    );
+    expect(
+        shared_memory[4], 0, "wut_create_n should reuse joined ids"
+    );
+    expect(
+        shared_memory[5], 1, "the first reused id should be the lowest"
+    );
+}
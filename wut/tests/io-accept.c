@@ -0,0 +1,61 @@
+#include "test.h"
+
+#include "wut.h"
+
+#include <netinet/in.h> // struct sockaddr_in
+#include <sys/socket.h> // socket, bind, listen, connect
+
+static int listener;
+static struct sockaddr_in address;
+
+void server(void) {
+    int connection = wut_accept(listener, NULL, NULL);
+    char buffer[4];
+    shared_memory[0] = wut_read(connection, buffer, sizeof(buffer));
+    shared_memory[1] = buffer[1];
+    wut_close(connection);
+}
+
+void client(void) {
+    int connection = socket(AF_INET, SOCK_STREAM, 0);
+    shared_memory[2] = connect(connection, (struct sockaddr *) &address,
+                               sizeof(address));
+    shared_memory[3] = wut_write(connection, "ping", 4);
+    wut_close(connection);
+}
+
+void test(void) {
+    wut_init();
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (bind(listener, (struct sockaddr *) &address, sizeof(address)) == -1
+        || listen(listener, 1) == -1
+        || getsockname(listener, (struct sockaddr *) &address, &length) == -1) {
+        return;
+    }
+    int server_id = wut_create(server);
+    wut_yield();
+    int client_id = wut_create(client);
+    shared_memory[4] = wut_join(server_id);
+    wut_join(client_id);
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], 4, "the server should read the whole message"
+    );
+    expect(
+        shared_memory[1], 'i', "the server should read the message"
+    );
+    expect(
+        shared_memory[2], 0, "the client should connect"
+    );
+    expect(
+        shared_memory[3], 4, "the client should write the whole message"
+    );
+    expect(
+        shared_memory[4], 0, "wut_join should return 0"
+    );
+}
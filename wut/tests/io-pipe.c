@@ -0,0 +1,52 @@
+#include "test.h"
+
+#include "wut.h"
+
+#include <unistd.h> // pipe
+
+static int fds[2];
+static int others_ran = 0;
+
+void reader(void) {
+    char buffer[16];
+    shared_memory[0] = wut_read(fds[0], buffer, sizeof(buffer));
+    shared_memory[1] = others_ran;
+    shared_memory[2] = buffer[0];
+}
+
+void other(void) {
+    for (int i = 0; i < 10; ++i) {
+        others_ran++;
+        wut_yield();
+    }
+}
+
+void test(void) {
+    wut_init();
+    if (pipe(fds) == -1) {
+        return;
+    }
+    int reader_id = wut_create(reader);
+    int other_id = wut_create(other);
+    wut_join(other_id);
+    shared_memory[3] = wut_write(fds[1], "hello", 5);
+    shared_memory[4] = wut_join(reader_id);
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], 5, "wut_read should read what was written"
+    );
+    expect(
+        shared_memory[1], 10, "other threads should run while it waits"
+    );
+    expect(
+        shared_memory[2], 'h', "wut_read should read the data"
+    );
+    expect(
+        shared_memory[3], 5, "wut_write should write everything"
+    );
+    expect(
+        shared_memory[4], 0, "wut_join should return 0"
+    );
+}
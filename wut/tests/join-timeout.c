@@ -0,0 +1,40 @@
+#include "test.h"
+
+#include "wut.h"
+
+#include <errno.h> // errno, ETIMEDOUT
+
+void slow(void) {
+    wut_sleep_ns(50000000);
+    wut_exit(7);
+}
+
+void fast(void) {
+    wut_exit(3);
+}
+
+void test(void) {
+    wut_init();
+    int slow_id = wut_create(slow);
+    int fast_id = wut_create(fast);
+    errno = 0;
+    shared_memory[0] = wut_join_timeout(slow_id, 5000000);
+    shared_memory[1] = errno;
+    shared_memory[2] = wut_join_timeout(fast_id, 5000000);
+    shared_memory[3] = wut_join(slow_id);
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], -1, "wut_join_timeout should give up"
+    );
+    expect(
+        shared_memory[1], ETIMEDOUT, "errno should be ETIMEDOUT"
+    );
+    expect(
+        shared_memory[2], 3, "a thread that exits in time should be joined"
+    );
+    expect(
+        shared_memory[3], 7, "a timed out thread should be joinable again"
+    );
+}
@@ -0,0 +1,28 @@
+#include "test.h"
+
+#include "wut.h"
+
+#define STACK_SIZE (512 * 1024)
+
+void run(void) {
+    volatile char buffer[STACK_SIZE / 2];
+    buffer[0] = 1;
+    buffer[sizeof(buffer) - 1] = 2;
+    shared_memory[1] = buffer[0] + buffer[sizeof(buffer) - 1];
+}
+
+void test(void) {
+    struct wut_config config = { .stack_size = STACK_SIZE };
+    wut_init_config(&config);
+    int id = wut_create(run);
+    shared_memory[0] = wut_join(id);
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], 0, "wut_join should return 0"
+    );
+    expect(
+        shared_memory[1], 3, "the thread should use half of its stack"
+    );
+}
@@ -0,0 +1,54 @@
+#include "test.h"
+
+#include "wut.h"
+
+#define DEEP (256 * 1024)
+
+static int deep;
+static int sum;
+
+void run(void) {
+    if (deep) {
+        volatile char buffer[DEEP];
+        for (int i = 0; i < DEEP; i += 1024) {
+            buffer[i] = 1;
+        }
+        sum = buffer[0] + buffer[DEEP - 1024];
+    }
+    wut_yield();
+}
+
+void test(void) {
+    struct wut_config config = { .lazy_stacks = 1, .release_stacks = 1 };
+    wut_init_config(&config);
+    shared_memory[0] = wut_stack_resident(0);
+    shared_memory[1] = wut_stack_resident(1);
+
+    deep = 1;
+    int id = wut_create(run);
+    wut_yield();
+    ssize_t used = wut_stack_resident(id);
+    shared_memory[2] = used >= DEEP && used < WUT_LAZY_STACK_SIZE / 2;
+    wut_join(id);
+
+    deep = 0;
+    id = wut_create(run);
+    wut_yield();
+    shared_memory[3] = wut_stack_resident(id) <= 16 * 1024;
+    wut_join(id);
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], 0, "the main thread should have no stack of its own"
+    );
+    expect(
+        shared_memory[1], -1, "there should be no thread 1"
+    );
+    expect(
+        shared_memory[2], 1, "only the touched pages should be resident"
+    );
+    expect(
+        shared_memory[3], 1, "the pages of the finished thread should be gone"
+    );
+}
@@ -0,0 +1,53 @@
+#include "test.h"
+
+#include "wut.h"
+
+#include <time.h> // clock_gettime
+
+static volatile int other_ran = 0;
+
+static double cpu_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void spin(void) {
+    wut_preempt_disable();
+    double start = cpu_time();
+    while (cpu_time() - start < 0.05) {
+    }
+    shared_memory[1] = other_ran;
+    wut_preempt_enable();
+    while (!other_ran) {
+    }
+    shared_memory[2] = other_ran;
+}
+
+void other(void) {
+    other_ran = 1;
+}
+
+void test(void) {
+    struct wut_config config = {
+        .stack_size = 64 * 1024,
+        .preempt_quantum_us = 1000,
+    };
+    wut_init_config(&config);
+    int spinner = wut_create(spin);
+    int id = wut_create(other);
+    shared_memory[0] = wut_join(spinner);
+    wut_join(id);
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], 0, "wut_join should return 0"
+    );
+    expect(
+        shared_memory[1], 0, "nothing should run while preemption is disabled"
+    );
+    expect(
+        shared_memory[2], 1, "the other thread should run once it's enabled"
+    );
+}
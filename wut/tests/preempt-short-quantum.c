@@ -0,0 +1,57 @@
+#include "test.h"
+
+#include "wut.h"
+
+#include <time.h> // clock_gettime
+
+#define QUANTUM_US 20
+#define RUN_NS 500000000
+
+static volatile int done = 0;
+static volatile long spins[2];
+
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void spin_first(void) {
+    while (!done) {
+        spins[0]++;
+    }
+}
+
+void spin_second(void) {
+    while (!done) {
+        spins[1]++;
+    }
+}
+
+// The spinners get preempted thousands of times on the default stack
+// size, which only has room for a signal frame or two
+void test(void) {
+    struct wut_config config = { .preempt_quantum_us = QUANTUM_US };
+    wut_init_config(&config);
+    int first = wut_create(spin_first);
+    int second = wut_create(spin_second);
+    long end = now_ns() + RUN_NS;
+    while (now_ns() < end) {
+    }
+    done = 1;
+    shared_memory[0] = wut_join(first);
+    shared_memory[1] = wut_join(second);
+    shared_memory[2] = spins[0] > 0 && spins[1] > 0;
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], 0, "the first spinner should finish"
+    );
+    expect(
+        shared_memory[1], 0, "the second spinner should finish"
+    );
+    expect(
+        shared_memory[2], 1, "both spinners should have run"
+    );
+}
@@ -0,0 +1,40 @@
+#include "test.h"
+
+#include "wut.h"
+
+static volatile int done = 0;
+
+void spin(void) {
+    while (!done) {
+    }
+    shared_memory[1] = 1;
+}
+
+void finish(void) {
+    done = 1;
+    shared_memory[2] = 1;
+}
+
+void test(void) {
+    struct wut_config config = {
+        .stack_size = 64 * 1024,
+        .preempt_quantum_us = 1000,
+    };
+    wut_init_config(&config);
+    int spinner = wut_create(spin);
+    int finisher = wut_create(finish);
+    shared_memory[0] = wut_join(spinner);
+    wut_join(finisher);
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], 0, "wut_join should return 0"
+    );
+    expect(
+        shared_memory[1], 1, "the spinning thread should see done"
+    );
+    expect(
+        shared_memory[2], 1, "the other thread should run while it spins"
+    );
+}
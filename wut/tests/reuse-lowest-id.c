@@ -0,0 +1,47 @@
+#include "test.h"
+
+#include "wut.h"
+
+#define NUM_THREADS 3000
+
+static const int freed[] = { 2500, 1500, 10, 1030 };
+
+#define NUM_FREED ((int) (sizeof(freed) / sizeof(freed[0])))
+
+void run(void) {
+}
+
+void test(void) {
+    wut_init();
+    for (int i = 1; i <= NUM_THREADS; ++i) {
+        shared_memory[0] = wut_create(run);
+    }
+    for (int i = 0; i < NUM_FREED; ++i) {
+        wut_cancel(freed[i]);
+        wut_join(freed[i]);
+    }
+    for (int i = 1; i <= NUM_FREED + 1; ++i) {
+        shared_memory[i] = wut_create(run);
+    }
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], NUM_THREADS, "the last thread created"
+    );
+    expect(
+        shared_memory[1], 10, "the lowest free id is reused first"
+    );
+    expect(
+        shared_memory[2], 1030, "then the next lowest one"
+    );
+    expect(
+        shared_memory[3], 1500, "then the next lowest one"
+    );
+    expect(
+        shared_memory[4], 2500, "then the highest free one"
+    );
+    expect(
+        shared_memory[5], NUM_THREADS + 1, "then a new id"
+    );
+}
@@ -0,0 +1,69 @@
+#include "test.h"
+
+#include "wut.h"
+
+#include <time.h> // clock, clock_gettime
+
+static int order[3];
+static int woken = 0;
+
+static void sleep_ms(int ms) {
+    wut_sleep_ns((uint64_t) ms * 1000000);
+    order[woken++] = ms;
+}
+
+void sleep_30(void) {
+    sleep_ms(30);
+}
+
+void sleep_10(void) {
+    sleep_ms(10);
+}
+
+void sleep_20(void) {
+    sleep_ms(20);
+}
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+void test(void) {
+    wut_init();
+    long long start = now_ms();
+    clock_t cpu_start = clock();
+    int ids[3];
+    ids[0] = wut_create(sleep_30);
+    ids[1] = wut_create(sleep_10);
+    ids[2] = wut_create(sleep_20);
+    for (int i = 0; i < 3; ++i) {
+        wut_join(ids[i]);
+    }
+    long long elapsed = now_ms() - start;
+    long long cpu_ms = (clock() - cpu_start) * 1000LL / CLOCKS_PER_SEC;
+    shared_memory[0] = order[0];
+    shared_memory[1] = order[1];
+    shared_memory[2] = order[2];
+    shared_memory[3] = elapsed >= 30;
+    shared_memory[4] = cpu_ms < elapsed / 2;
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], 10, "the shortest sleep should wake first"
+    );
+    expect(
+        shared_memory[1], 20, "the middle sleep should wake second"
+    );
+    expect(
+        shared_memory[2], 30, "the longest sleep should wake last"
+    );
+    expect(
+        shared_memory[3], 1, "no thread should wake before its deadline"
+    );
+    expect(
+        shared_memory[4], 1, "sleeping shouldn't spin"
+    );
+}
@@ -0,0 +1,57 @@
+#include "test.h"
+
+#include "wut.h"
+
+#include <signal.h> // SIGSEGV
+#include <sys/wait.h> // waitpid
+#include <unistd.h> // fork
+
+static int limit = 1 << 30;
+
+static int recurse(int depth) {
+    volatile char frame[256];
+    frame[0] = depth;
+    if (depth == limit) {
+        return frame[0];
+    }
+    return recurse(depth + 1) + frame[0];
+}
+
+void run(void) {
+    shared_memory[2] = recurse(0);
+}
+
+void idle(void) {
+    shared_memory[3] = 1;
+}
+
+void test(void) {
+    /* The overflow has to crash, so it happens in its own process. */
+    pid_t pid = fork();
+    if (pid == 0) {
+        wut_init();
+        wut_create(run);
+        wut_create(idle);
+        wut_yield();
+        exit(0);
+    }
+    int wstatus;
+    waitpid(pid, &wstatus, 0);
+    shared_memory[0] = WIFSIGNALED(wstatus);
+    shared_memory[1] = WIFSIGNALED(wstatus) ? WTERMSIG(wstatus) : 0;
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], 1, "overflowing the stack should crash"
+    );
+    expect(
+        shared_memory[1], SIGSEGV, "the guard page should fault"
+    );
+    expect(
+        shared_memory[2], TEST_MAGIC, "the recursion should never return"
+    );
+    expect(
+        shared_memory[3], TEST_MAGIC, "the next thread should never run"
+    );
+}
@@ -0,0 +1,47 @@
+#include "test.h"
+
+#include "wut.h"
+
+static struct wut_barrier barrier;
+static int arrived = 0;
+static int too_early = 0;
+static int serial = 0;
+
+void phases(void) {
+    for (int phase = 1; phase <= 2; ++phase) {
+        arrived++;
+        if (wut_barrier_wait(&barrier) == WUT_BARRIER_SERIAL_THREAD) {
+            serial++;
+        }
+        if (arrived < 4 * phase) {
+            too_early++;
+        }
+    }
+}
+
+void test(void) {
+    wut_init();
+    wut_barrier_init(&barrier, 4);
+    int ids[4];
+    for (int i = 0; i < 4; ++i) {
+        ids[i] = wut_create(phases);
+    }
+    for (int i = 0; i < 4; ++i) {
+        wut_join(ids[i]);
+    }
+    shared_memory[0] = too_early;
+    shared_memory[1] = serial;
+    shared_memory[2] = wut_barrier_wait(&barrier);
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], 0, "no thread should pass before all arrive"
+    );
+    expect(
+        shared_memory[1], 2, "one thread per phase should be the serial one"
+    );
+    expect(
+        shared_memory[2], -1, "waiting should fail if nobody else could come"
+    );
+}
@@ -0,0 +1,58 @@
+#include "test.h"
+
+#include "wut.h"
+
+static struct wut_mutex mutex;
+static struct wut_cond cond;
+static int ready = 0;
+static int woken = 0;
+
+void waiter(void) {
+    wut_mutex_lock(&mutex);
+    while (!ready) {
+        wut_cond_wait(&cond, &mutex);
+    }
+    woken++;
+    wut_mutex_unlock(&mutex);
+}
+
+void test(void) {
+    wut_init();
+    int ids[3];
+    for (int i = 0; i < 3; ++i) {
+        ids[i] = wut_create(waiter);
+    }
+    wut_yield();
+    shared_memory[0] = woken;
+
+    wut_mutex_lock(&mutex);
+    ready = 1;
+    wut_cond_signal(&cond);
+    wut_mutex_unlock(&mutex);
+    wut_yield();
+    shared_memory[1] = woken;
+
+    wut_cond_broadcast(&cond);
+    for (int i = 0; i < 3; ++i) {
+        wut_join(ids[i]);
+    }
+    shared_memory[2] = woken;
+
+    wut_mutex_lock(&mutex);
+    shared_memory[3] = wut_cond_wait(&cond, &mutex);
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], 0, "waiters should wait until they're signalled"
+    );
+    expect(
+        shared_memory[1], 1, "a signal should wake one waiter"
+    );
+    expect(
+        shared_memory[2], 3, "a broadcast should wake the others"
+    );
+    expect(
+        shared_memory[3], -1, "waiting should fail if nobody could signal"
+    );
+}
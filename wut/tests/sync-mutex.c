@@ -0,0 +1,71 @@
+#include "test.h"
+
+#include "wut.h"
+
+static struct wut_mutex mutex;
+static int counter = 0;
+static int order[3];
+static int acquired = 0;
+
+void increment(void) {
+    for (int i = 0; i < 100; ++i) {
+        wut_mutex_lock(&mutex);
+        int value = counter;
+        wut_yield();
+        counter = value + 1;
+        wut_mutex_unlock(&mutex);
+    }
+}
+
+void record(void) {
+    wut_mutex_lock(&mutex);
+    order[acquired++] = wut_id();
+    wut_mutex_unlock(&mutex);
+}
+
+void test(void) {
+    wut_init();
+    wut_mutex_init(&mutex);
+    int ids[3];
+    for (int i = 0; i < 3; ++i) {
+        ids[i] = wut_create(increment);
+    }
+    for (int i = 0; i < 3; ++i) {
+        wut_join(ids[i]);
+    }
+    shared_memory[0] = counter;
+
+    wut_mutex_lock(&mutex);
+    for (int i = 0; i < 3; ++i) {
+        ids[i] = wut_create(record);
+    }
+    wut_yield();
+    wut_mutex_unlock(&mutex);
+    for (int i = 0; i < 3; ++i) {
+        wut_join(ids[i]);
+    }
+    shared_memory[1] = order[0];
+    shared_memory[2] = order[1];
+    shared_memory[3] = order[2];
+
+    wut_mutex_lock(&mutex);
+    shared_memory[4] = wut_mutex_lock(&mutex);
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], 300, "only one thread should hold the mutex"
+    );
+    expect(
+        shared_memory[1], 1, "the first thread to wait should lock first"
+    );
+    expect(
+        shared_memory[2], 2, "the second thread to wait should lock second"
+    );
+    expect(
+        shared_memory[3], 3, "the third thread to wait should lock last"
+    );
+    expect(
+        shared_memory[4], -1, "locking should fail if nobody could unlock"
+    );
+}
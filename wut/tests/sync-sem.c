@@ -0,0 +1,52 @@
+#include "test.h"
+
+#include "wut.h"
+
+static struct wut_sem sem;
+static int order[3];
+static int taken = 0;
+
+void take(void) {
+    wut_sem_wait(&sem);
+    order[taken++] = wut_id();
+}
+
+void test(void) {
+    wut_init();
+    wut_sem_init(&sem, 0);
+    int ids[3];
+    for (int i = 0; i < 3; ++i) {
+        ids[i] = wut_create(take);
+    }
+    wut_yield();
+    wut_sem_post(&sem);
+    wut_sem_post(&sem);
+    wut_yield();
+    shared_memory[0] = taken;
+    shared_memory[1] = order[0];
+    shared_memory[2] = order[1];
+    wut_sem_post(&sem);
+    for (int i = 0; i < 3; ++i) {
+        wut_join(ids[i]);
+    }
+    shared_memory[3] = order[2];
+    shared_memory[4] = wut_sem_wait(&sem);
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], 2, "two posts should wake two waiters"
+    );
+    expect(
+        shared_memory[1], 1, "the first thread to wait should wake first"
+    );
+    expect(
+        shared_memory[2], 2, "the second thread to wait should wake second"
+    );
+    expect(
+        shared_memory[3], 3, "the last post should wake the last waiter"
+    );
+    expect(
+        shared_memory[4], -1, "waiting should fail if nobody could post"
+    );
+}
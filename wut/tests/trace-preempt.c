@@ -0,0 +1,45 @@
+#include "test.h"
+
+#include "wut.h"
+
+#include <stdlib.h> // mkstemp
+#include <unistd.h> // close, unlink
+
+#define WRITES 50
+
+static volatile int done = 0;
+
+void spin(void) {
+    while (!done) {
+    }
+}
+
+// A tick in the middle of writing must not switch to a thread that
+// records into a buffer the write holds
+void test(void) {
+    struct wut_config config = { .preempt_quantum_us = 200 };
+    wut_init_config(&config);
+    int first = wut_create(spin);
+    int second = wut_create(spin);
+    char path[] = "/tmp/wut-trace-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        return;
+    }
+    close(fd);
+    int written = 0;
+    for (int i = 0; i < WRITES; ++i) {
+        written += wut_trace_write(path) == 0;
+    }
+    unlink(path);
+    done = 1;
+    wut_join(first);
+    wut_join(second);
+    shared_memory[0] = written;
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], WRITES, "every write should finish"
+    );
+}
@@ -0,0 +1,83 @@
+#include "test.h"
+
+#include "wut.h"
+
+#include <stdio.h>    // fopen, fread
+#include <stdlib.h>   // mkstemp
+#include <string.h>   // strstr, strncmp
+#include <unistd.h>   // close, unlink
+
+void run(void) {
+    for (int i = 0; i < 3; ++i) {
+        wut_yield();
+    }
+    struct wut_trace_stats stats;
+    if (wut_trace_stats(wut_id(), &stats) == 0) {
+        shared_memory[wut_id()] = stats.runs;
+    }
+}
+
+void test(void) {
+    wut_init();
+    int first = wut_create(run);
+    int second = wut_create(run);
+    wut_join(first);
+    wut_join(second);
+
+    struct wut_trace_stats stats;
+    shared_memory[3] = wut_trace_stats(0, &stats);
+    shared_memory[4] = stats.runs;
+    shared_memory[5] = stats.run_ns > 0 && stats.join_ns > 0;
+    shared_memory[6] = wut_trace_stats(first, &stats);
+
+    char path[] = "/tmp/wut-trace-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        return;
+    }
+    close(fd);
+    shared_memory[7] = wut_trace_write(path);
+    static char json[1 << 16];
+    FILE *file = fopen(path, "r");
+    size_t length = fread(json, 1, sizeof(json) - 1, file);
+    fclose(file);
+    unlink(path);
+    json[length] = '\0';
+    shared_memory[8] = strncmp(json, "{\"displayTimeUnit\"", 18) == 0
+                       && strcmp(json + length - 3, "}}\n") == 0;
+    shared_memory[9] = strstr(json, "\"name\":\"run\",\"ph\":\"X\","
+                                    "\"pid\":0,\"tid\":2,") != NULL
+                       && strstr(json, "\"name\":\"join\"") != NULL
+                       && strstr(json, "\"name\":\"ready on worker 0\"")
+                          != NULL;
+}
+
+void check(void) {
+    expect(
+        shared_memory[1], 4, "the first thread should have run four times"
+    );
+    expect(
+        shared_memory[2], 4, "the second thread should have run four times"
+    );
+    expect(
+        shared_memory[3], 0, "wut_trace_stats should succeed"
+    );
+    expect(
+        shared_memory[4], 2, "the main thread should have run again once"
+    );
+    expect(
+        shared_memory[5], 1, "the main thread should have run and joined"
+    );
+    expect(
+        shared_memory[6], -1, "a joined thread should have no stats"
+    );
+    expect(
+        shared_memory[7], 0, "wut_trace_write should succeed"
+    );
+    expect(
+        shared_memory[8], 1, "the trace should be a JSON object"
+    );
+    expect(
+        shared_memory[9], 1, "the trace should have runs, joins and counters"
+    );
+}
@@ -0,0 +1,34 @@
+#include "test.h"
+
+#include "wut.h"
+
+#include <stdatomic.h> // atomic_store
+
+static atomic_int spinning = 0;
+
+void spin(void) {
+    for (;;) {
+        atomic_store(&spinning, 1);
+        wut_yield();
+    }
+}
+
+void test(void) {
+    struct wut_config config = { .workers = 2 };
+    wut_init_config(&config);
+    int id = wut_create(spin);
+    while (!atomic_load(&spinning)) {
+        wut_yield();
+    }
+    shared_memory[0] = wut_cancel(id);
+    shared_memory[1] = wut_join(id);
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], 0, "wut_cancel should return 0"
+    );
+    expect(
+        shared_memory[1], 128, "the cancelled thread should exit with 128"
+    );
+}
@@ -0,0 +1,68 @@
+#include "test.h"
+
+#include "wut.h"
+
+#include <stdatomic.h> // atomic_fetch_add
+
+#define STAGES 4
+#define ITEMS 10000
+
+static struct wut_chan *chans[STAGES + 1];
+static atomic_int next_stage = 0;
+
+void stage(void) {
+    int index = atomic_fetch_add(&next_stage, 1);
+    int value;
+    while (wut_chan_recv(chans[index], &value) == 0) {
+        value++;
+        wut_chan_send(chans[index + 1], &value);
+    }
+    wut_chan_close(chans[index + 1]);
+}
+
+void test(void) {
+    struct wut_config config = { .workers = 2 };
+    wut_init_config(&config);
+    for (int i = 0; i <= STAGES; ++i) {
+        chans[i] = wut_chan_create(sizeof(int), i % 2 == 0 ? 0 : 8);
+    }
+    int ids[STAGES];
+    for (int i = 0; i < STAGES; ++i) {
+        ids[i] = wut_create(stage);
+    }
+    int feeder_done = 0;
+    int received = 0;
+    int correct = 1;
+    int sent = 0;
+    while (received < ITEMS) {
+        int value = sent;
+        int result;
+        struct wut_chan_case cases[] = {
+            { .chan = chans[STAGES], .op = WUT_CHAN_RECV, .value = &result },
+            { .chan = chans[0], .op = WUT_CHAN_SEND, .value = &value },
+        };
+        int count = feeder_done ? 1 : 2;
+        if (wut_chan_select(cases, count) == 0) {
+            correct &= result == received + STAGES;
+            received++;
+        }
+        else if (++sent == ITEMS) {
+            feeder_done = 1;
+            wut_chan_close(chans[0]);
+        }
+    }
+    shared_memory[0] = received;
+    shared_memory[1] = correct;
+    for (int i = 0; i < STAGES; ++i) {
+        wut_join(ids[i]);
+    }
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], ITEMS, "every item should make it through"
+    );
+    expect(
+        shared_memory[1], 1, "every stage should see every item in order"
+    );
+}
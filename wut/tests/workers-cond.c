@@ -0,0 +1,49 @@
+#include "test.h"
+
+#include "wut.h"
+
+#define ROUNDS 1000
+
+static struct wut_mutex mutex;
+static struct wut_cond cond;
+static int turn = 0;
+static int turns = 0;
+
+// take every other turn with the other player, waiting for it in between
+static void play(int me) {
+    for (int i = 0; i < ROUNDS; ++i) {
+        wut_mutex_lock(&mutex);
+        while (turn != me) {
+            wut_cond_wait(&cond, &mutex);
+        }
+        turns++;
+        turn = !me;
+        wut_cond_signal(&cond);
+        wut_mutex_unlock(&mutex);
+    }
+}
+
+void ping(void) {
+    play(0);
+}
+
+void pong(void) {
+    play(1);
+}
+
+void test(void) {
+    struct wut_config config = { .workers = 4 };
+    wut_init_config(&config);
+    int ids[2] = { wut_create(ping), wut_create(pong) };
+    for (int i = 0; i < 2; ++i) {
+        wut_join(ids[i]);
+    }
+    shared_memory[0] = turns;
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], 2 * ROUNDS,
+        "a signal on another worker shouldn't get lost"
+    );
+}
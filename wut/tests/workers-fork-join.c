@@ -0,0 +1,45 @@
+#include "test.h"
+
+#include "wut.h"
+
+#include <stdatomic.h> // atomic_fetch_add
+
+#define NUM_THREADS 200
+
+static atomic_int ran = 0;
+
+void run(void) {
+    atomic_fetch_add(&ran, 1);
+    wut_yield();
+    wut_exit(wut_id() & 0xff);
+}
+
+void test(void) {
+    struct wut_config config = { .workers = 4 };
+    wut_init_config(&config);
+    int ids[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        ids[i] = wut_create(run);
+    }
+    int matching = 0;
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        if (wut_join(ids[i]) == (ids[i] & 0xff)) {
+            ++matching;
+        }
+    }
+    shared_memory[0] = matching;
+    shared_memory[1] = ran;
+    shared_memory[2] = wut_create(run);
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], NUM_THREADS, "every join should return its status"
+    );
+    expect(
+        shared_memory[1], NUM_THREADS, "every thread should run once"
+    );
+    expect(
+        shared_memory[2], 1, "every id should be free again"
+    );
+}
@@ -0,0 +1,46 @@
+#include "test.h"
+
+#include "wut.h"
+
+#include <unistd.h> // pipe
+
+#define NUM_PIPES 16
+
+static int fds[NUM_PIPES][2];
+
+void reader(void) {
+    int pipe_index = wut_id() - 1;
+    char buffer;
+    if (wut_read(fds[pipe_index][0], &buffer, 1) == 1 && buffer == 'x') {
+        wut_exit(1);
+    }
+}
+
+void test(void) {
+    struct wut_config config = { .workers = 2 };
+    wut_init_config(&config);
+    int ids[NUM_PIPES];
+    for (int i = 0; i < NUM_PIPES; ++i) {
+        if (pipe(fds[i]) == -1) {
+            return;
+        }
+        ids[i] = wut_create(reader);
+    }
+    for (int i = 0; i < NUM_PIPES; ++i) {
+        wut_yield();
+    }
+    for (int i = NUM_PIPES - 1; i >= 0; --i) {
+        wut_write(fds[i][1], "x", 1);
+    }
+    int read = 0;
+    for (int i = 0; i < NUM_PIPES; ++i) {
+        read += wut_join(ids[i]);
+    }
+    shared_memory[0] = read;
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], NUM_PIPES, "every reader should get its byte"
+    );
+}
@@ -0,0 +1,38 @@
+#include "test.h"
+
+#include "wut.h"
+
+#include <stdatomic.h> // atomic_fetch_add
+
+#define THREADS 16
+
+static atomic_int woken = 0;
+
+void sleeper(void) {
+    wut_sleep_ns((uint64_t) (wut_id() % 4 + 1) * 1000000);
+    atomic_fetch_add(&woken, 1);
+}
+
+void test(void) {
+    struct wut_config config = { .workers = 2 };
+    wut_init_config(&config);
+    int ids[THREADS];
+    for (int i = 0; i < THREADS; ++i) {
+        ids[i] = wut_create(sleeper);
+    }
+    int joined = 0;
+    for (int i = 0; i < THREADS; ++i) {
+        joined += wut_join(ids[i]) == 0;
+    }
+    shared_memory[0] = joined;
+    shared_memory[1] = atomic_load(&woken);
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], THREADS, "every sleeping thread should be joined"
+    );
+    expect(
+        shared_memory[1], THREADS, "every sleeping thread should wake up"
+    );
+}
@@ -0,0 +1,46 @@
+#include "test.h"
+
+#include "wut.h"
+
+#define THREADS 8
+#define ROUNDS 1000
+
+static struct wut_mutex mutex;
+static struct wut_sem done;
+static int counter = 0;
+
+void increment(void) {
+    for (int i = 0; i < ROUNDS; ++i) {
+        wut_mutex_lock(&mutex);
+        int value = counter;
+        if (i % 10 == 0) {
+            wut_yield();
+        }
+        counter = value + 1;
+        wut_mutex_unlock(&mutex);
+    }
+    wut_sem_post(&done);
+}
+
+void test(void) {
+    struct wut_config config = { .workers = 2 };
+    wut_init_config(&config);
+    int ids[THREADS];
+    for (int i = 0; i < THREADS; ++i) {
+        ids[i] = wut_create(increment);
+    }
+    for (int i = 0; i < THREADS; ++i) {
+        wut_sem_wait(&done);
+    }
+    shared_memory[0] = counter;
+    for (int i = 0; i < THREADS; ++i) {
+        wut_join(ids[i]);
+    }
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], THREADS * ROUNDS,
+        "only one thread on any worker should hold the mutex"
+    );
+}
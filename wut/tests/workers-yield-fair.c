@@ -0,0 +1,47 @@
+#include "test.h"
+
+#include "wut.h"
+
+#include <stdatomic.h> // atomic_*
+
+#define NUM_THREADS 8
+#define YIELDS 200000
+
+static atomic_int done = 0;
+static long counts[NUM_THREADS];
+
+void *count_yields(void *arg) {
+    long *counter = arg;
+    while (!atomic_load(&done)) {
+        ++*counter;
+        wut_yield();
+    }
+    return NULL;
+}
+
+// Every thread yields all the time, so all of them should get to run,
+// not just the two that were ready last
+void test(void) {
+    struct wut_config config = { .workers = 2 };
+    wut_init_config(&config);
+    int ids[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        ids[i] = wut_create_arg(count_yields, &counts[i]);
+    }
+    for (int i = 0; i < YIELDS; ++i) {
+        wut_yield();
+    }
+    atomic_store(&done, 1);
+    int starved = 0;
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        wut_join(ids[i]);
+        starved += counts[i] == 0;
+    }
+    shared_memory[0] = starved;
+}
+
+void check(void) {
+    expect(
+        shared_memory[0], 0, "no thread should starve with two workers"
+    );
+}